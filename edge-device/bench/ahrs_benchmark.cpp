@@ -0,0 +1,151 @@
+// Host benchmark for the orientation filter (src/Ahrs.cpp): accuracy and CPU
+// cost per update for a range of filter gains around AHRS_BETA.
+//
+//   pio run -e ahrs_benchmark && .pio/build/ahrs_benchmark/program
+// or
+//   g++ -O2 -I src bench/ahrs_benchmark.cpp src/Ahrs.cpp -o ahrs_benchmark
+//
+// A synthetic drive (slow yaw turns, body roll and pitch) is sampled at the
+// firmware rate (MPU_UPDATE_INTERVAL = 20 ms). The sensor readings get
+// noise and a constant gyro bias. The error is the angle between the true and
+// estimated quaternion once the filter has settled.
+//
+// The filter runs one gradient step per sample. Splitting dt into up to 15
+// steps was measured here before: 1.111 deg RMS at one step, 1.110 at 15, for
+// about ten times the cost.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "Ahrs.h"
+
+static const float SAMPLE_PERIOD = 0.02f;
+static const int SAMPLE_COUNT = 30000; // 10 minutes
+static const int SETTLE_SAMPLES = 1500;
+static const float DEG = 0.0174532925f;
+
+struct Sample {
+    Vector gyro;
+    Vector acc;
+    Vector mag;
+    Quaternion truth;
+};
+
+static Quaternion multiply(Quaternion a, Quaternion b) {
+    return {
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w
+    };
+}
+
+static Quaternion conjugate(Quaternion q) {
+    return {q.w, -q.x, -q.y, -q.z};
+}
+
+// Earth -> body, the inverse of Ahrs::toEarth
+static Vector toBody(Quaternion q, Vector v) {
+    Quaternion r = multiply(multiply(conjugate(q), {0, v.x, v.y, v.z}), q);
+    return {r.x, r.y, r.z};
+}
+
+static Quaternion fromEuler(float roll, float pitch, float yaw) {
+    Quaternion qx = {cosf(roll / 2), sinf(roll / 2), 0, 0};
+    Quaternion qy = {cosf(pitch / 2), 0, sinf(pitch / 2), 0};
+    Quaternion qz = {cosf(yaw / 2), 0, 0, sinf(yaw / 2)};
+    return multiply(multiply(qz, qy), qx);
+}
+
+// Cruise: slow turns and mild body motion. Swerve: fast lane changes.
+static Quaternion trajectory(bool isSwerve, float t) {
+    float yaw = 0.6f * sinf(0.05f * t) + 0.3f * t * DEG;
+    float roll = 4 * DEG * sinf(0.7f * t);
+    float pitch = 3 * DEG * sinf(0.45f * t + 1.0f);
+    if (isSwerve) {
+        yaw += 1.2f * sinf(2.0f * t);
+        roll += 15 * DEG * sinf(3.0f * t);
+    }
+    return fromEuler(roll, pitch, yaw);
+}
+
+static std::vector<Sample> generate(bool isSwerve) {
+
+    std::mt19937 rng(42);
+    std::normal_distribution<float> gyroNoise(0.0f, 0.3f * DEG);
+    std::normal_distribution<float> accNoise(0.0f, 0.02f);
+    std::normal_distribution<float> magNoise(0.0f, 0.01f);
+    const Vector gyroBias = {0.5f * DEG, -0.3f * DEG, 0.2f * DEG};
+
+    // Gravity reaction points up, the field points north and 50° down
+    const Vector gravity = {0, 0, 1};
+    const Vector field = {cosf(50 * DEG), 0, -sinf(50 * DEG)};
+
+    std::vector<Sample> samples(SAMPLE_COUNT);
+    for (int i = 0; i < SAMPLE_COUNT; i++) {
+        float t = i * SAMPLE_PERIOD;
+        Quaternion now = trajectory(isSwerve, t);
+        Quaternion next = trajectory(isSwerve, t + SAMPLE_PERIOD);
+        Quaternion delta = multiply(conjugate(now), next);
+        float scale = 2.0f / SAMPLE_PERIOD * (delta.w < 0 ? -1 : 1);
+
+        Vector acc = toBody(now, gravity);
+        Vector mag = toBody(now, field);
+        samples[i] = {
+            {delta.x * scale + gyroBias.x + gyroNoise(rng),
+             delta.y * scale + gyroBias.y + gyroNoise(rng),
+             delta.z * scale + gyroBias.z + gyroNoise(rng)},
+            {acc.x + accNoise(rng), acc.y + accNoise(rng), acc.z + accNoise(rng)},
+            {mag.x + magNoise(rng), mag.y + magNoise(rng), mag.z + magNoise(rng)},
+            next
+        };
+    }
+    return samples;
+}
+
+static float angleBetween(Quaternion a, Quaternion b) {
+    float dot = fabsf(a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z);
+    return 2.0f * acosf(dot > 1.0f ? 1.0f : dot) / DEG;
+}
+
+static const float BETAS[] = {0.025f, 0.05f, 0.1f, 0.2f, 0.4f};
+
+static void run(const char* name, const std::vector<Sample>& samples) {
+
+    printf("\n%s\n", name);
+    printf("    beta  rms error (deg)  max error (deg)  ns/update\n");
+
+    for (float beta : BETAS) {
+
+        Ahrs ahrs(beta);
+        double squaredError = 0;
+        float maxError = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < SAMPLE_COUNT; i++) {
+            ahrs.update(samples[i].gyro, samples[i].acc, samples[i].mag, SAMPLE_PERIOD);
+            if (i < SETTLE_SAMPLES) continue;
+            float error = angleBetween(ahrs.getQuaternion(), samples[i].truth);
+            squaredError += error * error;
+            if (error > maxError) maxError = error;
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        // Includes the error bookkeeping, which is the same for every setting
+        double nanos = std::chrono::duration<double, std::nano>(end - start).count() / SAMPLE_COUNT;
+
+        printf("%8.3f  %15.3f  %15.3f  %9.0f\n",
+            beta,
+            sqrt(squaredError / (SAMPLE_COUNT - SETTLE_SAMPLES)),
+            maxError,
+            nanos);
+    }
+}
+
+int main() {
+    run("cruise", generate(false));
+    run("swerve", generate(true));
+    return 0;
+}
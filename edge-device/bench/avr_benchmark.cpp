@@ -0,0 +1,249 @@
+// Cycle counts of the firmware hot paths on the ATmega2560, run under simavr:
+//
+//   python3 bench/run_avr_benchmark.py
+//
+// builds env:avr_benchmark, runs the image with
+//
+//   simavr -m atmega2560 -f 16000000 .pio/build/avr_benchmark/firmware.elf
+//
+// and checks cycles, stack and footprint against
+// bench/avr_benchmark_thresholds.json.
+//
+// Timer1 runs at the CPU clock, so its count is the cycle count. The Timer0
+// millis() interrupt is paused while a call is measured, and the timer
+// overhead is subtracted. Stack use is the depth reached below the caller,
+// found by painting the free RAM first. It includes any interrupt (UART)
+// taken during the call. Each result is printed as
+//
+//   BENCH <name> runs=<n> min=<cycles> avg=<cycles> max=<cycles> stack=<bytes>
+
+#include <Arduino.h>
+#include <avr/sleep.h>
+#include "MpuSensor.h"
+#include "GpsSensor.h"
+#include "ModemStream.h"
+#include "MqttPayload.h"
+#include "utilities.h"
+#include "Settings.h"
+
+// Not declared in a header; defined in GpsSensor.cpp
+void cleanResonse(char *str, int len);
+
+static const uint8_t STACK_PAINT = 0xC5;
+static const uint16_t BENCH_RUNS = 200;
+
+extern uint8_t __heap_start;
+extern char* __brkval;
+
+static volatile uint16_t timer1Overflows = 0;
+
+ISR(TIMER1_OVF_vect) {
+    timer1Overflows++;
+}
+
+// Answers every command line with a canned SIM808 response, or plays back
+// unsolicited output such as the NMEA stream
+class ScriptedStream : public Stream {
+public:
+    const char* response = "";
+
+    void play(const char* output) { pending = output; }
+
+    int available() override { return pending && *pending ? 1 : 0; }
+    int peek() override { return pending && *pending ? *pending : -1; }
+    int read() override {
+        if (!pending || !*pending) return -1;
+        return *pending++;
+    }
+    size_t write(uint8_t c) override {
+        if (c == '\n') pending = response;
+        return 1;
+    }
+    using Print::write;
+
+private:
+    const char* pending = nullptr;
+};
+
+static const char CGNSINF_RESPONSE[] =
+    "AT+CGNSINF\r\r\n"
+    "+CGNSINF: 1,1,20260315084512.000,35.702614,51.395812,1198.400,42.50,87.3,1,,0.9,1.2,0.8,,11,9,,,38,,\r\n"
+    "\r\n"
+    "OK\r\n";
+
+// One streamed fix, as AT+CGNSTST=1 sends it
+static const char NMEA_FIX[] =
+    "$GNGGA,084512.000,3542.15684,N,05123.74872,E,1,11,0.9,1198.4,M,-26.0,M,,*58\r\n"
+    "$GNRMC,084512.000,A,3542.15684,N,05123.74872,E,82.62,87.3,150326,,,A*4E\r\n";
+
+static ScriptedStream scriptedStream;
+static ModemStream modemStream(scriptedStream);
+static GpsSensor gpsSensor(modemStream);
+static MpuSensor mpuSensor;
+
+static unsigned long benchNow = 0;
+static char responseBuffer[sizeof(CGNSINF_RESPONSE)];
+static uint8_t payloadBuffer[MqttPayload::SIZE];
+static VehicleStatus status;
+static Vector location;
+static uint32_t sequence = 0;
+
+struct BenchResult {
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    uint32_t totalCycles;
+    uint16_t stack;
+};
+
+static inline void startCycles() {
+    cli();
+    TCNT1 = 0;
+    TIFR1 = _BV(TOV1);
+    timer1Overflows = 0;
+    sei();
+}
+
+static inline uint32_t readCycles() {
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t count = TCNT1;
+    uint16_t overflows = timer1Overflows;
+    // An overflow that has not been serviced yet
+    if ((TIFR1 & _BV(TOV1)) && count < 0x8000) overflows++;
+    SREG = sreg;
+    return ((uint32_t)overflows << 16) | count;
+}
+
+static uint8_t* freeRamBottom() {
+    return __brkval ? (uint8_t*)__brkval : &__heap_start;
+}
+
+static void noop() {}
+
+static uint32_t timerOverhead = 0;
+
+static BenchResult measure(void (*prepare)(), void (*function)(), uint16_t runs) {
+
+    BenchResult result = {0xFFFFFFFFUL, 0, 0, 0};
+
+    for (uint16_t run = 0; run < runs; run++) {
+        if (prepare) prepare();
+
+        // Paint everything below this frame; the call can only grow into it
+        uint8_t* base = (uint8_t*)SP;
+        for (uint8_t* p = freeRamBottom(); p < base - 2; p++) *p = STACK_PAINT;
+
+        TIMSK0 &= ~_BV(TOIE0);
+        startCycles();
+        function();
+        uint32_t cycles = readCycles();
+        TIMSK0 |= _BV(TOIE0);
+
+        cycles = cycles > timerOverhead ? cycles - timerOverhead : 0;
+        result.minCycles = min(result.minCycles, cycles);
+        result.maxCycles = max(result.maxCycles, cycles);
+        result.totalCycles += cycles;
+
+        uint8_t* p = freeRamBottom();
+        while (p < base && *p == STACK_PAINT) p++;
+        result.stack = max(result.stack, (uint16_t)(base - p));
+    }
+    return result;
+}
+
+static void report(const char* name, void (*prepare)(), void (*function)(), uint16_t runs = BENCH_RUNS) {
+
+    BenchResult result = measure(prepare, function, runs);
+
+    char line[112];
+    snprintf(line, sizeof(line), "BENCH %s runs=%u min=%lu avg=%lu max=%lu stack=%u",
+        name, runs, result.minCycles, result.totalCycles / runs, result.maxCycles, result.stack);
+    Serial.println(line);
+    Serial.flush();
+}
+
+// Benchmarked calls
+
+static void benchMpuUpdate() {
+    benchNow += Settings::get().mpuUpdateInterval;
+    mpuSensor.update(benchNow);
+}
+
+static void benchNewLocation() {
+    location = mpuSensor.getNewLocation(51.395812f, 35.702614f, 1198.4f);
+}
+
+static void prepareGpsStream() {
+    scriptedStream.play(NMEA_FIX);
+}
+
+static void benchUpdateGpsStream() {
+    gpsSensor.updateStream();
+}
+
+static void prepareCleanResponse() {
+    memcpy(responseBuffer, CGNSINF_RESPONSE, sizeof(CGNSINF_RESPONSE));
+}
+
+static void benchCleanResponse() {
+    cleanResonse(responseBuffer, sizeof(CGNSINF_RESPONSE) - 1);
+}
+
+static void benchSerializeStatus() {
+    MqttPayload::serialize(status, sequence++, payloadBuffer);
+}
+
+static void prepareLogger() {
+    // Start with an empty TX buffer so the line is only queued, never waited on
+    Serial.flush();
+}
+
+static void benchLoggerInfo() {
+    Logger::info("fix %ld %ld sats %u", 35702614L, 51395812L, 11);
+}
+
+void setup() {
+
+    Logger::setup();
+
+    // Timer1 at the CPU clock with overflows counted in software
+    TCCR1A = 0;
+    TCCR1B = _BV(CS10);
+    TIMSK1 = _BV(TOIE1);
+
+    timerOverhead = measure(nullptr, noop, 16).minCycles;
+
+    // The stub IMU is parked, so calibration completes on simulated time
+    mpuSensor.setup();
+    benchNow = millis();
+    while (!mpuSensor.isReady()) benchMpuUpdate();
+    Serial.println("BENCH imu ready");
+
+    status.time = {12, 45, 8, 15, 3, 2026, 250};
+    status.acceleration = {0.12f, -0.03f, 0.01f};
+    status.velocity = {11.2f, 3.4f, 0.0f};
+    status.angularVelocity = {0.01f, 0.0f, 0.2f};
+    status.orientation = {1.2f, -0.4f, 87.3f};
+    status.location = {51.395812f, 35.702614f, 1198.4f};
+    status.isLocationDeadReckoned = false;
+    status.locationFreshness = 180;
+    status.signalStrength = 70;
+    status.batteryStatus = -1;
+
+    report("mpu_update", nullptr, benchMpuUpdate);
+    report("get_new_location", nullptr, benchNewLocation);
+    report("update_gps_stream", prepareGpsStream, benchUpdateGpsStream);
+    report("clean_response", prepareCleanResponse, benchCleanResponse);
+    report("serialize_status", nullptr, benchSerializeStatus);
+    report("logger_info", prepareLogger, benchLoggerInfo, 20);
+
+    Serial.println("BENCH done");
+    Serial.flush();
+
+    // simavr stops once the CPU sleeps with interrupts off
+    cli();
+    sleep_enable();
+    sleep_cpu();
+}
+
+void loop() {}
@@ -0,0 +1,48 @@
+#ifndef __BENCH_MPU9250_H__
+    #define __BENCH_MPU9250_H__
+
+#include <Arduino.h>
+
+// Stand-in for hideakitai/MPU9250 in env:avr_benchmark. simavr has no IMU on
+// the I2C bus, so update() replays a parked vehicle: gravity on z, a field
+// pointing north and down, and a little deterministic noise on every axis.
+class MPU9250 {
+public:
+    bool setup(uint8_t) { return true; }
+    void ahrs(bool) {}
+    void calibrateAccelGyro() {}
+
+    bool update() {
+        seed = seed * 1103515245UL + 12345UL;
+        noise = ((int16_t)(seed >> 16) % 64) / 6400.0f;
+        return true;
+    }
+
+    float getAccX() const { return noise; }
+    float getAccY() const { return -noise; }
+    float getAccZ() const { return 1.0f + noise; }
+    float getGyroX() const { return 10.0f * noise; }
+    float getGyroY() const { return -10.0f * noise; }
+    float getGyroZ() const { return 5.0f * noise; }
+    float getMagX() const { return 200.0f + 100.0f * noise; }
+    float getMagY() const { return 100.0f * noise; }
+    float getMagZ() const { return -400.0f + 100.0f * noise; }
+    float getTemperature() const { return 30.0f; }
+
+    void setAccBias(float x, float y, float z) { accBias[0] = x; accBias[1] = y; accBias[2] = z; }
+    void setGyroBias(float x, float y, float z) { gyroBias[0] = x; gyroBias[1] = y; gyroBias[2] = z; }
+    float getAccBiasX() const { return accBias[0]; }
+    float getAccBiasY() const { return accBias[1]; }
+    float getAccBiasZ() const { return accBias[2]; }
+    float getGyroBiasX() const { return gyroBias[0]; }
+    float getGyroBiasY() const { return gyroBias[1]; }
+    float getGyroBiasZ() const { return gyroBias[2]; }
+
+private:
+    uint32_t seed = 1;
+    float noise = 0.0f;
+    float accBias[3] = {0.0f, 0.0f, 0.0f};
+    float gyroBias[3] = {0.0f, 0.0f, 0.0f};
+};
+
+#endif
@@ -0,0 +1,156 @@
+"""Builds env:avr_benchmark, runs it under simavr and checks it for regressions.
+
+    python3 bench/run_avr_benchmark.py            # report and check
+    python3 bench/run_avr_benchmark.py --record   # store the results as the new baseline
+
+Per benchmark it reports the cycle counts and stack depth printed by
+bench/avr_benchmark.cpp, plus the flash size of the symbols listed for it in
+bench/avr_benchmark_thresholds.json. The image's total flash and static SRAM
+(.data + .bss) come from the section headers. A value that exceeds its
+baseline by more than max_regression fails the run, and so does a value that
+has no baseline yet: record one with --record and commit it.
+
+Needs PlatformIO (pio) and simavr on PATH. The AVR binutils are taken from
+PATH or from PlatformIO's toolchain-atmelavr package.
+"""
+import argparse
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+from pathlib import Path
+
+PROJECT = Path(__file__).resolve().parent.parent
+THRESHOLDS = PROJECT / "bench" / "avr_benchmark_thresholds.json"
+ELF = PROJECT / ".pio" / "build" / "avr_benchmark" / "firmware.elf"
+SIMAVR_TIMEOUT = 300  # s
+
+BENCH_LINE = re.compile(r"BENCH (\w+) runs=(\d+) min=(\d+) avg=(\d+) max=(\d+) stack=(\d+)")
+ANSI_ESCAPE = re.compile(r"\x1b\[[0-9;]*m")
+
+
+def avr_tool(name: str) -> str:
+    found = shutil.which(name)
+    if found:
+        return found
+    packaged = Path.home() / ".platformio" / "packages" / "toolchain-atmelavr" / "bin" / name
+    if packaged.exists():
+        return str(packaged)
+    sys.exit(f"{name} not found; install avr-binutils or build once with PlatformIO")
+
+
+def build():
+    subprocess.run(["pio", "run", "-e", "avr_benchmark"], cwd=PROJECT, check=True)
+
+
+def run_simavr() -> dict[str, dict[str, int]]:
+    result = subprocess.run(
+        ["simavr", "-m", "atmega2560", "-f", "16000000", str(ELF)],
+        capture_output=True, text=True, timeout=SIMAVR_TIMEOUT,
+    )
+    # simavr echoes UART0 on stdout or stderr depending on the version
+    output = ANSI_ESCAPE.sub("", result.stdout + result.stderr)
+    if "BENCH done" not in output:
+        print(output)
+        sys.exit("benchmark image did not finish")
+
+    results = {}
+    for match in BENCH_LINE.finditer(output):
+        name, runs, low, avg, high, stack = match.groups()
+        results[name] = {"cycles_min": int(low), "cycles_avg": int(avg), "cycles_max": int(high), "stack": int(stack)}
+    return results
+
+
+def symbol_sizes() -> list[tuple[str, str, int]]:
+    """(demangled name, nm type, size) of every sized symbol in the image."""
+    output = subprocess.run(
+        [avr_tool("avr-nm"), "-C", "--print-size", "--size-sort", str(ELF)],
+        capture_output=True, text=True, check=True,
+    ).stdout
+    symbols = []
+    for line in output.splitlines():
+        parts = line.split(maxsplit=3)
+        if len(parts) == 4:
+            _, size, kind, name = parts
+            symbols.append((name, kind, int(size, 16)))
+    return symbols
+
+
+def section_totals() -> dict[str, int]:
+    output = subprocess.run(
+        [avr_tool("avr-size"), "-A", str(ELF)], capture_output=True, text=True, check=True,
+    ).stdout
+    sections = {}
+    for line in output.splitlines():
+        parts = line.split()
+        if len(parts) >= 2 and parts[0].startswith(".") and parts[1].isdigit():
+            sections[parts[0]] = int(parts[1])
+    return {
+        "flash": sections.get(".text", 0) + sections.get(".data", 0),
+        "sram": sections.get(".data", 0) + sections.get(".bss", 0),
+    }
+
+
+def flash_of(symbols: list[tuple[str, str, int]], patterns: list[str]) -> int:
+    """Code size of the functions whose name starts with one of the patterns."""
+    return sum(size for name, kind, size in symbols
+               if kind in "tTwW" and any(name.startswith(pattern) for pattern in patterns))
+
+
+def check(name: str, metric: str, value: int, baseline: dict, max_regression: float, record: bool) -> bool:
+    reference = baseline.get(metric)
+    if reference is None:
+        print(f"  {metric:<11}{value:>10}   (no baseline)")
+        return record
+    limit = reference * (1 + max_regression)
+    ok = value <= limit
+    change = (value - reference) / reference * 100 if reference else 0.0
+    print(f"  {metric:<11}{value:>10}   baseline {reference:>8}  {change:+6.1f}%  {'ok' if ok else 'REGRESSION'}")
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--record", action="store_true", help="store this run as the baseline")
+    parser.add_argument("--no-build", action="store_true", help="reuse the existing image")
+    args = parser.parse_args()
+
+    thresholds = json.loads(THRESHOLDS.read_text())
+    max_regression = thresholds["max_regression"]
+
+    if not args.no_build:
+        build()
+    results = run_simavr()
+    symbols = symbol_sizes()
+
+    ok = True
+    for name, bench in thresholds["benchmarks"].items():
+        if name not in results:
+            print(f"{name}: missing from the benchmark output")
+            ok = False
+            continue
+        measured = dict(results[name], flash=flash_of(symbols, bench["symbols"]))
+        print(name)
+        for metric, value in measured.items():
+            ok &= check(name, metric, value, bench.get("baseline", {}), max_regression, args.record)
+        if args.record:
+            bench["baseline"] = measured
+
+    totals = section_totals()
+    print("image")
+    for metric, value in totals.items():
+        ok &= check("image", metric, value, thresholds.get("image", {}), max_regression, args.record)
+    if args.record:
+        thresholds["image"] = totals
+        THRESHOLDS.write_text(json.dumps(thresholds, indent=2) + "\n")
+        print(f"baseline written to {os.path.relpath(THRESHOLDS)}")
+        return
+
+    if not ok:
+        sys.exit(f"regression above {max_regression:.0%} of the baseline, or no baseline to check against")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,99 @@
+# PlatformIO post-build script: static RAM (.data + .bss) per module, the
+# flash used by the image and a budget check. Enabled per environment with
+#
+#   extra_scripts = post:scripts/ram_report.py
+#   custom_sram_stack_reserve = <bytes>
+#
+# Every object file of the build is grouped into a module: one per source file
+# in src/, one per library and one for the Arduino core. The build fails when
+# the linked image leaves less than the reserve for heap and stack.
+
+import subprocess
+from collections import defaultdict
+from pathlib import Path
+
+Import("env")  # noqa: F821 (provided by PlatformIO)
+
+SRAM_SIZE = 8192  # ATmega2560
+DATA_SYMBOL_TYPES = set("bBdDvV")
+
+
+def module_of(build_dir: Path, obj: Path) -> str:
+    parts = obj.relative_to(build_dir).parts
+    if parts[0] == "src":
+        return Path(*parts[1:]).with_suffix("").with_suffix("").as_posix()
+    # lib<hash>/<LibraryName>/..., FrameworkArduino/...
+    return parts[1] if parts[0].startswith("lib") and len(parts) > 2 else parts[0]
+
+
+def data_symbols(nm: str, obj: Path, tool_env: dict) -> list[tuple[str, int]]:
+    output = subprocess.run(
+        [nm, "-C", "--print-size", str(obj)], capture_output=True, text=True, env=tool_env,
+    ).stdout
+    symbols = []
+    for line in output.splitlines():
+        parts = line.split(maxsplit=3)
+        if len(parts) == 4 and parts[2] in DATA_SYMBOL_TYPES:
+            symbols.append((parts[3], int(parts[1], 16)))
+    return symbols
+
+
+def linked_sections(size_tool: str, elf: str, tool_env: dict) -> dict[str, int]:
+    output = subprocess.run([size_tool, "-A", elf], capture_output=True, text=True, env=tool_env).stdout
+    sections = {}
+    for line in output.splitlines():
+        parts = line.split()
+        if len(parts) >= 2 and parts[0].startswith(".") and parts[1].isdigit():
+            sections[parts[0]] = int(parts[1])
+    return sections
+
+
+def ram_report(source, target, env):
+    build_dir = Path(env.subst("$BUILD_DIR"))
+    tool_env = env["ENV"]
+    nm = env.subst("$CC").replace("gcc", "nm")
+    size_tool = env.subst("$CC").replace("gcc", "size")
+    reserve = int(env.GetProjectOption("custom_sram_stack_reserve", "2048"))
+
+    modules = defaultdict(int)
+    largest = []
+    seen = set()
+    for obj in sorted(build_dir.rglob("*.o")):
+        module = module_of(build_dir, obj)
+        for name, size in data_symbols(nm, obj, tool_env):
+            # Inline and template statics are emitted in every user; the linker keeps one
+            if name in seen:
+                continue
+            seen.add(name)
+            modules[module] += size
+            largest.append((size, name, module))
+
+    sections = linked_sections(size_tool, str(target[0]), tool_env)
+    linked = sections.get(".data", 0) + sections.get(".bss", 0) + sections.get(".noinit", 0)
+    # Initial values of .data are stored in flash as well
+    flash = sections.get(".text", 0) + sections.get(".data", 0)
+    flash_size = int(env.BoardConfig().get("upload.maximum_size", 253952))
+    attributed = sum(modules.values())
+
+    print("\nStatic RAM per module (.data + .bss)")
+    for module, size in sorted(modules.items(), key=lambda item: -item[1]):
+        if size:
+            print(f"  {module:<32}{size:>6} B")
+    if linked > attributed:
+        print(f"  {'(toolchain libraries)':<32}{linked - attributed:>6} B")
+
+    print("Largest objects")
+    for size, name, module in sorted(largest, reverse=True)[:10]:
+        print(f"  {name:<40}{size:>6} B  {module}")
+
+    free = SRAM_SIZE - linked
+    print(f"Profile {env.subst('$PIOENV')}")
+    print(f"  Flash {flash} B of {flash_size} B ({100 * flash / flash_size:.1f}%)")
+    print(f"  Static RAM {linked} B, {free} B left for heap and stack (reserve {reserve} B)\n")
+    if free < reserve:
+        print(f"Error: static RAM leaves {free} B, below custom_sram_stack_reserve = {reserve} B")
+        return 1
+    return 0
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", ram_report)  # noqa: F821
@@ -0,0 +1,174 @@
+#include "Ahrs.h"
+#include <math.h>
+
+static const float AHRS_RAD_TO_DEG = 57.2957795f;
+
+static float invSqrt(float x) {
+    return 1.0f / sqrtf(x);
+}
+
+Ahrs::Ahrs(float beta) : beta(beta) {
+    reset();
+}
+
+void Ahrs::reset() {
+    q = {1.0f, 0.0f, 0.0f, 0.0f};
+}
+
+void Ahrs::setBeta(float value) {
+    beta = value;
+}
+
+Quaternion Ahrs::getQuaternion() const {
+    return q;
+}
+
+void Ahrs::update(Vector gyro, Vector acc, Vector mag, float dt) {
+
+    if (mag.x == 0.0f && mag.y == 0.0f && mag.z == 0.0f) {
+        stepImu(gyro, acc, dt);
+    } else {
+        step(gyro, acc, mag, dt);
+    }
+}
+
+// v' = q v q*, written out (15 multiplies)
+Vector Ahrs::toEarth(Vector v) const {
+    float tx = 2.0f * (q.y * v.z - q.z * v.y);
+    float ty = 2.0f * (q.z * v.x - q.x * v.z);
+    float tz = 2.0f * (q.x * v.y - q.y * v.x);
+    return {
+        v.x + q.w * tx + q.y * tz - q.z * ty,
+        v.y + q.w * ty + q.z * tx - q.x * tz,
+        v.z + q.w * tz + q.x * ty - q.y * tx
+    };
+}
+
+Vector Ahrs::getEuler() const {
+    float sinPitch = 2.0f * (q.w * q.y - q.z * q.x);
+    if (sinPitch > 1.0f) sinPitch = 1.0f;
+    if (sinPitch < -1.0f) sinPitch = -1.0f;
+    return {
+        atan2f(2.0f * (q.w * q.x + q.y * q.z), 1.0f - 2.0f * (q.x * q.x + q.y * q.y)) * AHRS_RAD_TO_DEG,
+        asinf(sinPitch) * AHRS_RAD_TO_DEG,
+        atan2f(2.0f * (q.w * q.z + q.x * q.y), 1.0f - 2.0f * (q.y * q.y + q.z * q.z)) * AHRS_RAD_TO_DEG
+    };
+}
+
+// One gradient-descent step of Madgwick's MARG algorithm
+void Ahrs::step(Vector g, Vector a, Vector m, float dt) {
+
+    float q0 = q.w, q1 = q.x, q2 = q.y, q3 = q.z;
+
+    float qDot1 = 0.5f * (-q1 * g.x - q2 * g.y - q3 * g.z);
+    float qDot2 = 0.5f * (q0 * g.x + q2 * g.z - q3 * g.y);
+    float qDot3 = 0.5f * (q0 * g.y - q1 * g.z + q3 * g.x);
+    float qDot4 = 0.5f * (q0 * g.z + q1 * g.y - q2 * g.x);
+
+    if (!(a.x == 0.0f && a.y == 0.0f && a.z == 0.0f)) {
+
+        float recipNorm = invSqrt(a.x * a.x + a.y * a.y + a.z * a.z);
+        a.x *= recipNorm; a.y *= recipNorm; a.z *= recipNorm;
+
+        recipNorm = invSqrt(m.x * m.x + m.y * m.y + m.z * m.z);
+        m.x *= recipNorm; m.y *= recipNorm; m.z *= recipNorm;
+
+        float _2q0mx = 2.0f * q0 * m.x;
+        float _2q0my = 2.0f * q0 * m.y;
+        float _2q0mz = 2.0f * q0 * m.z;
+        float _2q1mx = 2.0f * q1 * m.x;
+        float _2q0 = 2.0f * q0;
+        float _2q1 = 2.0f * q1;
+        float _2q2 = 2.0f * q2;
+        float _2q3 = 2.0f * q3;
+        float _2q0q2 = 2.0f * q0 * q2;
+        float _2q2q3 = 2.0f * q2 * q3;
+        float q0q0 = q0 * q0;
+        float q0q1 = q0 * q1;
+        float q0q2 = q0 * q2;
+        float q0q3 = q0 * q3;
+        float q1q1 = q1 * q1;
+        float q1q2 = q1 * q2;
+        float q1q3 = q1 * q3;
+        float q2q2 = q2 * q2;
+        float q2q3 = q2 * q3;
+        float q3q3 = q3 * q3;
+
+        // Reference direction of the earth's magnetic field
+        float hx = m.x * q0q0 - _2q0my * q3 + _2q0mz * q2 + m.x * q1q1 + _2q1 * m.y * q2 + _2q1 * m.z * q3 - m.x * q2q2 - m.x * q3q3;
+        float hy = _2q0mx * q3 + m.y * q0q0 - _2q0mz * q1 + _2q1mx * q2 - m.y * q1q1 + m.y * q2q2 + _2q2 * m.z * q3 - m.y * q3q3;
+        float _2bx = sqrtf(hx * hx + hy * hy);
+        float _2bz = -_2q0mx * q2 + _2q0my * q1 + m.z * q0q0 + _2q1mx * q3 - m.z * q1q1 + _2q2 * m.y * q3 - m.z * q2q2 + m.z * q3q3;
+        float _4bx = 2.0f * _2bx;
+        float _4bz = 2.0f * _2bz;
+
+        float s0 = -_2q2 * (2.0f * q1q3 - _2q0q2 - a.x) + _2q1 * (2.0f * q0q1 + _2q2q3 - a.y) - _2bz * q2 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - m.x) + (-_2bx * q3 + _2bz * q1) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - m.y) + _2bx * q2 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - m.z);
+        float s1 = _2q3 * (2.0f * q1q3 - _2q0q2 - a.x) + _2q0 * (2.0f * q0q1 + _2q2q3 - a.y) - 4.0f * q1 * (1 - 2.0f * q1q1 - 2.0f * q2q2 - a.z) + _2bz * q3 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - m.x) + (_2bx * q2 + _2bz * q0) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - m.y) + (_2bx * q3 - _4bz * q1) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - m.z);
+        float s2 = -_2q0 * (2.0f * q1q3 - _2q0q2 - a.x) + _2q3 * (2.0f * q0q1 + _2q2q3 - a.y) - 4.0f * q2 * (1 - 2.0f * q1q1 - 2.0f * q2q2 - a.z) + (-_4bx * q2 - _2bz * q0) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - m.x) + (_2bx * q1 + _2bz * q3) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - m.y) + (_2bx * q0 - _4bz * q2) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - m.z);
+        float s3 = _2q1 * (2.0f * q1q3 - _2q0q2 - a.x) + _2q2 * (2.0f * q0q1 + _2q2q3 - a.y) + (-_4bx * q3 + _2bz * q1) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - m.x) + (-_2bx * q0 + _2bz * q2) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - m.y) + _2bx * q1 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - m.z);
+
+        recipNorm = invSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+        qDot1 -= beta * s0 * recipNorm;
+        qDot2 -= beta * s1 * recipNorm;
+        qDot3 -= beta * s2 * recipNorm;
+        qDot4 -= beta * s3 * recipNorm;
+    }
+
+    q0 += qDot1 * dt;
+    q1 += qDot2 * dt;
+    q2 += qDot3 * dt;
+    q3 += qDot4 * dt;
+
+    float recipNorm = invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    q = {q0 * recipNorm, q1 * recipNorm, q2 * recipNorm, q3 * recipNorm};
+}
+
+// Accelerometer-only correction when no magnetometer reading is available
+void Ahrs::stepImu(Vector g, Vector a, float dt) {
+
+    float q0 = q.w, q1 = q.x, q2 = q.y, q3 = q.z;
+
+    float qDot1 = 0.5f * (-q1 * g.x - q2 * g.y - q3 * g.z);
+    float qDot2 = 0.5f * (q0 * g.x + q2 * g.z - q3 * g.y);
+    float qDot3 = 0.5f * (q0 * g.y - q1 * g.z + q3 * g.x);
+    float qDot4 = 0.5f * (q0 * g.z + q1 * g.y - q2 * g.x);
+
+    if (!(a.x == 0.0f && a.y == 0.0f && a.z == 0.0f)) {
+
+        float recipNorm = invSqrt(a.x * a.x + a.y * a.y + a.z * a.z);
+        a.x *= recipNorm; a.y *= recipNorm; a.z *= recipNorm;
+
+        float _2q0 = 2.0f * q0;
+        float _2q1 = 2.0f * q1;
+        float _2q2 = 2.0f * q2;
+        float _2q3 = 2.0f * q3;
+        float _4q0 = 4.0f * q0;
+        float _4q1 = 4.0f * q1;
+        float _4q2 = 4.0f * q2;
+        float _8q1 = 8.0f * q1;
+        float _8q2 = 8.0f * q2;
+        float q0q0 = q0 * q0;
+        float q1q1 = q1 * q1;
+        float q2q2 = q2 * q2;
+        float q3q3 = q3 * q3;
+
+        float s0 = _4q0 * q2q2 + _2q2 * a.x + _4q0 * q1q1 - _2q1 * a.y;
+        float s1 = _4q1 * q3q3 - _2q3 * a.x + 4.0f * q0q0 * q1 - _2q0 * a.y - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * a.z;
+        float s2 = 4.0f * q0q0 * q2 + _2q0 * a.x + _4q2 * q3q3 - _2q3 * a.y - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * a.z;
+        float s3 = 4.0f * q1q1 * q3 - _2q1 * a.x + 4.0f * q2q2 * q3 - _2q2 * a.y;
+
+        recipNorm = invSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+        qDot1 -= beta * s0 * recipNorm;
+        qDot2 -= beta * s1 * recipNorm;
+        qDot3 -= beta * s2 * recipNorm;
+        qDot4 -= beta * s3 * recipNorm;
+    }
+
+    q0 += qDot1 * dt;
+    q1 += qDot2 * dt;
+    q2 += qDot3 * dt;
+    q3 += qDot4 * dt;
+
+    float recipNorm = invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    q = {q0 * recipNorm, q1 * recipNorm, q2 * recipNorm, q3 * recipNorm};
+}
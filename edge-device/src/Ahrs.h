@@ -0,0 +1,43 @@
+#ifndef __AHRS_H__
+    #define __AHRS_H__
+
+#include <stdint.h>
+#include "dataStructures.h"
+
+struct Quaternion {
+    float w;
+    float x;
+    float y;
+    float z;
+};
+
+// Madgwick MARG filter that keeps the orientation as a quaternion. Each sample
+// costs one fixed-size gradient step, so the cost per sample is constant.
+// Splitting dt into more steps buys no accuracy (bench/ahrs_benchmark.cpp).
+// No Arduino dependency: also builds on the host.
+//
+// Earth frame: x = magnetic north, y = west, z = up (along the specific force
+// measured at rest).
+class Ahrs {
+public:
+    Ahrs(float beta = 0.1f);
+
+    // gyro in rad/s, acc in any unit, mag in any unit (all zero = 6-axis update)
+    void update(Vector gyro, Vector acc, Vector mag, float dt);
+
+    void setBeta(float beta);
+    void reset();
+
+    Quaternion getQuaternion() const;
+    Vector toEarth(Vector body) const;   // body frame -> earth frame
+    Vector getEuler() const;             // roll, pitch, yaw in degrees
+
+private:
+    void step(Vector gyro, Vector acc, Vector mag, float dt);
+    void stepImu(Vector gyro, Vector acc, float dt);
+
+    Quaternion q;
+    float beta;
+};
+
+#endif
@@ -0,0 +1,26 @@
+#include "AsyncGsmClient.h"
+
+AsyncGsmClient::AsyncGsmClient(TinyGsm& gsmModem) : TinyGsmClient(gsmModem) {}
+
+bool AsyncGsmClient::startConnect(const char* host, uint16_t port) {
+
+    if (sock_connected) stop(MODEM_COMMAND_TIMEOUT);
+    rx.clear();
+    at->sendAT(GF("+CIPSTART="), mux, ',', GF("\"TCP"), GF("\",\""), host, GF("\","), port);
+    return at->waitResponse(MODEM_COMMAND_TIMEOUT) == 1;
+}
+
+SocketState AsyncGsmClient::pollConnect() {
+
+    at->sendAT(GF("+CIPSTATUS="), mux);
+    int8_t result = at->waitResponse(MODEM_COMMAND_TIMEOUT, GF(",\"CONNECTED\""), GF(",\"CONNECTING\""),
+                                     GF(",\"CLOSED\""), GF(",\"INITIAL\""), GF("ERROR"));
+    at->waitResponse(MODEM_COMMAND_TIMEOUT);
+
+    if (result == 1) {
+        // What TinyGsmClient::connect() sets once CONNECT OK arrives
+        sock_connected = true;
+        return SocketState::CONNECTED;
+    }
+    return result >= 3 ? SocketState::FAILED : SocketState::PENDING;
+}
@@ -0,0 +1,23 @@
+#ifndef __ASYNC_GSM_CLIENT_H__
+    #define __ASYNC_GSM_CLIENT_H__
+
+#include "config.h"
+#include <TinyGsmClient.h>
+
+enum class SocketState : uint8_t {
+    PENDING,
+    CONNECTED,
+    FAILED
+};
+
+// TinyGsmClient whose TCP connect is split in two: startConnect() issues
+// CIPSTART and pollConnect() reads CIPSTATUS, each a single short AT exchange,
+// instead of blocking until the modem reports CONNECT OK (up to 75 s).
+class AsyncGsmClient : public TinyGsmClient {
+public:
+    explicit AsyncGsmClient(TinyGsm& gsmModem);
+    bool startConnect(const char* host, uint16_t port);
+    SocketState pollConnect();
+};
+
+#endif
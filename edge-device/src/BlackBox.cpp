@@ -0,0 +1,117 @@
+#include "BlackBox.h"
+#include "Settings.h"
+#include "utilities.h"
+#include <string.h>
+
+static int16_t quantize(float value, float scale) {
+    float scaled = value * scale;
+    if (scaled > 32767.0f) return 32767;
+    if (scaled < -32768.0f) return -32768;
+    return (int16_t)lround(scaled);
+}
+
+BlackBox::BlackBox()
+    :   head(0),
+        count(0),
+        state(BlackBoxState::RECORDING),
+        postRemaining(0),
+        captureId(0),
+        triggerEpoch(0),
+        sampleInterval(0),
+        nextChunk(0) {}
+
+// acceleration in g, angular velocity in deg/s, straight from the sensor
+void BlackBox::record(unsigned long now, uint32_t epoch, const Vector& acceleration, const Vector& angularVelocity) {
+
+    if (state == BlackBoxState::FROZEN) return;
+
+    BlackBoxSample& sample = samples[head];
+    sample.acceleration[0] = quantize(acceleration.x, BLACKBOX_ACCEL_SCALE);
+    sample.acceleration[1] = quantize(acceleration.y, BLACKBOX_ACCEL_SCALE);
+    sample.acceleration[2] = quantize(acceleration.z, BLACKBOX_ACCEL_SCALE);
+    sample.angularVelocity[0] = quantize(angularVelocity.x, BLACKBOX_GYRO_SCALE);
+    sample.angularVelocity[1] = quantize(angularVelocity.y, BLACKBOX_GYRO_SCALE);
+    sample.angularVelocity[2] = quantize(angularVelocity.z, BLACKBOX_GYRO_SCALE);
+    head = (head + 1) % BLACKBOX_SAMPLES;
+    if (count < BLACKBOX_SAMPLES) count++;
+
+    if (state == BlackBoxState::CAPTURING) {
+        if (--postRemaining == 0) {
+            state = BlackBoxState::FROZEN;
+            nextChunk = 0;
+            Logger::info("black box frozen, %u samples in %u chunks", count, getChunkCount());
+        }
+        return;
+    }
+
+    float magnitude = sqrt(acceleration.x * acceleration.x + acceleration.y * acceleration.y + acceleration.z * acceleration.z);
+    if (fabs(magnitude - 1.0f) > BLACKBOX_TRIGGER_SHOCK) trigger(now, epoch);
+}
+
+// The sample recorded last is the trigger sample
+void BlackBox::trigger(unsigned long now, uint32_t epoch) {
+
+    if (state != BlackBoxState::RECORDING || count == 0) return;
+
+    state = BlackBoxState::CAPTURING;
+    postRemaining = BLACKBOX_POST_SAMPLES;
+    captureId = now;
+    triggerEpoch = epoch;
+    sampleInterval = Settings::get().mpuUpdateInterval;
+    Logger::warn("black box triggered");
+}
+
+bool BlackBox::hasChunk() const {
+    return state == BlackBoxState::FROZEN;
+}
+
+size_t BlackBox::peekChunk(uint8_t* buffer) const {
+
+    if (!hasChunk()) return 0;
+
+    uint16_t triggerIndex = count - 1 - BLACKBOX_POST_SAMPLES;
+    uint8_t chunkCount = getChunkCount();
+    uint16_t first = nextChunk * BLACKBOX_CHUNK_SAMPLES;
+    uint16_t last = min((uint16_t)(first + BLACKBOX_CHUNK_SAMPLES), count);
+
+    size_t offset = 0;
+    memcpy(&buffer[offset], &captureId, sizeof(uint32_t));
+    offset += sizeof(uint32_t);
+    memcpy(&buffer[offset], &triggerEpoch, sizeof(uint32_t));
+    offset += sizeof(uint32_t);
+    memcpy(&buffer[offset], &sampleInterval, sizeof(uint16_t));
+    offset += sizeof(uint16_t);
+    memcpy(&buffer[offset], &triggerIndex, sizeof(uint16_t));
+    offset += sizeof(uint16_t);
+    memcpy(&buffer[offset], &count, sizeof(uint16_t));
+    offset += sizeof(uint16_t);
+    buffer[offset++] = nextChunk;
+    buffer[offset++] = chunkCount;
+
+    for (uint16_t i = first; i < last; i++) {
+        memcpy(&buffer[offset], &at(i), sizeof(BlackBoxSample));
+        offset += sizeof(BlackBoxSample);
+    }
+    return offset;
+}
+
+// The chunk went out; after the last one the ring starts over
+void BlackBox::popChunk() {
+
+    if (!hasChunk()) return;
+    if (++nextChunk < getChunkCount()) return;
+
+    Logger::info("black box capture uploaded");
+    state = BlackBoxState::RECORDING;
+    count = 0;
+    head = 0;
+}
+
+// index 0 is the oldest sample
+const BlackBoxSample& BlackBox::at(uint16_t index) const {
+    return samples[(head + BLACKBOX_SAMPLES - count + index) % BLACKBOX_SAMPLES];
+}
+
+uint8_t BlackBox::getChunkCount() const {
+    return (count + BLACKBOX_CHUNK_SAMPLES - 1) / BLACKBOX_CHUNK_SAMPLES;
+}
@@ -0,0 +1,76 @@
+#ifndef __BLACK_BOX_H__
+    #define __BLACK_BOX_H__
+
+#include "config.h"
+#include "dataStructures.h"
+
+// Raw IMU sample quantized with BLACKBOX_ACCEL_SCALE / BLACKBOX_GYRO_SCALE
+struct BlackBoxSample {
+    int16_t acceleration[3];
+    int16_t angularVelocity[3];
+};
+
+enum class BlackBoxState : uint8_t {
+    RECORDING,   // ring keeps the latest samples
+    CAPTURING,   // triggered, recording the post-trigger samples
+    FROZEN       // capture complete, waiting for the uplink
+};
+
+// Circular buffer of raw accel/gyro samples at the IMU sampling rate. A shock
+// freezes it once BLACKBOX_POST_SAMPLES more samples are in, keeping the
+// moments before and after the trigger. The capture then goes out as numbered
+// chunks; a chunk is only dropped once it was published, so an upload cut by
+// a link loss resumes where it stopped.
+//
+// Chunk (little-endian): u32 capture id, u32 trigger time (s since 2000 UTC,
+// 0 if unknown), u16 sample interval (ms), u16 trigger index, u16 samples in
+// the capture, u8 chunk index, u8 chunk count, then up to
+// BLACKBOX_CHUNK_SAMPLES samples of 6 x i16 (accel x y z, gyro x y z).
+class BlackBox {
+public:
+    static constexpr bool ENABLED = true;
+    static constexpr size_t CHUNK_HEADER_SIZE = 16;
+    static constexpr size_t CHUNK_SIZE = CHUNK_HEADER_SIZE + BLACKBOX_CHUNK_SAMPLES * sizeof(BlackBoxSample);
+
+    BlackBox();
+    void record(unsigned long now, uint32_t epoch, const Vector& acceleration, const Vector& angularVelocity);
+    void trigger(unsigned long now, uint32_t epoch);
+    bool hasChunk() const;
+    size_t peekChunk(uint8_t* buffer) const;
+    void popChunk();
+
+private:
+    const BlackBoxSample& at(uint16_t index) const;
+    uint8_t getChunkCount() const;
+
+    BlackBoxSample samples[BLACKBOX_SAMPLES];
+    uint16_t head;
+    uint16_t count;
+    BlackBoxState state;
+    uint16_t postRemaining;
+    uint32_t captureId;
+    uint32_t triggerEpoch;
+    uint16_t sampleInterval;
+    uint8_t nextChunk;
+};
+
+// Stand-in for builds without BLACKBOX_ENABLED; never has a capture to upload
+class NoBlackBox {
+public:
+    static constexpr bool ENABLED = false;
+    static constexpr size_t CHUNK_SIZE = 1;     // keeps chunk buffers declared against it valid
+
+    void record(unsigned long, uint32_t, const Vector&, const Vector&) {}
+    void trigger(unsigned long, uint32_t) {}
+    bool hasChunk() const { return false; }
+    size_t peekChunk(uint8_t*) const { return 0; }
+    void popChunk() {}
+};
+
+#if BLACKBOX_ENABLED
+using ImuRecorder = BlackBox;
+#else
+using ImuRecorder = NoBlackBox;
+#endif
+
+#endif
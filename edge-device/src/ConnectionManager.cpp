@@ -0,0 +1,320 @@
+#include "ConnectionManager.h"
+#include "utilities.h"
+
+static const char* const LINK_STATE_NAMES[] = {"modem", "network", "gprs", "mqtt", "connected"};
+
+// Phases of the GPRS step: the sequence TinyGSM's gprsConnect() runs
+enum GprsPhase : uint8_t {
+    GPRS_SHUT,          // drop any half-open context
+    GPRS_ATTACH,        // poll CGATT, requesting attach once and then waiting for its answer
+    GPRS_MUX,
+    GPRS_QUICK_SEND,
+    GPRS_MANUAL_RECEIVE,
+    GPRS_APN,
+    GPRS_ACTIVATE,      // CIICR, its answer read in GPRS_ACTIVE
+    GPRS_ACTIVE,        // wait for CIICR's answer, then confirm with CIPSTATUS
+    GPRS_ADDRESS,
+    GPRS_DNS
+};
+
+// Phases of the MQTT step
+enum MqttPhase : uint8_t {
+    MQTT_TCP_START,     // CIPSTART, not waited for
+    MQTT_TCP_OPEN,      // poll CIPSTATUS until the socket is connected
+    MQTT_SESSION        // CONNECT/CONNACK, bounded by MQTT_CONNACK_TIMEOUT
+};
+
+ConnectionManager::ConnectionManager(ModemStream& modemStream, TinyGsm& gsmModem, AsyncGsmClient& gsmClient, PubSubClient& mqttClient)
+    :   modemStream(modemStream),
+        gsmModem(gsmModem),
+        gsmClient(gsmClient),
+        mqttClient(mqttClient),
+        state(LinkState::MODEM),
+        phase(0),
+        isAttachRequested(false),
+        stepStart(0),
+        phaseStart(0),
+        nextAttempt(0),
+        backoff(CONNECTION_BACKOFF_MIN),
+        stepFailures(0),
+        stepLatency{0, 0, 0, 0} {}
+
+void ConnectionManager::update(unsigned long now) {
+
+    if ((long)(now - nextAttempt) < 0) return;
+
+    if (state == LinkState::CONNECTED) {
+        if (mqttClient.connected()) return;
+        Logger::warn("mqtt link lost");
+        enter(LinkState::MQTT, now);
+    }
+
+    if (runStep(now)) {
+        advance();
+    }
+}
+
+bool ConnectionManager::isConnected() const {
+    return state == LinkState::CONNECTED;
+}
+
+// SMS only needs the network, so this is the earliest point any uplink works
+bool ConnectionManager::isNetworkRegistered() const {
+    return state >= LinkState::GPRS;
+}
+
+LinkState ConnectionManager::getState() const {
+    return state;
+}
+
+unsigned long ConnectionManager::getStepLatency(LinkState step) const {
+    if (step == LinkState::CONNECTED) return 0;
+    return stepLatency[(uint8_t)step];
+}
+
+unsigned long ConnectionManager::getNextAttempt() const {
+    return nextAttempt;
+}
+
+// Performs a single bounded attempt of the current step. Returns true once the
+// step is done; failures and pending polls schedule the next attempt themselves.
+bool ConnectionManager::runStep(unsigned long now) {
+
+    switch (state) {
+        case LinkState::MODEM:
+            if (gsmModem.testAT(MODEM_PROBE_TIMEOUT) && gsmModem.init()) return true;
+            fail(now, "modem not responding");
+            return false;
+
+        case LinkState::NETWORK:
+            if (gsmModem.isNetworkConnected()) return true;
+            if (now - stepStart >= NETWORK_ATTACH_TIMEOUT) {
+                fail(now, "network registration timed out");
+            } else {
+                nextAttempt = now + NETWORK_POLL_INTERVAL;
+            }
+            return false;
+
+        case LinkState::GPRS:
+            return runGprsPhase(now);
+
+        case LinkState::MQTT:
+            return runMqttPhase(now);
+
+        default:
+            return true;
+    }
+}
+
+bool ConnectionManager::runGprsPhase(unsigned long now) {
+
+    switch (phase) {
+        case GPRS_SHUT:
+            gsmModem.sendAT(GF("+CIPSHUT"));
+            if (gsmModem.waitResponse(MODEM_COMMAND_TIMEOUT, GF("SHUT OK")) != 1) {
+                fail(now, "gprs reset failed");
+                return false;
+            }
+            break;
+
+        case GPRS_ATTACH: {
+            if (isAttachRequested) {
+                // The modem only answers CGATT=1 once attached
+                int8_t answer = readLateResponse();
+                if (answer == 1) break;
+                if (answer == 2) {
+                    fail(now, "gprs attach refused");
+                    return false;
+                }
+                return poll(now, GPRS_ATTACH_TIMEOUT, "gprs attach timed out");
+            }
+            gsmModem.sendAT(GF("+CGATT?"));
+            int8_t attached = gsmModem.waitResponse(MODEM_COMMAND_TIMEOUT, GF("+CGATT: 1"), GF("+CGATT: 0"));
+            gsmModem.waitResponse(MODEM_COMMAND_TIMEOUT);
+            if (attached == 1) break;
+            if (attached == 2) {
+                sendLate(GF("+CGATT=1"));
+                isAttachRequested = true;
+            }
+            return poll(now, GPRS_ATTACH_TIMEOUT, "gprs attach timed out");
+        }
+
+        case GPRS_MUX:
+            if (!sendCommand(GF("+CIPMUX=1"), now, "gprs setup failed")) return false;
+            break;
+
+        case GPRS_QUICK_SEND:
+            if (!sendCommand(GF("+CIPQSEND=1"), now, "gprs setup failed")) return false;
+            break;
+
+        case GPRS_MANUAL_RECEIVE:
+            if (!sendCommand(GF("+CIPRXGET=1"), now, "gprs setup failed")) return false;
+            break;
+
+        case GPRS_APN:
+            gsmModem.sendAT(GF("+CSTT=\""), APN, GF("\",\""), GPRS_USER, GF("\",\""), GPRS_PASS, GF("\""));
+            if (gsmModem.waitResponse(MODEM_COMMAND_TIMEOUT) != 1) {
+                fail(now, "gprs apn rejected");
+                return false;
+            }
+            break;
+
+        case GPRS_ACTIVATE:
+            sendLate(GF("+CIICR"));
+            break;
+
+        case GPRS_ACTIVE: {
+            if (modemStream.isAwaitingResponse()) {
+                int8_t answer = readLateResponse();
+                if (answer == 2) {
+                    fail(now, "gprs activation refused");
+                    return false;
+                }
+                if (answer != 1) return poll(now, GPRS_ACTIVATE_TIMEOUT, "gprs activation timed out");
+            }
+            gsmModem.sendAT(GF("+CIPSTATUS"));
+            int8_t status = gsmModem.waitResponse(MODEM_COMMAND_TIMEOUT, GF("IP GPRSACT"), GF("PDP DEACT"));
+            if (status == 2) {
+                fail(now, "gprs context deactivated");
+                return false;
+            }
+            if (status != 1) return poll(now, GPRS_ACTIVATE_TIMEOUT, "gprs activation timed out");
+            break;
+        }
+
+        case GPRS_ADDRESS: {
+            // Required before CIPSTART; answers with the address, then OK for E0
+            String response;
+            gsmModem.sendAT(GF("+CIFSR;E0"));
+            if (gsmModem.waitResponse(MODEM_COMMAND_TIMEOUT, response) != 1 || response.indexOf('.') < 0) {
+                fail(now, "gprs got no address");
+                return false;
+            }
+            break;
+        }
+
+        case GPRS_DNS:
+            return sendCommand(GF("+CDNSCFG=\"8.8.8.8\",\"8.8.4.4\""), now, "gprs dns setup failed");
+    }
+
+    nextPhase(now);
+    return false;
+}
+
+bool ConnectionManager::runMqttPhase(unsigned long now) {
+
+    switch (phase) {
+        case MQTT_TCP_START:
+            if (!gsmClient.startConnect(MQTT_SERVER, MQTT_PORT)) {
+                fail(now, "tcp open refused");
+                return false;
+            }
+            break;
+
+        case MQTT_TCP_OPEN: {
+            SocketState socket = gsmClient.pollConnect();
+            if (socket == SocketState::FAILED) {
+                fail(now, "tcp connect failed");
+                return false;
+            }
+            if (socket == SocketState::PENDING) return poll(now, MQTT_TCP_CONNECT_TIMEOUT, "tcp connect timed out");
+            break;
+        }
+
+        case MQTT_SESSION:
+            // The socket is open, so PubSubClient only sends CONNECT and waits for CONNACK
+            if (mqttClient.connect(MQTT_CLIENT_ID)) return true;
+            Logger::warn("mqtt connection failed, rc=%d", mqttClient.state());
+            fail(now, "mqtt connect failed");
+            return false;
+    }
+
+    nextPhase(now);
+    return false;
+}
+
+// A short command answered with OK; failures schedule a retry of the step
+bool ConnectionManager::sendCommand(GsmConstStr command, unsigned long now, const char* reason) {
+
+    gsmModem.sendAT(command);
+    if (gsmModem.waitResponse(MODEM_COMMAND_TIMEOUT) == 1) return true;
+    fail(now, reason);
+    return false;
+}
+
+// Sends a command answered only once the operation is done and holds the
+// modem for everyone else until readLateResponse() has seen that answer
+void ConnectionManager::sendLate(GsmConstStr command) {
+    gsmModem.sendAT(command);
+    modemStream.setAwaitingResponse(true);
+}
+
+// 1 for OK, 2 for ERROR, 0 while the answer is still outstanding
+int8_t ConnectionManager::readLateResponse() {
+    int8_t answer = gsmModem.waitResponse(MODEM_LATE_RESPONSE_TIMEOUT);
+    if (answer != 0) modemStream.setAwaitingResponse(false);
+    return answer;
+}
+
+// The current phase waits on the modem: asks again shortly, or gives up once
+// the phase has run for longer than timeout
+bool ConnectionManager::poll(unsigned long now, unsigned long timeout, const char* reason) {
+
+    if (now - phaseStart >= timeout) {
+        fail(now, reason);
+    } else {
+        nextAttempt = now + MODEM_POLL_INTERVAL;
+    }
+    return false;
+}
+
+void ConnectionManager::nextPhase(unsigned long now) {
+    phase++;
+    phaseStart = now;
+}
+
+void ConnectionManager::advance() {
+
+    // millis() moved while the step was blocking on the modem
+    unsigned long finished = millis();
+    stepLatency[(uint8_t)state] = finished - stepStart;
+    Logger::info("link step '%s' up in %lu ms", LINK_STATE_NAMES[(uint8_t)state], stepLatency[(uint8_t)state]);
+
+    backoff = CONNECTION_BACKOFF_MIN;
+    enter((LinkState)((uint8_t)state + 1), finished);
+}
+
+// Schedules a retry with jittered exponential backoff. After too many
+// consecutive failures the previous step is assumed broken and redone.
+void ConnectionManager::fail(unsigned long now, const char* reason) {
+
+    unsigned long wait = backoff / 2 + random(backoff / 2 + 1);
+    nextAttempt = now + wait;
+    backoff = min(backoff * 2, CONNECTION_BACKOFF_MAX);
+
+    Logger::warn("%s, retrying '%s' in %lu ms", reason, LINK_STATE_NAMES[(uint8_t)state], wait);
+
+    // A retried step starts over from its first phase; an answer that never
+    // came is not waited for any longer
+    phase = 0;
+    phaseStart = nextAttempt;
+    isAttachRequested = false;
+    modemStream.setAwaitingResponse(false);
+
+    if (++stepFailures >= CONNECTION_MAX_STEP_FAILURES && state != LinkState::MODEM) {
+        LinkState previous = (LinkState)((uint8_t)state - 1);
+        Logger::warn("falling back to '%s'", LINK_STATE_NAMES[(uint8_t)previous]);
+        state = previous;
+        stepStart = now;
+        stepFailures = 0;
+    }
+}
+
+void ConnectionManager::enter(LinkState next, unsigned long now) {
+    state = next;
+    stepStart = now;
+    stepFailures = 0;
+    phase = 0;
+    phaseStart = now;
+    isAttachRequested = false;
+}
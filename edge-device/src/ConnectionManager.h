@@ -0,0 +1,64 @@
+#ifndef __CONNECTION_MANAGER_H__
+    #define __CONNECTION_MANAGER_H__
+
+#include "config.h"
+#include <TinyGsmClient.h>
+#include "AsyncGsmClient.h"
+#include "ModemStream.h"
+#include <PubSubClient.h>
+
+// Uplink bring-up steps, in the order they have to succeed
+enum class LinkState : uint8_t {
+    MODEM = 0,
+    NETWORK = 1,
+    GPRS = 2,
+    MQTT = 3,
+    CONNECTED = 4
+};
+
+// Drives modem -> network -> GPRS -> MQTT as a state machine that does at most
+// one bounded modem operation per update(), so the main loop keeps running
+// while the link is being (re)established. GPRS and MQTT run as phases of one
+// short AT exchange each; the slow commands (CGATT, CIICR, CIPSTART) are
+// issued and then polled. CGATT=1 and CIICR only answer once done, so the
+// modem stream is held for other users until that answer has been read.
+class ConnectionManager {
+public:
+    ConnectionManager(ModemStream& modemStream, TinyGsm& gsmModem, AsyncGsmClient& gsmClient, PubSubClient& mqttClient);
+    void update(unsigned long now);
+    bool isConnected() const;
+    bool isNetworkRegistered() const;
+    LinkState getState() const;
+    unsigned long getStepLatency(LinkState step) const;
+    unsigned long getNextAttempt() const;
+
+private:
+    bool runStep(unsigned long now);
+    bool runGprsPhase(unsigned long now);
+    bool runMqttPhase(unsigned long now);
+    bool sendCommand(GsmConstStr command, unsigned long now, const char* reason);
+    void sendLate(GsmConstStr command);
+    int8_t readLateResponse();
+    bool poll(unsigned long now, unsigned long timeout, const char* reason);
+    void nextPhase(unsigned long now);
+    void advance();
+    void fail(unsigned long now, const char* reason);
+    void enter(LinkState next, unsigned long now);
+
+    ModemStream& modemStream;
+    TinyGsm& gsmModem;
+    AsyncGsmClient& gsmClient;
+    PubSubClient& mqttClient;
+
+    LinkState state;
+    uint8_t phase;
+    bool isAttachRequested;
+    unsigned long stepStart;
+    unsigned long phaseStart;
+    unsigned long nextAttempt;
+    unsigned long backoff;
+    uint8_t stepFailures;
+    unsigned long stepLatency[4];
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "FallbackChannel.h"
+#include "utilities.h"
+
+SmsFallback::SmsFallback(TinyGsm& gsmModem) : gsmModem(gsmModem) {}
+
+void SmsFallback::report(const VehicleStatus& data, uint32_t, unsigned long, unsigned long) {
+
+    char lat[12], lon[12], speed[8], acc[8], bat[8];
+
+    // Format float values manually
+    dtostrf(data.location.x, 5, 2, lat);
+    dtostrf(data.location.y, 5, 2, lon);
+
+    float speedVal = sqrt(
+        data.velocity.x * data.velocity.x +
+        data.velocity.y * data.velocity.y +
+        data.velocity.z * data.velocity.z);
+    dtostrf(speedVal, 4, 1, speed);
+
+    float accVal = sqrt(
+        data.acceleration.x * data.acceleration.x +
+        data.acceleration.y * data.acceleration.y +
+        data.acceleration.z * data.acceleration.z);
+    dtostrf(accVal, 4, 1, acc);
+
+    // Battery
+    if (data.batteryStatus < 0) {
+        strcpy(bat, "ADAPTER");
+    } else {
+        snprintf(bat, sizeof(bat), "%d%%", data.batteryStatus);
+    }
+
+    char sms[160];
+    snprintf(sms, sizeof(sms),
+        "[%02d:%02d:%02d %02d/%02d/%04d] "
+        "Lat:%s Lon:%s Spd:%sm/s Acc:%s "
+        "Sig:%d%% Bat:%s",
+        data.time.hour, data.time.minute, data.time.second,
+        data.time.day, data.time.month, data.time.year,
+        lat, lon, speed, acc,
+        data.signalStrength, bat);
+
+
+    gsmModem.sendSMS(EMERGENCY_PHONE_NUMBER, sms);
+    Logger::info("SMS sent: %s", sms);
+}
+
+PackedSmsFallback::PackedSmsFallback(TinyGsm& gsmModem)
+    :   gsmModem(gsmModem),
+        batchStart(0),
+        batchDelay(0),
+        lastAttempt(0),
+        isRetryPending(false) {}
+
+// Adds the fix to the pending packed SMS, sending the batch first if it is
+// full or the clock stepped back
+void PackedSmsFallback::report(const VehicleStatus& data, uint32_t sequence, unsigned long now, unsigned long interval) {
+
+    if (data.time.year < 2000) {
+        Logger::info("clock not synced, fix left out of the SMS batch");
+        return;
+    }
+
+    batchDelay = interval * SMS_BATCH_FIXES;
+    if (smsPacker.add(data, sequence)) {
+        if (smsPacker.getCount() == 1) batchStart = now;
+        return;
+    }
+
+    if (!flush(now)) {
+        Logger::warn("previous SMS batch still unsent, fix dropped");
+        return;
+    }
+    smsPacker.add(data, sequence);
+    batchStart = now;
+}
+
+void PackedSmsFallback::update(unsigned long now) {
+    if (smsPacker.getCount() > 0 && (long)(now - getNextFlush()) >= 0) flush(now);
+}
+
+unsigned long PackedSmsFallback::getSleepBudget(unsigned long now) const {
+
+    if (smsPacker.getCount() == 0) return ULONG_MAX;
+    long untilFlush = (long)(getNextFlush() - now);
+    return untilFlush <= 0 ? 0 : (unsigned long)untilFlush;
+}
+
+unsigned long PackedSmsFallback::getNextFlush() const {
+    return isRetryPending ? lastAttempt + SMS_RETRY_INTERVAL : batchStart + batchDelay;
+}
+
+// Sends the batch; on failure it is kept for a retry and false returned
+bool PackedSmsFallback::flush(unsigned long now) {
+
+    char sms[161];
+    if (!smsPacker.encode(sms, sizeof(sms))) {
+        smsPacker.reset();
+        isRetryPending = false;
+        return true;
+    }
+
+    bool sent = gsmModem.sendSMS(EMERGENCY_PHONE_NUMBER, sms);
+    Logger::info("packed SMS with %u fixes %s", smsPacker.getCount(), sent ? "sent" : "failed, kept for retry");
+    lastAttempt = now;
+    isRetryPending = !sent;
+    if (sent) smsPacker.reset();
+    return sent;
+}
@@ -0,0 +1,80 @@
+#ifndef __FALLBACK_CHANNEL_H__
+    #define __FALLBACK_CHANNEL_H__
+
+#include "config.h"
+#include "dataStructures.h"
+#include "SmsPacker.h"
+#include <TinyGsmClient.h>
+#include <limits.h>
+
+// Channels that carry fixes while MQTT is down, one per FALLBACK_CHANNEL
+// setting. MqttClient takes one as a template parameter, so the others are
+// never compiled into the image. All share the same interface:
+//
+//   report(data, sequence, now, interval)   hands over a fix and the message
+//                                 sequence number it was given; the next one
+//                                 follows in interval ms
+//   update(now)           sends whatever is due
+//   getSleepBudget(now)   ms until update() has work, ULONG_MAX if none
+
+// MQTT only; fixes taken while the link is down are dropped
+class NoFallback {
+public:
+    static constexpr bool ENABLED = false;
+
+    explicit NoFallback(TinyGsm&) {}
+    void report(const VehicleStatus&, uint32_t, unsigned long, unsigned long) {}
+    void update(unsigned long) {}
+    unsigned long getSleepBudget(unsigned long) const { return ULONG_MAX; }
+};
+
+// One human-readable SMS per fix
+class SmsFallback {
+public:
+    static constexpr bool ENABLED = true;
+
+    explicit SmsFallback(TinyGsm& gsmModem);
+    void report(const VehicleStatus& data, uint32_t sequence, unsigned long now, unsigned long interval);
+    void update(unsigned long) {}
+    unsigned long getSleepBudget(unsigned long) const { return ULONG_MAX; }
+
+private:
+    TinyGsm& gsmModem;
+};
+
+// Several fixes per SMS. A batch goes out when it is full or SMS_BATCH_FIXES
+// report intervals after its first fix, so it fills about as well at the
+// slowest report interval as at the fastest. A batch that failed to send is
+// kept and retried; fixes that do not fit meanwhile are dropped, and so are
+// fixes taken before the clock was first synced, which the server could not
+// place in time.
+class PackedSmsFallback {
+public:
+    static constexpr bool ENABLED = true;
+
+    explicit PackedSmsFallback(TinyGsm& gsmModem);
+    void report(const VehicleStatus& data, uint32_t sequence, unsigned long now, unsigned long interval);
+    void update(unsigned long now);
+    unsigned long getSleepBudget(unsigned long now) const;
+
+private:
+    bool flush(unsigned long now);
+    unsigned long getNextFlush() const;
+
+    TinyGsm& gsmModem;
+    SmsPacker smsPacker;
+    unsigned long batchStart;
+    unsigned long batchDelay;
+    unsigned long lastAttempt;
+    bool isRetryPending;
+};
+
+#if FALLBACK_CHANNEL == FALLBACK_SMS_PACKED
+using FallbackChannel = PackedSmsFallback;
+#elif FALLBACK_CHANNEL == FALLBACK_SMS
+using FallbackChannel = SmsFallback;
+#else
+using FallbackChannel = NoFallback;
+#endif
+
+#endif
@@ -1,8 +1,25 @@
 #include "GpsSensor.h"
 #include <Arduino.h>
 #include "utilities.h"
-
-const unsigned int SIM808_RESPONSE_TIMEOUT = 5000;
+#include "Settings.h"
+
+// GNSS power-up sequence, sent one command per setup step
+static const char* const GPS_SETUP_COMMANDS[] = {
+    "AT",
+    "AT+CFUN=1",
+    "AT+CGNSPWR=1",
+    "AT+CGPSRST=1",
+    "AT+CLTS=1"
+};
+static const uint8_t GPS_BASE_SETUP_STEPS = sizeof(GPS_SETUP_COMMANDS) / sizeof(GPS_SETUP_COMMANDS[0]);
+
+// Extra steps for streaming mode: restrict the GNSS engine output to RMC and
+// GGA, then route NMEA to the UART. The fix rate is set by updateStreamRate().
+static const char* const GPS_STREAM_PMTK_BODIES[] = {
+    "PMTK314,0,1,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0"
+};
+static const uint8_t GPS_STREAM_PMTK_STEPS = sizeof(GPS_STREAM_PMTK_BODIES) / sizeof(GPS_STREAM_PMTK_BODIES[0]);
+static const uint8_t GPS_SETUP_STEPS = GPS_BASE_SETUP_STEPS + (GPS_NMEA_STREAMING ? GPS_STREAM_PMTK_STEPS + 1 : 0);
 
 void cleanResonse(char *str, int len) {
     
@@ -21,23 +38,114 @@ void cleanResonse(char *str, int len) {
     *dst = '\0';
 }
 
-GpsSensor::GpsSensor(SoftwareSerial& sim808Serial): sim808Serial(sim808Serial) {
+GpsSensor::GpsSensor(ModemStream& sim808Serial):
+    sim808Serial(sim808Serial),
+    setupStep(0),
+    nextSetupAttempt(0),
+    streamFixInterval(0) {
     // Initialize gpsData
     gpsData = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0, 0};
 }
 
-bool GpsSensor::setup() {
+void GpsSensor::setup() {
+    setupStep = 0;
+    nextSetupAttempt = 0;
+    streamFixInterval = 0;
+}
+
+// Advances the GNSS power-up sequence by at most one command so the modem
+// bring-up and IMU calibration keep running. Returns true once GNSS is powered.
+bool GpsSensor::updateSetup(unsigned long now) {
+
+    if (isReady()) return true;
+    if ((long)(now - nextSetupAttempt) < 0) return false;
+
+    // The first command only probes the modem, which may still be booting
+    unsigned long timeout = setupStep == 0 ? MODEM_PROBE_TIMEOUT : SIM808_RESPONSE_TIMEOUT;
+    char buffer[80];
+    const char* command = getSetupCommand(setupStep, buffer, sizeof(buffer));
+
+    if (!sendControllCommand(command, timeout)) {
+        Logger::warn("gps setup step '%s' failed", command);
+        nextSetupAttempt = now + GPS_SETUP_RETRY_INTERVAL;
+        return false;
+    }
+
+    if (++setupStep == GPS_SETUP_STEPS) {
+        Logger::info("gps powered up after %lu ms", millis());
+        return true;
+    }
+    return false;
+}
+
+bool GpsSensor::isReady() {
+    return setupStep >= GPS_SETUP_STEPS;
+}
+
+const char* GpsSensor::getSetupCommand(uint8_t step, char* buffer, size_t bufferSize) {
+
+    if (step < GPS_BASE_SETUP_STEPS) return GPS_SETUP_COMMANDS[step];
+
+    step -= GPS_BASE_SETUP_STEPS;
+    if (step == GPS_STREAM_PMTK_STEPS) return "AT+CGNSTST=1";
+
+    return getPmtkCommand(GPS_STREAM_PMTK_BODIES[step], buffer, bufferSize);
+}
+
+const char* GpsSensor::getPmtkCommand(const char* body, char* buffer, size_t bufferSize) {
+    snprintf(buffer, bufferSize, "AT+CGNSCMD=0,\"$%s*%02X\"", body, NmeaParser::checksum(body));
+    return buffer;
+}
+
+// Fix interval the stream should run at: the GPS interval setting within
+// what the modem link and the GNSS engine allow
+unsigned int GpsSensor::getStreamFixInterval() {
+    return constrain(Settings::get().gpsUpdateInterval, GPS_STREAM_MIN_FIX_INTERVAL, GPS_STREAM_MAX_FIX_INTERVAL);
+}
+
+// Sends PMTK220 once streaming is up and again whenever the GPS interval
+// setting changes; a refused command is retried like a setup step
+void GpsSensor::updateStreamRate(unsigned long now) {
+
+    unsigned int interval = getStreamFixInterval();
+    if (!isReady() || interval == streamFixInterval) return;
+    if ((long)(now - nextSetupAttempt) < 0) return;
+
+    char body[16];
+    snprintf(body, sizeof(body), "PMTK220,%u", interval);
+    char buffer[48];
+    if (!sendControllCommand(getPmtkCommand(body, buffer, sizeof(buffer)))) {
+        Logger::warn("gnss refused fix interval %u ms", interval);
+        nextSetupAttempt = now + GPS_SETUP_RETRY_INTERVAL;
+        return;
+    }
+    streamFixInterval = interval;
+    Logger::info("gnss streams a fix every %u ms", interval);
+}
+
+// Drains the NMEA sentences the modem pushed since the last call. Returns true
+// if at least one new fix was parsed.
+bool GpsSensor::updateStream() {
 
-    return sendControllCommand("AT") &&
-        sendControllCommand("AT+CFUN=1") &&
-        sendControllCommand("AT+CGNSPWR=1") &&
-        sendControllCommand("AT+CGPSRST=1") &&
-        sendControllCommand("AT+CLTS=1");
+    bool isUpdated = false;
+    char c;
+    unsigned long lineEnd = millis();
+    while (sim808Serial.readNmea(c, lineEnd)) {
+        if (nmeaParser.feed(c, gpsData)) {
+            gpsData.measureTime = lineEnd;
+            isUpdated = true;
+        }
+    }
 
+    if (sim808Serial.hasNmeaOverflow()) {
+        Logger::warn("nmea buffer overflow");
+    }
+    return isUpdated;
 }
 
-Datetime GpsSensor::getDatetime() {
-    Datetime dt = {0, 0, 0, 0, 0, 0
+// Network local time; utcOffset (seconds) receives the reported time zone
+Datetime GpsSensor::getDatetime(int32_t* utcOffset) {
+    Datetime dt = {0, 0, 0, 0, 0, 0, 0
     }; // Default invalid
 
     char response[64];
@@ -50,8 +158,9 @@ Datetime GpsSensor::getDatetime() {
     start += 8; // Move past "+CCLK: \""
 
     // Expected format: "yy/MM/dd,hh:mm:ss±zz"
-    int yy, MM, dd, hh, mm, ss;
-    if (sscanf(start, "%2d/%2d/%2d,%2d:%2d:%2d", &yy, &MM, &dd, &hh, &mm, &ss) == 6) {
+    int yy, MM, dd, hh, mm, ss, zz;
+    int parsed = sscanf(start, "%2d/%2d/%2d,%2d:%2d:%2d%3d", &yy, &MM, &dd, &hh, &mm, &ss, &zz);
+    if (parsed >= 6) {
         dt.year = 2000 + yy;
         dt.month = MM;
         dt.day = dd;
@@ -59,10 +168,40 @@ Datetime GpsSensor::getDatetime() {
         dt.minute = mm;
         dt.second = ss;
     }
+    if (utcOffset) {
+        // zz is in quarter hours
+        *utcOffset = parsed == 7 ? zz * 900L : CLOCK_DEFAULT_UTC_OFFSET;
+    }
 
     return dt;
 }
 
+// Lets the SIM808 enter sleep mode 2, where it sleeps on its own once the
+// UART is idle. The NMEA stream would keep the UART busy, so it is stopped first.
+bool GpsSensor::sleepModem() {
+
+    if (GPS_NMEA_STREAMING) sendControllCommand("AT+CGNSTST=0");
+    if (!sendControllCommand("AT+CSCLK=2")) {
+        Logger::warn("modem refused to sleep");
+        if (GPS_NMEA_STREAMING) sendControllCommand("AT+CGNSTST=1");
+        return false;
+    }
+    return true;
+}
+
+// In sleep mode 2 the first characters only wake the UART, so the modem gets
+// a moment before sleep is disabled and streaming resumed
+void GpsSensor::wakeModem() {
+
+    sim808Serial.println("AT");
+    delay(MODEM_WAKE_DELAY);
+    while (sim808Serial.available()) sim808Serial.read();
+
+    if (!sendControllCommand("AT+CSCLK=0")) {
+        Logger::warn("modem did not leave sleep mode");
+    }
+    if (GPS_NMEA_STREAMING) sendControllCommand("AT+CGNSTST=1");
+}
 
 bool GpsSensor::updateGps() {
 
@@ -89,6 +228,17 @@ bool GpsSensor::updateGps() {
                     return false;
                 }
                 break;
+            case 2: { // UTC yyyyMMddhhmmss.sss
+                int year, month, day, hour, minute, second;
+                if (sscanf(token, "%4d%2d%2d%2d%2d%2d", &year, &month, &day, &hour, &minute, &second) == 6) {
+                    tempData.utcTime = {
+                        (uint8_t)second, (uint8_t)minute, (uint8_t)hour,
+                        (uint8_t)day, (uint8_t)month, (int16_t)year,
+                        (uint16_t)(token[14] == '.' ? atoi(token + 15) : 0)
+                    };
+                }
+                break;
+            }
             case 3: tempData.latitude = atof(token); break;
             case 4: tempData.longitude = atof(token); break;
             case 5: tempData.altitude = atof(token); break;
@@ -151,6 +301,7 @@ bool GpsSensor::sendDataCommand(const char* command, char* response, size_t resp
     if (response && responseSize > 0) {
         memset(response, 0, responseSize);
     }
+    if (sim808Serial.isAwaitingResponse()) return false;
 
     sim808Serial.println(command);
     
@@ -194,8 +345,10 @@ bool GpsSensor::sendDataCommand(const char* command, char* response, size_t resp
     return false;
 }
 
-bool GpsSensor::sendControllCommand(const char* command){
+bool GpsSensor::sendControllCommand(const char* command, unsigned long timeout){
     
+    if (sim808Serial.isAwaitingResponse()) return false;
+
     char response[8];
     memset(response, 0, 8);
     sim808Serial.println(command);
@@ -203,24 +356,25 @@ bool GpsSensor::sendControllCommand(const char* command){
     unsigned long start = millis();
     size_t index = 0;
     
-    while (millis() - start < SIM808_RESPONSE_TIMEOUT) {
+    while (millis() - start < timeout) {
         while (sim808Serial.available()) {
 
             char c = sim808Serial.read();
         
-            if (index < 8) {
+            if (index < 7) {
                 response[index++] = c;
             }
             
             if(c == '\n'){
-                if(index < 3){
-                    memset(response, 0, 8);
-                    index = 0;
-                } else {
-
-                    return strcmp(response, "OK\r\n") == 0;
+                if(strcmp(response, "OK\r\n") == 0){
+                    return true;
+                }
+                if(strncmp(response, "ERROR", 5) == 0){
+                    return false;
                 }
-                
+                // blank line or command echo while the modem still has echo on
+                memset(response, 0, 8);
+                index = 0;
             }
         }
     }
@@ -1,7 +1,9 @@
 #ifndef __GPS_SENSOR_H__
     #define __GPS_SENSOR_H__
 
-#include <SoftwareSerial.h>
+#include "ModemStream.h"
+#include "NmeaParser.h"
+#include "config.h"
 #include "dataStructures.h"
 
 // GpsSensor class
@@ -9,17 +11,30 @@ class GpsSensor {
 public:
     GpsData gpsData;
     
-    GpsSensor(SoftwareSerial& sim808Serial);
-    bool setup();
+    GpsSensor(ModemStream& sim808Serial);
+    void setup();
+    bool updateSetup(unsigned long now);
+    bool isReady();
     bool updateGps();
+    bool updateStream();
+    void updateStreamRate(unsigned long now);
+    unsigned int getStreamFixInterval();
     int8_t getSignalStrength();
     int8_t getBatteryStatus();
-    Datetime getDatetime();
+    Datetime getDatetime(int32_t* utcOffset = nullptr);
+    bool sleepModem();
+    void wakeModem();
 
 private:
-    SoftwareSerial& sim808Serial;
+    ModemStream& sim808Serial;
+    NmeaParser nmeaParser;
+    uint8_t setupStep;
+    unsigned long nextSetupAttempt;
+    unsigned int streamFixInterval;   // ms, sent with PMTK220; 0 = not yet
+    const char* getSetupCommand(uint8_t step, char* buffer, size_t bufferSize);
+    static const char* getPmtkCommand(const char* body, char* buffer, size_t bufferSize);
     bool sendDataCommand(const char* command, char* response, size_t responseSiz, bool verbose = false);
-    bool sendControllCommand(const char* command);
+    bool sendControllCommand(const char* command, unsigned long timeout = SIM808_RESPONSE_TIMEOUT);
 
    
 };
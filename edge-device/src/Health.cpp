@@ -0,0 +1,86 @@
+#include "Health.h"
+#include "MemoryMonitor.h"
+#include <Arduino.h>
+
+unsigned long Health::powerTime[3] = {0, 0, 0};
+unsigned long Health::modemSleepTime = 0;
+unsigned long Health::periodStart = 0;
+
+void Health::addPowerTime(PowerMode mode, unsigned long ms) {
+    powerTime[(uint8_t)mode] += ms;
+}
+
+void Health::addModemSleepTime(unsigned long ms) {
+    modemSleepTime += ms;
+}
+
+// JSON keys of Report::values, in order
+static const char* const HEALTH_FIELDS[Health::FIELD_COUNT] = {
+    "uptime_ms", "period_ms",
+    "active_ms", "idle_ms", "power_down_ms", "modem_sleep_ms",
+    "active_ma", "idle_ma", "power_down_ma", "modem_awake_ma", "modem_sleep_ma",
+    "average_ma",
+    "static_ram", "free_stack", "free_heap", "stack_headroom", "stack_high_water"
+};
+
+static uint8_t decimalDigits(unsigned long value) {
+    uint8_t digits = 1;
+    while (value >= 10) {
+        value /= 10;
+        digits++;
+    }
+    return digits;
+}
+
+// Current is not measured: it is estimated from the time spent in each mode
+// and the typical draw configured for it
+void Health::collect(Report& report, unsigned long now) {
+
+    unsigned long period = now - periodStart;
+    unsigned long modemAwakeTime = period > modemSleepTime ? period - modemSleepTime : 0;
+
+    float charge =
+        (float)powerTime[(uint8_t)PowerMode::ACTIVE] * POWER_CURRENT_ACTIVE +
+        (float)powerTime[(uint8_t)PowerMode::IDLE] * POWER_CURRENT_IDLE +
+        (float)powerTime[(uint8_t)PowerMode::POWER_DOWN] * POWER_CURRENT_POWER_DOWN +
+        (float)modemAwakeTime * POWER_CURRENT_MODEM_AWAKE +
+        (float)modemSleepTime * POWER_CURRENT_MODEM_SLEEP;
+    unsigned int averageCurrent = period ? (unsigned int)(charge / period + 0.5f) : 0;
+
+    const unsigned long values[FIELD_COUNT] = {
+        now, period,
+        powerTime[(uint8_t)PowerMode::ACTIVE],
+        powerTime[(uint8_t)PowerMode::IDLE],
+        powerTime[(uint8_t)PowerMode::POWER_DOWN],
+        modemSleepTime,
+        POWER_CURRENT_ACTIVE, POWER_CURRENT_IDLE, POWER_CURRENT_POWER_DOWN,
+        POWER_CURRENT_MODEM_AWAKE, POWER_CURRENT_MODEM_SLEEP,
+        averageCurrent,
+        MemoryMonitor::getStaticRam(), MemoryMonitor::getFreeStack(), MemoryMonitor::getFreeHeap(),
+        MemoryMonitor::getStackHeadroom(), MemoryMonitor::getStackHighWater()
+    };
+    memcpy(report.values, values, sizeof(values));
+}
+
+// Length of what print() writes for this report
+size_t Health::measure(const Report& report) {
+    size_t length = strlen("{\"device\":\"\"}") + strlen(MQTT_CLIENT_ID);
+    for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+        length += strlen(",\"\":") + strlen(HEALTH_FIELDS[i]) + decimalDigits(report.values[i]);
+    }
+    return length;
+}
+
+size_t Health::print(Print& out, const Report& report) {
+    size_t written = out.print("{\"device\":\"") + out.print(MQTT_CLIENT_ID) + out.print('"');
+    for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+        written += out.print(",\"") + out.print(HEALTH_FIELDS[i]) + out.print("\":") + out.print(report.values[i]);
+    }
+    return written + out.print('}');
+}
+
+void Health::reset(unsigned long now) {
+    powerTime[0] = powerTime[1] = powerTime[2] = 0;
+    modemSleepTime = 0;
+    periodStart = now;
+}
@@ -0,0 +1,39 @@
+#ifndef __HEALTH_H__
+    #define __HEALTH_H__
+
+#include "config.h"
+#include <Arduino.h>
+
+enum class PowerMode : uint8_t {
+    ACTIVE = 0,
+    IDLE = 1,
+    POWER_DOWN = 2
+};
+
+// Device health counters, collected from every module like Logger and
+// published by MqttClient as a JSON report on MQTT_HEALTH_TOPIC. The report
+// is streamed into the publish rather than formatted into a buffer first:
+// it is close to 400 characters.
+class Health {
+public:
+    static const uint8_t FIELD_COUNT = 17;
+
+    // Values of one report, taken once so its length and text agree
+    struct Report {
+        unsigned long values[FIELD_COUNT];
+    };
+
+    static void addPowerTime(PowerMode mode, unsigned long ms);
+    static void addModemSleepTime(unsigned long ms);
+    static void collect(Report& report, unsigned long now);
+    static size_t measure(const Report& report);
+    static size_t print(Print& out, const Report& report);
+    static void reset(unsigned long now);
+
+private:
+    static unsigned long powerTime[3];
+    static unsigned long modemSleepTime;
+    static unsigned long periodStart;
+};
+
+#endif
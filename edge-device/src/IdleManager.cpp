@@ -0,0 +1,133 @@
+#include "IdleManager.h"
+#include "Health.h"
+#include "utilities.h"
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+
+// Maintained by the Arduino core; advanced by hand for time spent powered down
+extern volatile unsigned long timer0_millis;
+
+static volatile bool isMotionDetected = false;
+static volatile bool isWatchdogFired = false;
+
+static void onMotion() {
+    isMotionDetected = true;
+}
+
+ISR(WDT_vect) {
+    isWatchdogFired = true;
+}
+
+// Watchdog periods usable as a power-down timer, longest first
+static const uint8_t WATCHDOG_TIMEOUTS[] = {WDTO_8S, WDTO_4S, WDTO_2S, WDTO_1S, WDTO_500MS, WDTO_250MS, WDTO_120MS, WDTO_60MS, WDTO_30MS, WDTO_15MS};
+static const unsigned int WATCHDOG_PERIODS[] = {8000, 4000, 2000, 1000, 500, 250, 120, 60, 30, 15};
+
+IdleManager::IdleManager(SensorManager& sensorManager, MqttClient& mqttClient, ModemStream& sim808Serial)
+    :   sensorManager(sensorManager),
+        mqttClient(mqttClient),
+        sim808Serial(sim808Serial),
+        lastWake(0) {}
+
+void IdleManager::setup() {
+    pinMode(MPU_INTERRUPT_PIN, INPUT);
+    Health::reset(millis());
+    lastWake = millis();
+}
+
+void IdleManager::update(unsigned long now) {
+
+    // Everything since the last wake-up was spent running the loop
+    Health::addPowerTime(PowerMode::ACTIVE, now - lastWake);
+
+    unsigned long budget = min(sensorManager.getIdleBudget(now), mqttClient.getIdleBudget(now));
+
+    if (sensorManager.isAtRest()) {
+        unsigned long sleepBudget = mqttClient.getSleepBudget(now);
+        if (sleepBudget >= IDLE_POWER_DOWN_MIN) {
+            powerDown(sleepBudget);
+            lastWake = millis();
+            return;
+        }
+    }
+
+    if (budget > 0) idle(budget);
+    lastWake = millis();
+}
+
+// Timer0 keeps running in idle mode, so millis() stays correct and the CPU
+// wakes every millisecond to check the deadline
+void IdleManager::idle(unsigned long budget) {
+
+    unsigned long start = millis();
+    set_sleep_mode(SLEEP_MODE_IDLE);
+
+    while (millis() - start < budget) {
+        sleep_mode();
+        // Moves streamed NMEA out of the small UART buffer; stop on AT traffic
+        if (sim808Serial.available()) break;
+    }
+
+    Health::addPowerTime(PowerMode::IDLE, millis() - start);
+}
+
+void IdleManager::powerDown(unsigned long budget) {
+
+    unsigned long start = millis();
+    if (!sensorManager.sleep()) return;
+
+    Logger::info("powering down for up to %lu ms", budget);
+    Serial.flush();
+
+    isMotionDetected = false;
+    attachInterrupt(digitalPinToInterrupt(MPU_INTERRUPT_PIN), onMotion, RISING);
+
+    unsigned long slept = 0;
+    while (slept < budget && !isMotionDetected) {
+        unsigned long period = sleepWatchdog(budget - slept);
+        if (period == 0) break;
+        slept += period;
+    }
+
+    detachInterrupt(digitalPinToInterrupt(MPU_INTERRUPT_PIN));
+
+    // Timer0 is stopped in power-down. The watchdog periods are nominal and a
+    // wake-up before the watchdog fired is not accounted, so millis() is only
+    // approximate from here on; sensorManager.wake() has the clock resynced.
+    noInterrupts();
+    timer0_millis += slept;
+    interrupts();
+
+    unsigned long now = millis();
+    sensorManager.wake(now);
+
+    Health::addPowerTime(PowerMode::POWER_DOWN, slept);
+    Health::addModemSleepTime(millis() - start);
+    Logger::info("woke up after %lu ms%s", slept, isMotionDetected ? " on motion" : "");
+}
+
+// Powers down for the longest watchdog period that fits in remaining. Returns
+// the period slept, or 0 if another interrupt woke the MCU or nothing fits.
+unsigned long IdleManager::sleepWatchdog(unsigned long remaining) {
+
+    uint8_t i = 0;
+    while (i < sizeof(WATCHDOG_PERIODS) / sizeof(WATCHDOG_PERIODS[0]) && WATCHDOG_PERIODS[i] > remaining) i++;
+    if (i == sizeof(WATCHDOG_PERIODS) / sizeof(WATCHDOG_PERIODS[0])) return 0;
+
+    uint8_t timeout = WATCHDOG_TIMEOUTS[i];
+    isWatchdogFired = false;
+
+    // Watchdog in interrupt-only mode so it wakes instead of resetting
+    noInterrupts();
+    MCUSR &= ~(1 << WDRF);
+    WDTCSR = (1 << WDCE) | (1 << WDE);
+    WDTCSR = (1 << WDIE) | ((timeout & 0x08) ? (1 << WDP3) : 0) | (timeout & 0x07);
+    interrupts();
+
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    sleep_enable();
+    sleep_cpu();
+    sleep_disable();
+
+    wdt_disable();
+    return isWatchdogFired ? WATCHDOG_PERIODS[i] : 0;
+}
@@ -0,0 +1,30 @@
+#ifndef __IDLE_MANAGER_H__
+    #define __IDLE_MANAGER_H__
+
+#include "config.h"
+#include "ModemStream.h"
+#include "SensorManager.h"
+#include "MqttClient.h"
+
+// Puts the MCU to sleep between the deadlines of the other modules. Short gaps
+// use idle sleep; while the vehicle is parked and the uplink has nothing due
+// for a while, the modem is slept and the MCU powers down until the watchdog
+// or the IMU motion interrupt wakes it.
+class IdleManager {
+public:
+    IdleManager(SensorManager& sensorManager, MqttClient& mqttClient, ModemStream& sim808Serial);
+    void setup();
+    void update(unsigned long now);
+
+private:
+    void idle(unsigned long budget);
+    void powerDown(unsigned long budget);
+    unsigned long sleepWatchdog(unsigned long remaining);
+
+    SensorManager& sensorManager;
+    MqttClient& mqttClient;
+    ModemStream& sim808Serial;
+    unsigned long lastWake;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "MemoryMonitor.h"
+#include <stdlib.h>
+
+static const uint8_t STACK_PAINT = 0xC5;
+
+extern uint8_t __data_start;
+extern uint8_t __bss_end;
+extern uint8_t __heap_start;
+extern char* __brkval;
+
+// avr-libc malloc free list
+struct __freelist {
+    size_t sz;
+    struct __freelist* nx;
+};
+extern struct __freelist* __flp;
+
+static uint8_t* heapTop() {
+    return __brkval ? (uint8_t*)__brkval : &__heap_start;
+}
+
+// Runs from .init1, before .data/.bss are set up and before constructors.
+// Written in assembly because r1 is not cleared yet, so compiled C could not
+// rely on the zero register. The stack is still empty here.
+extern "C" void paintStack() __attribute__((naked, used, section(".init1")));
+extern "C" void paintStack() {
+    __asm__ volatile (
+        "    ldi r30, lo8(__heap_start)\n"
+        "    ldi r31, hi8(__heap_start)\n"
+        "    ldi r24, %[paint]\n"
+        "    ldi r25, hi8(%[end])\n"
+        "1:  st Z+, r24\n"
+        "    cpi r30, lo8(%[end])\n"
+        "    cpc r31, r25\n"
+        "    brlo 1b\n"
+        :
+        : [paint] "M" (STACK_PAINT), [end] "i" (RAMEND + 1)
+        : "r24", "r25", "r30", "r31", "memory"
+    );
+}
+
+// .data and .bss, fixed at link time
+size_t MemoryMonitor::getStaticRam() {
+    return &__bss_end - &__data_start;
+}
+
+// Gap between the heap and the current stack pointer
+size_t MemoryMonitor::getFreeStack() {
+    uint8_t marker;
+    return &marker - heapTop();
+}
+
+// Heap blocks released to the free list; the gap above the heap is counted
+// as free stack instead
+size_t MemoryMonitor::getFreeHeap() {
+    size_t free = 0;
+    for (struct __freelist* block = __flp; block; block = block->nx) {
+        free += block->sz + sizeof(size_t);
+    }
+    return free;
+}
+
+// Smallest gap the stack has ever left above the heap since boot
+size_t MemoryMonitor::getStackHeadroom() {
+    uint8_t* p = heapTop();
+    uint8_t marker;
+    while (p < &marker && *p == STACK_PAINT) p++;
+    return p - heapTop();
+}
+
+// Deepest stack use since boot
+size_t MemoryMonitor::getStackHighWater() {
+    return (uint8_t*)RAMEND + 1 - (heapTop() + getStackHeadroom());
+}
@@ -0,0 +1,18 @@
+#ifndef __MEMORY_MONITOR_H__
+    #define __MEMORY_MONITOR_H__
+
+#include "config.h"
+
+// SRAM usage of the running firmware. The free RAM between the heap and the
+// stack is painted at boot (before any constructor runs), so the deepest stack
+// use since then can be read back at any time without sampling.
+class MemoryMonitor {
+public:
+    static size_t getStaticRam();
+    static size_t getFreeStack();
+    static size_t getFreeHeap();
+    static size_t getStackHeadroom();
+    static size_t getStackHighWater();
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "ModemStream.h"
+
+ModemStream::ModemStream(Stream& serial)
+    :   serial(serial),
+        pending(-1),
+        isInSentence(false),
+        isAtLineStart(true),
+        isLineEndStamped(false),
+        isReadingSentence(false),
+        isOverflowed(false),
+        isAwaiting(false) {}
+
+int ModemStream::available() {
+    pump();
+    return pending < 0 ? 0 : 1;
+}
+
+int ModemStream::read() {
+    pump();
+    int c = pending;
+    pending = -1;
+    return c;
+}
+
+int ModemStream::peek() {
+    pump();
+    return pending;
+}
+
+size_t ModemStream::write(uint8_t c) {
+    return serial.write(c);
+}
+
+static bool isLineEnd(char c) {
+    return c == '\r' || c == '\n';
+}
+
+// lineEnd receives the arrival time of the sentence on its first line-end
+// character and is left alone for every other character
+bool ModemStream::readNmea(char& c, unsigned long& lineEnd) {
+    pump();
+    if (!nmeaBuffer.pop(c)) {
+        // Stamps whose sentence was lost to an overflow
+        lineEnds.clear();
+        return false;
+    }
+    if (c == '$') {
+        isReadingSentence = true;
+    } else if (isReadingSentence && isLineEnd(c)) {
+        isReadingSentence = false;
+        if (!lineEnds.pop(lineEnd)) lineEnd = millis();
+    }
+    return true;
+}
+
+// Reports (and clears) whether NMEA bytes were dropped since the last call
+bool ModemStream::hasNmeaOverflow() {
+    bool overflowed = isOverflowed;
+    isOverflowed = false;
+    return overflowed;
+}
+
+void ModemStream::setAwaitingResponse(bool value) {
+    isAwaiting = value;
+}
+
+bool ModemStream::isAwaitingResponse() const {
+    return isAwaiting;
+}
+
+// Drains the UART until one byte of AT traffic is available for the caller
+void ModemStream::pump() {
+
+    while (pending < 0 && serial.available()) {
+        char c = serial.read();
+
+        if (isInSentence || (isAtLineStart && c == '$')) {
+            if (!isInSentence) isLineEndStamped = false;
+            isInSentence = c != '\n';
+            isAtLineStart = !isInSentence;
+            if (!nmeaBuffer.push(c)) {
+                isOverflowed = true;
+            } else if (!isLineEndStamped && isLineEnd(c)) {
+                isLineEndStamped = true;
+                lineEnds.push(millis());
+            }
+            continue;
+        }
+
+        isAtLineStart = c == '\n';
+        pending = (uint8_t)c;
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef __MODEM_STREAM_H__
+    #define __MODEM_STREAM_H__
+
+#include <Arduino.h>
+#include "config.h"
+#include "RingBuffer.h"
+
+// Wraps the SIM808 UART and diverts unsolicited NMEA sentences ('$' at the
+// start of a line) into a ring buffer, so AT traffic from TinyGsm and
+// GpsSensor never sees them while GNSS streaming is enabled. The millis() at
+// which each sentence arrived is kept alongside, since a blocking AT call can
+// leave it in the buffer for hundreds of milliseconds before it is parsed.
+class ModemStream : public Stream {
+public:
+    ModemStream(Stream& serial);
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t c) override;
+    using Print::write;
+
+    bool readNmea(char& c, unsigned long& lineEnd);
+    bool hasNmeaOverflow();
+
+    // A command whose final OK/ERROR comes long after it was sent (CGATT=1,
+    // CIICR) holds the modem until its sender has read that answer. Other
+    // users skip their exchanges meanwhile, so none takes the late OK/ERROR
+    // for its own.
+    void setAwaitingResponse(bool isAwaiting);
+    bool isAwaitingResponse() const;
+
+private:
+    void pump();
+
+    Stream& serial;
+    RingBuffer<char, NMEA_BUFFER_SIZE> nmeaBuffer;
+    RingBuffer<unsigned long, NMEA_LINE_TIMES> lineEnds;
+    int pending;
+    bool isInSentence;
+    bool isAtLineStart;
+    bool isLineEndStamped;
+    bool isReadingSentence;
+    bool isOverflowed;
+    bool isAwaiting;
+};
+
+#endif
@@ -2,23 +2,62 @@
 
 #include "config.h"
 #include "utilities.h"
+#include "Settings.h"
 #include <Wire.h>
+#include <EEPROM.h>
+
+// MPU9250 registers used for wake-on-motion
+static const uint8_t MPU_ACCEL_CONFIG2 = 0x1D;
+static const uint8_t MPU_LP_ACCEL_ODR = 0x1E;
+static const uint8_t MPU_WOM_THR = 0x1F;
+static const uint8_t MPU_INT_ENABLE = 0x38;
+static const uint8_t MPU_INT_STATUS = 0x3A;
+static const uint8_t MPU_MOT_DETECT_CTRL = 0x69;
+static const uint8_t MPU_PWR_MGMT_1 = 0x6B;
+static const uint8_t MPU_PWR_MGMT_2 = 0x6C;
+
+static void writeRegister(uint8_t reg, uint8_t value) {
+Wire.beginTransmission(MPU_I2C_ADDRESS);
+Wire.write(reg);
+Wire.write(value);
+Wire.endTransmission();
+}
+
+static uint8_t readRegister(uint8_t reg) {
+Wire.beginTransmission(MPU_I2C_ADDRESS);
+Wire.write(reg);
+Wire.endTransmission(false);
+Wire.requestFrom(MPU_I2C_ADDRESS, (uint8_t)1);
+return Wire.available() ? Wire.read() : 0;
+}
 
+static uint8_t calibrationChecksum(const ImuCalibration& calibration) {
+const uint8_t* bytes = (const uint8_t*)&calibration;
+uint8_t sum = 0;
+for (size_t i = 0; i < offsetof(ImuCalibration, checksum); i++)
+    sum = (sum << 1 | sum >> 7) ^ bytes[i];
+return sum;
+}
 
 
 bool MpuSensor::setup() {
 
 Wire.begin(); // SDA = 20, SCL = 21 for Arduino Mega
-if (!mpu.setup(0x68)) return false;
-mpu.setMagneticDeclination(4.73f); // Adjust as needed
-mpu.selectFilter(QuatFilterSel::MADGWICK);
-mpu.setFilterIterations(15);
-mpu.ahrs(true);
+if (!mpu.setup(MPU_I2C_ADDRESS)) return false;
+// The library only reads the sensors; orientation is tracked by our own
+// quaternion filter so its cost can be budgeted per sample
+mpu.ahrs(false);
+
+if (loadCalibration()) {
+    // Only the orientation filter has to settle; biases come from EEPROM
+    state = ImuState::WARMING_UP;
+    phaseStart = millis();
+    return true;
+}
+
 mpu.calibrateAccelGyro();
-delay(15000);
 calibrate();
 
-
 return true;
 
 }
@@ -26,20 +65,33 @@ return true;
 bool MpuSensor::update(unsigned long now) {
 
 float dt = now - lastUpdate;
+unsigned long interval = Settings::get().mpuUpdateInterval;
 
 mpu.update();
 
-if(dt < MPU_UPDATE_INTERVAL)
+if(dt < interval)
     return false;
 
 dt /= 1000.0f; // Convert milliseconds to seconds
 
 lastUpdate = now;
 
+angularVelocity.x = mpu.getGyroX() - gyroOffset.x;
+angularVelocity.y = mpu.getGyroY() - gyroOffset.y;
+angularVelocity.z = mpu.getGyroZ() - gyroOffset.z;
+
+updateAttitude(dt);
+
+if (state != ImuState::READY) {
+    updateCalibration(now);
+    return false;
+}
+
+Vector linearAcceleration = getLinearAcceleration();
 instantaneousAcceleration = {
-    (mpu.getLinearAccX() - accelerationOffset.x) * GRAVITY_ACCELERATION,
-    (mpu.getLinearAccY() - accelerationOffset.y) * GRAVITY_ACCELERATION,
-    (mpu.getLinearAccZ() - accelerationOffset.z) * GRAVITY_ACCELERATION
+    (linearAcceleration.x - accelerationOffset.x) * GRAVITY_ACCELERATION,
+    (linearAcceleration.y - accelerationOffset.y) * GRAVITY_ACCELERATION,
+    (linearAcceleration.z - accelerationOffset.z) * GRAVITY_ACCELERATION
 };
 
 smoothedAcceleration.x = alpha * instantaneousAcceleration.x + (1 - alpha) * smoothedAcceleration.x;
@@ -47,14 +99,6 @@ smoothedAcceleration.y = alpha * instantaneousAcceleration.y + (1 - alpha) * smo
 smoothedAcceleration.z = alpha * instantaneousAcceleration.z + (1 - alpha) * smoothedAcceleration.z;
 
 
-angularVelocity.x = mpu.getGyroX() - gyroOffset.x;
-angularVelocity.y = mpu.getGyroY() - gyroOffset.y;
-angularVelocity.z = mpu.getGyroZ() - gyroOffset.z;
-
-orientation.x = mpu.getRoll() - orientationOffset.x;
-orientation.y = mpu.getPitch() - orientationOffset.y;
-orientation.z = mpu.getYaw() - orientationOffset.z;
-
 displacement.x += (smoothedAcceleration.x * dt + velocity.x) / 2 * dt;
 displacement.y += (smoothedAcceleration.y * dt + velocity.y) / 2 * dt;
 displacement.z += (smoothedAcceleration.z * dt + velocity.z) / 2 * dt;
@@ -68,25 +112,130 @@ return true;
 
 }
 
+// Runs the quaternion filter once per sample
+void MpuSensor::updateAttitude(float dt) {
+
+// AK8963 axes are swapped and z is inverted relative to the accel/gyro frame
+Vector gyro = {
+    angularVelocity.x * DEG_TO_RAD,
+    angularVelocity.y * DEG_TO_RAD,
+    angularVelocity.z * DEG_TO_RAD
+};
+Vector acc = {mpu.getAccX(), mpu.getAccY(), mpu.getAccZ()};
+Vector mag = {mpu.getMagY(), mpu.getMagX(), -mpu.getMagZ()};
+
+ahrs.update(gyro, acc, mag, dt);
+
+}
+
+// Acceleration without gravity, rotated once into east/north/up, in g
+Vector MpuSensor::getLinearAcceleration() {
+
+Vector earth = ahrs.toEarth({mpu.getAccX(), mpu.getAccY(), mpu.getAccZ()});
+return {-earth.y, earth.x, earth.z - 1.0f};
+
+}
+
+bool MpuSensor::isAtRest() {
+return state == ImuState::READY && successiveStationaryState > IMU_REST_SAMPLES;
+}
+
+// Milliseconds until the next sample is due
+unsigned long MpuSensor::getIdleBudget(unsigned long now) {
+unsigned long elapsed = now - lastUpdate;
+unsigned long interval = Settings::get().mpuUpdateInterval;
+return elapsed >= interval ? 0 : interval - elapsed;
+}
+
+// Puts the accelerometer in low-power cycle mode with its INT pin raised on
+// motion (MPU9250 wake-on-motion sequence); gyro and magnetometer are off
+void MpuSensor::enableMotionWake() {
+
+savedAccelConfig2 = readRegister(MPU_ACCEL_CONFIG2);
+
+writeRegister(MPU_PWR_MGMT_1, 0x00);
+writeRegister(MPU_PWR_MGMT_2, 0x07);      // gyro off
+writeRegister(MPU_ACCEL_CONFIG2, 0x01);   // 184 Hz bandwidth
+writeRegister(MPU_INT_ENABLE, 0x40);      // wake-on-motion only
+writeRegister(MPU_MOT_DETECT_CTRL, 0xC0); // compare against the previous sample
+writeRegister(MPU_WOM_THR, MPU_WAKE_THRESHOLD);
+writeRegister(MPU_LP_ACCEL_ODR, 0x06);    // 15.63 Hz
+writeRegister(MPU_PWR_MGMT_1, 0x20);      // cycle mode
+readRegister(MPU_INT_STATUS);             // clear a latched interrupt
+
+}
+
+void MpuSensor::disableMotionWake(unsigned long now) {
+
+writeRegister(MPU_PWR_MGMT_1, 0x01);      // PLL clock, cycle off
+writeRegister(MPU_PWR_MGMT_2, 0x00);
+writeRegister(MPU_ACCEL_CONFIG2, savedAccelConfig2);
+writeRegister(MPU_MOT_DETECT_CTRL, 0x00);
+writeRegister(MPU_INT_ENABLE, 0x01);      // raw data ready, as the library sets it
+readRegister(MPU_INT_STATUS);
+
+// The vehicle was at rest; do not integrate across the sleep
+lastUpdate = now;
+velocity = {0.0f, 0.0f, 0.0f};
+
+}
+
+// The vehicle counts as still once the accel magnitude has been steady and
+// the gyro quiet for IMU_REST_SAMPLES in a row. Both are read from the sensor
+// rather than the integrated velocity, so the count drops back to zero as
+// soon as the vehicle moves again.
 void MpuSensor::updateStationaryState() {
 
-float absoluteAcceleration = sqrt(
-    instantaneousAcceleration.x * instantaneousAcceleration.x +
-    instantaneousAcceleration.y * instantaneousAcceleration.y +
-    instantaneousAcceleration.z * instantaneousAcceleration.z
-);
-float absoluteVelocity = sqrt(
-    velocity.x * velocity.x +
-    velocity.y * velocity.y +
-    velocity.z * velocity.z
+float ax = mpu.getAccX(), ay = mpu.getAccY(), az = mpu.getAccZ();
+float magnitude = sqrt(ax * ax + ay * ay + az * az);
+float deviation = magnitude - accelMagnitudeMean;
+accelMagnitudeMean += IMU_REST_VARIANCE_WEIGHT * deviation;
+accelMagnitudeVariance = (1 - IMU_REST_VARIANCE_WEIGHT) *
+    (accelMagnitudeVariance + IMU_REST_VARIANCE_WEIGHT * deviation * deviation);
+
+float absoluteAngularVelocity = sqrt(
+    angularVelocity.x * angularVelocity.x +
+    angularVelocity.y * angularVelocity.y +
+    angularVelocity.z * angularVelocity.z
 );
-if(absoluteVelocity < 0.5 || absoluteAcceleration < 0.5){
+if (accelMagnitudeVariance < IMU_REST_MAX_ACCEL_VARIANCE &&
+    absoluteAngularVelocity < IMU_REST_MAX_ANGULAR_VELOCITY) {
     successiveStationaryState++;
-}else{
+} else {
     successiveStationaryState = 0;
 }
-if (successiveStationaryState > 150) 
+if (successiveStationaryState > IMU_REST_SAMPLES) {
     velocity = {0, 0, 0};
+}
+
+}
+
+// While at rest the true linear acceleration and rotation rate are zero, so
+// whatever is left after the offsets is residual bias and slowly folded in.
+// Called after a sample only once GNSS also reports the vehicle standing;
+// a quiet IMU alone cannot tell rest from a steady push.
+void MpuSensor::trackBias() {
+
+if (!isAtRest()) return;
+
+float absoluteAngularVelocity = sqrt(
+    angularVelocity.x * angularVelocity.x +
+    angularVelocity.y * angularVelocity.y +
+    angularVelocity.z * angularVelocity.z
+);
+if (absoluteAngularVelocity > IMU_REST_MAX_ANGULAR_VELOCITY)
+    return;
+
+accelerationOffset.x += IMU_BIAS_TRACKING_RATE * instantaneousAcceleration.x / GRAVITY_ACCELERATION;
+accelerationOffset.y += IMU_BIAS_TRACKING_RATE * instantaneousAcceleration.y / GRAVITY_ACCELERATION;
+accelerationOffset.z += IMU_BIAS_TRACKING_RATE * instantaneousAcceleration.z / GRAVITY_ACCELERATION;
+gyroOffset.x += IMU_BIAS_TRACKING_RATE * angularVelocity.x;
+gyroOffset.y += IMU_BIAS_TRACKING_RATE * angularVelocity.y;
+gyroOffset.z += IMU_BIAS_TRACKING_RATE * angularVelocity.z;
+
+if (millis() - lastCalibrationSave >= IMU_CALIBRATION_SAVE_INTERVAL) {
+    saveCalibration();
+}
 
 }
 
@@ -115,58 +264,98 @@ Vector MpuSensor::getVelocity() { return velocity; }
 
 Vector MpuSensor::getAcceleration() { return smoothedAcceleration; }
 
-Vector MpuSensor::getOrientation() { return orientation; }
+// Euler angles are only derived from the quaternion when a report needs them
+Vector MpuSensor::getOrientation() {
+Vector euler = ahrs.getEuler();
+return {
+    euler.x - orientationOffset.x,
+    euler.y - orientationOffset.y,
+    euler.z + MAGNETIC_DECLINATION - orientationOffset.z
+};
+}
 
 Vector MpuSensor::getAngularVelocity() { return angularVelocity; }
 
+// Sensor frame readings of the last sample, in g and deg/s
+Vector MpuSensor::getRawAcceleration() { return {mpu.getAccX(), mpu.getAccY(), mpu.getAccZ()}; }
+
+Vector MpuSensor::getRawAngularVelocity() { return {mpu.getGyroX(), mpu.getGyroY(), mpu.getGyroZ()}; }
+
 
 
+bool MpuSensor::isReady() { return state == ImuState::READY; }
+
+// Starts a full calibration. The vehicle must stay still while update() lets
+// the AHRS filter settle and then averages the residual accel/gyro readings.
 void MpuSensor::calibrate(){
-unsigned long sampleCount = 0;
 
 accelerationOffset = {0.0f, 0.0f, 0.0f};
 gyroOffset = {0.0f, 0.0f, 0.0f};
 orientationOffset = {0.0f, 0.0f, 0.0f};
+calibrationSamples = 0;
 
+state = ImuState::SETTLING;
+phaseStart = millis();
 
-unsigned long now = millis();
-unsigned long start = now;
-unsigned long last_update = now;
-do {
-
-    now = millis();
-    mpu.update();
-
-    if((now - last_update) < MPU_UPDATE_INTERVAL)
-    continue;
-
-    last_update = now;
-    mpu.update();
+}
 
-    if((now - start) < 15000)
-    continue;
+void MpuSensor::updateCalibration(unsigned long now) {
+
+switch (state) {
+    case ImuState::WARMING_UP:
+        if (now - phaseStart >= IMU_FAST_BOOT_WARMUP) {
+            state = ImuState::READY;
+            Logger::info("imu ready after %lu ms", now);
+        }
+        break;
+
+    case ImuState::SETTLING:
+        if (now - phaseStart >= IMU_CALIBRATION_SETTLE_TIME) {
+            state = ImuState::SAMPLING;
+            phaseStart = now;
+        }
+        break;
+
+    case ImuState::SAMPLING: {
+        Vector linearAcceleration = getLinearAcceleration();
+        accelerationOffset.x += linearAcceleration.x;
+        accelerationOffset.y += linearAcceleration.y;
+        accelerationOffset.z += linearAcceleration.z;
+        gyroOffset.x += mpu.getGyroX();
+        gyroOffset.y += mpu.getGyroY();
+        gyroOffset.z += mpu.getGyroZ();
+        calibrationSamples += 1;
+
+        if (now - phaseStart >= IMU_CALIBRATION_SAMPLE_TIME) {
+            finishCalibration();
+            saveCalibration();
+            state = ImuState::READY;
+            Logger::info("imu ready after %lu ms", now);
+        }
+        break;
+    }
+
+    default:
+        break;
+}
 
-    accelerationOffset.x += mpu.getLinearAccX();
-    accelerationOffset.y += mpu.getLinearAccY();
-    accelerationOffset.z += mpu.getLinearAccZ();
-    gyroOffset.x += mpu.getGyroX();
-    gyroOffset.y += mpu.getGyroY();
-    gyroOffset.z += mpu.getGyroZ();
+}
 
-    sampleCount += 1;
-} while((now - start) <= 30000);
+void MpuSensor::finishCalibration(){
 
 float accScale = 1;
 float gyroScale = 1;
 
-accelerationOffset.x *= accScale / sampleCount;
-accelerationOffset.y *= accScale / sampleCount;
-accelerationOffset.z *= accScale / sampleCount;
-gyroOffset.x *= gyroScale / sampleCount;
-gyroOffset.y *= gyroScale / sampleCount;
-gyroOffset.z *= gyroScale / sampleCount;
-orientationOffset.x = - atan2(accelerationOffset.y, accelerationOffset.z) * RAD_TO_DEG + mpu.getRoll(); // Roll
-orientationOffset.y = - atan2(-accelerationOffset.x, sqrt(accelerationOffset.y * accelerationOffset.y + accelerationOffset.z * accelerationOffset.z)) * RAD_TO_DEG + mpu.getPitch(); // Pitch
+accelerationOffset.x *= accScale / calibrationSamples;
+accelerationOffset.y *= accScale / calibrationSamples;
+accelerationOffset.z *= accScale / calibrationSamples;
+gyroOffset.x *= gyroScale / calibrationSamples;
+gyroOffset.y *= gyroScale / calibrationSamples;
+gyroOffset.z *= gyroScale / calibrationSamples;
+// Mounting tilt: whatever roll/pitch the filter reports while the vehicle is level
+Vector euler = ahrs.getEuler();
+orientationOffset.x = euler.x; // Roll
+orientationOffset.y = euler.y; // Pitch
 orientationOffset.z =  0;
 
 Logger::vector("orientation offset", orientationOffset);
@@ -174,3 +363,56 @@ Logger::vector("accelation offset", accelerationOffset);
 Logger::vector("gero offset", gyroOffset);
 }
 
+bool MpuSensor::loadCalibration() {
+
+ImuCalibration calibration;
+EEPROM.get(IMU_CALIBRATION_EEPROM_ADDRESS, calibration);
+
+if (calibration.magic != IMU_CALIBRATION_MAGIC ||
+    calibration.version != IMU_CALIBRATION_VERSION ||
+    calibration.checksum != calibrationChecksum(calibration)) {
+    Logger::info("no stored imu calibration");
+    return false;
+}
+
+mpu.update();
+float temperature = mpu.getTemperature();
+if (isnan(calibration.temperature) ||
+    fabs(temperature - calibration.temperature) > IMU_CALIBRATION_MAX_TEMPERATURE_DRIFT) {
+    Logger::info("stored imu calibration is stale (%d vs %d C)", (int)calibration.temperature, (int)temperature);
+    return false;
+}
+
+mpu.setAccBias(calibration.accelBias.x, calibration.accelBias.y, calibration.accelBias.z);
+mpu.setGyroBias(calibration.gyroBias.x, calibration.gyroBias.y, calibration.gyroBias.z);
+accelerationOffset = calibration.accelerationOffset;
+gyroOffset = calibration.gyroOffset;
+orientationOffset = calibration.orientationOffset;
+lastCalibrationSave = millis();
+
+Logger::vector("loaded accelation offset", accelerationOffset);
+Logger::vector("loaded gero offset", gyroOffset);
+return true;
+
+}
+
+void MpuSensor::saveCalibration() {
+
+ImuCalibration calibration;
+calibration.magic = IMU_CALIBRATION_MAGIC;
+calibration.version = IMU_CALIBRATION_VERSION;
+calibration.temperature = mpu.getTemperature();
+calibration.accelBias = {mpu.getAccBiasX(), mpu.getAccBiasY(), mpu.getAccBiasZ()};
+calibration.gyroBias = {mpu.getGyroBiasX(), mpu.getGyroBiasY(), mpu.getGyroBiasZ()};
+calibration.accelerationOffset = accelerationOffset;
+calibration.gyroOffset = gyroOffset;
+calibration.orientationOffset = orientationOffset;
+calibration.checksum = calibrationChecksum(calibration);
+
+// EEPROM.put only rewrites cells that changed
+EEPROM.put(IMU_CALIBRATION_EEPROM_ADDRESS, calibration);
+lastCalibrationSave = millis();
+
+Logger::info("imu calibration saved");
+
+}
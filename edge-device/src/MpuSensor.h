@@ -4,17 +4,36 @@
 #include "config.h"
 #include "utilities.h"
 #include "dataStructures.h"
+#include "Ahrs.h"
 #include <MPU9250.h>
 #include <Wire.h>
 
+// Calibration snapshot persisted to EEPROM so reboots can skip the long calibration
+struct ImuCalibration {
+  uint16_t magic;
+  uint8_t version;
+  float temperature;        // °C at calibration time
+  Vector accelBias;         // MPU9250 library biases (calibrateAccelGyro)
+  Vector gyroBias;
+  Vector accelerationOffset;
+  Vector gyroOffset;
+  Vector orientationOffset;
+  uint8_t checksum;
+};
 
+enum class ImuState : uint8_t {
+  SETTLING,     // full calibration: waiting for the AHRS filter to converge
+  SAMPLING,     // full calibration: averaging the at-rest readings
+  WARMING_UP,   // stored calibration loaded, filter still converging
+  READY
+};
 
 class MpuSensor {
 
 private:
 
   MPU9250 mpu;
-  Vector orientation = {0.0f, 0.0f, 0.0f};
+  Ahrs ahrs = Ahrs(AHRS_BETA);
   Vector velocity = {0.0f, 0.0f, 0.0f};
   Vector displacement = {0.0f, 0.0f, 0.0f};
   Vector angularVelocity = {0.0f, 0.0f, 0.0f};
@@ -24,7 +43,14 @@ private:
   Vector gyroOffset = {0.0f, 0.0f, 0.0f};
   Vector orientationOffset = {0.0f, 0.0f, 0.0f};
   unsigned long successiveStationaryState = 0;
+  float accelMagnitudeMean = 1.0f;
+  float accelMagnitudeVariance = 0.0f;
   unsigned long lastUpdate = 0;
+  unsigned long lastCalibrationSave = 0;
+  ImuState state = ImuState::SETTLING;
+  unsigned long phaseStart = 0;
+  unsigned long calibrationSamples = 0;
+  uint8_t savedAccelConfig2 = 0;
   const float alpha = 0.1f; // EMA coefficient
 
  
@@ -38,10 +64,24 @@ public:
   Vector getAcceleration();
   Vector getOrientation();
   Vector getAngularVelocity();
+  Vector getRawAcceleration();
+  Vector getRawAngularVelocity();
   void calibrate();
+  bool isReady();
+  bool isAtRest();
+  void trackBias();
+  unsigned long getIdleBudget(unsigned long now);
+  void enableMotionWake();
+  void disableMotionWake(unsigned long now);
 
 private:
   void updateStationaryState();
+  void updateAttitude(float dt);
+  Vector getLinearAcceleration();
+  void updateCalibration(unsigned long now);
+  void finishCalibration();
+  bool loadCalibration();
+  void saveCalibration();
 
 
 };
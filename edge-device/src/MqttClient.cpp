@@ -1,121 +1,249 @@
 #include "MqttClient.h"
+#include "MqttPayload.h"
+#include "MemoryMonitor.h"
 #define GSM_AUTOBAUD_MIN 9600
 #define GSM_AUTOBAUD_MAX 115200
 
-MqttClient::MqttClient(SensorManager& sensorManager, SoftwareSerial& sim808Serial)
+template <class Fallback>
+MqttClientT<Fallback>* MqttClientT<Fallback>::instance = nullptr;
+
+template <class Fallback>
+MqttClientT<Fallback>::MqttClientT(SensorManager& sensorManager, ModemStream& sim808Serial)
     :   sim808Serial(sim808Serial),
         sensorManager(sensorManager),
         gsmModem(sim808Serial),
         gsmClient(gsmModem),
         mqttClient(gsmClient),
+        connection(sim808Serial, gsmModem, gsmClient, mqttClient),
+        fallback(gsmModem),
         stablityState(0),
         lastSendTime(0),
         lastGprsUpdate(0),
-        lastConnectAttempt(0),
-        lastSuccessfullConnectionAttempt(0),
+        lastHealthReport(0),
+        firstPublishTime(0),
+        hasReported(false),
         missCount(0),
-        successCount(0) {}
+        successCount(0),
+        isConfigSubscribed(false),
+        hasPendingAck(false),
+        requestedVersion(0),
+        configResult(SettingsResult::UNCHANGED) {}
+
 
+template <class Fallback>
+void MqttClientT<Fallback>::setup() {
 
-void MqttClient::setup() {
+  // Modem, network, GPRS and broker are brought up by the connection manager
+  // from update(), so setup never blocks on the uplink.
+  mqttClient.setServer(MQTT_SERVER, MQTT_PORT);
+  // Long enough to survive a power-down cycle, which wakes at half of it
+  mqttClient.setKeepAlive(MQTT_KEEPALIVE);
+  mqttClient.setBufferSize(MQTT_BUFFER_SIZE);
+  // connect() only runs once the socket is open; this bounds the CONNACK wait
+  mqttClient.setSocketTimeout(MQTT_CONNACK_TIMEOUT);
+  instance = this;
+  mqttClient.setCallback(onMessage);
+  randomSeed(analogRead(0));
+  sequence.setup();
 
+  lastSendTime = millis();
 
-  Logger::info("Initializing modem...");
-  if (!gsmModem.restart()) {
-    Logger::warn("Failed to restart modem");
-    while (true); // Halt if modem fails to initialize
-  }
+  Logger::debug("gprs setup complete");
 
-  // Wait for network
-  Logger::info("Waiting for network...");
-  if (!gsmModem.waitForNetwork(60000L)) {
-    Logger::warn("Failed to connect to network");
-    while (true); // Halt if network connection fails
-  }
+}
 
-  // Connect to GPRS
-  Logger::info("Connecting to GPRS...");
-  if (!gsmModem.gprsConnect(APN, GPRS_USER, GPRS_PASS)) {
-    Logger::warn("Failed to connect to GPRS");
-    while (true); // Halt if GPRS connection fails
-  }
+template <class Fallback>
+void MqttClientT<Fallback>::update(unsigned long now) {
 
-  // Set MQTT server
-  mqttClient.setServer(MQTT_SERVER, MQTT_PORT);
+    if((now - lastGprsUpdate) < MODEM_UPDATE_INTERVAL) return;
+    lastGprsUpdate = now;
+    connection.update(now);
+    if (connection.isConnected()) {
+        subscribeConfig();
+        mqttClient.loop();
+        if (hasPendingAck) sendConfigAck();
+        if (now - lastHealthReport >= HEALTH_REPORT_INTERVAL) sendHealthReport(now);
+        sendTripSummaries();
+        sendBlackBoxChunk(now);
+    } else {
+        isConfigSubscribed = false;
+    }
+
+    // CGATT=1 or CIICR still owes its answer; any exchange now could take it
+    if (sim808Serial.isAwaitingResponse()) return;
+
+    fallback.update(now);
+
+    // The first report goes out as soon as any uplink is usable
+    if (!hasReported) {
+        if (!connection.isNetworkRegistered()) return;
+        hasReported = true;
+    } else if (now - lastSendTime < Settings::get().sendIntervals[stablityState]) return;
+
+    if (!connection.isConnected()){
+        if (Fallback::ENABLED) {
+            fallback.report(sensorManager.getVehicleStatus(), sequence.next(), now, Settings::get().sendIntervals[stablityState]);
+        }
+        adjustStablityState(false);
+        lastSendTime = now;
+        return;
+    }
+
+    VehicleStatus data = sensorManager.getVehicleStatus();
+    uint32_t number = sequence.next();
+    sendMqttMessage(data, number);
+    if (MQTT_ENABLE_SMS[stablityState]) fallback.report(data, number, now, Settings::get().sendIntervals[stablityState]);
+
+    lastSendTime = now;
+}
+
+// Milliseconds until the next modem tick
+template <class Fallback>
+unsigned long MqttClientT<Fallback>::getIdleBudget(unsigned long now) {
+    unsigned long elapsed = now - lastGprsUpdate;
+    return elapsed >= MODEM_UPDATE_INTERVAL ? 0 : MODEM_UPDATE_INTERVAL - elapsed;
+}
 
-    // Attempt to connect to MQTT server
-  Logger::info("Connecting to MQTT server: ");
+// Milliseconds the uplink can be left alone entirely: until the next report,
+// SMS batch flush or link retry, and never past half the MQTT keepalive
+template <class Fallback>
+unsigned long MqttClientT<Fallback>::getSleepBudget(unsigned long now) {
 
+    if (!hasReported) return 0;
 
-  int attempts = 0;
-  const int maxAttempts = 5;
+    unsigned long budget = MQTT_KEEPALIVE * 1000UL / 2;
+    unsigned long sendInterval = Settings::get().sendIntervals[stablityState];
+    unsigned long sinceSend = now - lastSendTime;
+    if (sinceSend >= sendInterval) return 0;
+    budget = min(budget, sendInterval - sinceSend);
 
-  while (!mqttClient.connected() && attempts < maxAttempts) {
-    if (mqttClient.connect(MQTT_CLIENT_ID)) {
-      Logger::info("Connected to MQTT server");
+    budget = min(budget, fallback.getSleepBudget(now));
+    if (budget == 0) return 0;
+
+    if (connection.isConnected()) {
+        // A pending black box capture goes out chunk by chunk on every modem tick
+        if (SensorManager::RecorderType::ENABLED && sensorManager.hasBlackBoxChunk()) return 0;
+        unsigned long sinceHealth = now - lastHealthReport;
+        if (sinceHealth >= HEALTH_REPORT_INTERVAL) return 0;
+        budget = min(budget, HEALTH_REPORT_INTERVAL - sinceHealth);
     } else {
-      Logger::warn("MQTT connection failed, rc=%d Retrying in 5 seconds...", mqttClient.state());
-      delay(5000);
-      attempts++;
+        long untilRetry = (long)(connection.getNextAttempt() - now);
+        if (untilRetry <= 0) return 0;
+        budget = min(budget, (unsigned long)untilRetry);
     }
-  }
-
-  if (!mqttClient.connected()) {
-    Logger::warn("Failed to connect to MQTT after max attempts");
-
-    // Attempt to reconnect GPRS
-    if (!gsmModem.isGprsConnected()) {
-      Logger::warn("GPRS disconnected, attempting to reconnect...");
-      if (!gsmModem.gprsConnect(APN, GPRS_USER, GPRS_PASS)) {
-        Logger::warn("GPRS reconnection failed, restarting modem...");
-        gsmModem.restart();
-      }
+    return budget;
+}
+
+template <class Fallback>
+void MqttClientT<Fallback>::sendHealthReport(unsigned long now) {
+
+    size_t headroom = MemoryMonitor::getStackHeadroom();
+    if (headroom < STACK_HEADROOM_WARN) {
+        Logger::warn("stack came within %u bytes of the heap", headroom);
     }
 
-    while(true);
+    Health::Report report;
+    Health::collect(report, now);
+    size_t length = Health::measure(report);
 
+    // Written straight to the socket; neither the report nor PubSubClient's buffer holds it
+    if (mqttClient.beginPublish(MQTT_HEALTH_TOPIC, length, false) &&
+        Health::print(mqttClient, report) == length &&
+        mqttClient.endPublish()) {
+        Health::reset(now);
+    } else {
+        Logger::warn("failed to send health report");
+    }
+    lastHealthReport = now;
 }
-    lastSendTime = millis();
-    lastConnectAttempt = lastSendTime;
-    lastSuccessfullConnectionAttempt = lastConnectAttempt;
-    
-    Logger::debug("gprs setup complete");
 
+// A clean session drops subscriptions, so this runs again after every reconnect.
+// The config topic is retained: the latest set is delivered on subscribe.
+template <class Fallback>
+void MqttClientT<Fallback>::subscribeConfig() {
+
+    if (isConfigSubscribed) return;
+    isConfigSubscribed = mqttClient.subscribe(MQTT_CONFIG_TOPIC, 1);
+    if (!isConfigSubscribed) Logger::warn("failed to subscribe to config topic");
 }
 
-void MqttClient::update(unsigned long now) {
+template <class Fallback>
+void MqttClientT<Fallback>::onMessage(char* topic, uint8_t* payload, unsigned int length) {
 
-    if((now - lastGprsUpdate) < MODEM_UPDATE_INTERVAL) return;
-    lastGprsUpdate = now;
-    mqttClient.loop();
+    if (!instance || strcmp(topic, MQTT_CONFIG_TOPIC) != 0) return;
 
-    if (now - lastSendTime < MQTT_SEND_INTERVALS[stablityState]) return;
+    // Acked from update(); publishing from inside the callback would reuse
+    // the buffer that still holds this payload
+    instance->configResult = Settings::apply(payload, length);
+    instance->requestedVersion = length >= 3 ? payload[1] | (uint16_t)payload[2] << 8 : 0;
+    instance->hasPendingAck = true;
+}
 
-    bool isMqttConnected = checkConnection(now);
+// Ack: u16 requested version, u16 active version, u8 SettingsResult
+template <class Fallback>
+void MqttClientT<Fallback>::sendConfigAck() {
 
-    VehicleStatus data = sensorManager.getVehicleStatus();
+    uint16_t activeVersion = Settings::get().version;
+    uint8_t ack[5];
+    memcpy(&ack[0], &requestedVersion, sizeof(uint16_t));
+    memcpy(&ack[2], &activeVersion, sizeof(uint16_t));
+    ack[4] = (uint8_t)configResult;
 
-    if (!isMqttConnected){
-        sendSms(data);
-        adjustStablityState(false);
-        return;
+    if (mqttClient.publish(MQTT_CONFIG_ACK_TOPIC, ack, sizeof(ack))) {
+        hasPendingAck = false;
+    } else {
+        Logger::warn("failed to send config ack");
     }
+}
 
-    sendMqttMessage(data);
-    if (MQTT_ENABLE_SMS[stablityState]) sendSms(data);
+// Finished trips stay queued on the device until the broker has taken them
+template <class Fallback>
+void MqttClientT<Fallback>::sendTripSummaries() {
+
+    TripSummary trip;
+    while (sensorManager.peekTripSummary(trip)) {
+        uint8_t buffer[MqttPayload::TRIP_SIZE];
+        MqttPayload::serializeTrip(trip, buffer);
+        if (!mqttClient.publish(MQTT_TRIP_TOPIC, buffer, sizeof(buffer))) {
+            Logger::warn("failed to send trip summary");
+            return;
+        }
+        sensorManager.popTripSummary();
+    }
+}
 
-    lastSendTime = now;
+// One chunk per modem tick, and none shortly before a status report is due,
+// so a capture never delays regular reporting
+template <class Fallback>
+void MqttClientT<Fallback>::sendBlackBoxChunk(unsigned long now) {
+
+    if (!SensorManager::RecorderType::ENABLED) return;
+
+    unsigned long sinceSend = now - lastSendTime;
+    if (sinceSend + BLACKBOX_UPLOAD_GUARD >= Settings::get().sendIntervals[stablityState]) return;
+
+    uint8_t chunk[SensorManager::RecorderType::CHUNK_SIZE];
+    size_t length = sensorManager.peekBlackBoxChunk(chunk);
+    if (length == 0) return;
+
+    if (mqttClient.publish(MQTT_BLACKBOX_TOPIC, chunk, length)) {
+        sensorManager.popBlackBoxChunk();
+    } else {
+        Logger::warn("failed to send black box chunk");
+    }
 }
 
-void MqttClient::sendMqttMessage(const VehicleStatus& data) {
+template <class Fallback>
+void MqttClientT<Fallback>::sendMqttMessage(const VehicleStatus& data, uint32_t number) {
     
-     Logger::info("%4d/%2d/%2d %2d:%2d:%d",
+     Logger::info("%4d/%2d/%2d %2d:%2d:%d.%03u",
         data.time.year,
         data.time.month,
         data.time.day,
         data.time.hour,
         data.time.minute,
-        data.time.second
+        data.time.second,
+        data.time.millisecond
     );
     Logger::vector("acceleration", data.acceleration);
     Logger::vector("angularVelocity", data.angularVelocity);
@@ -127,71 +255,17 @@ void MqttClient::sendMqttMessage(const VehicleStatus& data) {
     Logger::info("signalStrength: %d", data.signalStrength);
     Logger::info("batterydata: %d", data.batteryStatus);
 
-    // Buffer to hold serialized data (61 bytes)
-    uint8_t buffer[74];
-    uint8_t offset = 0;
-
-    // Serialize Datetime (6 bytes)
-    buffer[offset++] = data.time.second;
-    buffer[offset++] = data.time.minute;
-    buffer[offset++] = data.time.hour;
-    buffer[offset++] = data.time.day;
-    buffer[offset++] = data.time.month;
-    // Split int16_t year into two bytes (little-endian)
-    buffer[offset++] = (uint8_t)(data.time.year & 0xFF);
-    buffer[offset++] = (uint8_t)(data.time.year >> 8);
-
-    // Serialize Vector fields (4 bytes per float, 12 bytes per Vector)
-    memcpy(&buffer[offset], &data.acceleration.x, sizeof(float));
-    offset += sizeof(float);
-    memcpy(&buffer[offset], &data.acceleration.y, sizeof(float));
-    offset += sizeof(float);
-    memcpy(&buffer[offset], &data.acceleration.z, sizeof(float));
-    offset += sizeof(float);
-
-    memcpy(&buffer[offset], &data.velocity.x, sizeof(float));
-    offset += sizeof(float);
-    memcpy(&buffer[offset], &data.velocity.y, sizeof(float));
-    offset += sizeof(float);
-    memcpy(&buffer[offset], &data.velocity.z, sizeof(float));
-    offset += sizeof(float);
-
-    memcpy(&buffer[offset], &data.angularVelocity.x, sizeof(float));
-    offset += sizeof(float);
-    memcpy(&buffer[offset], &data.angularVelocity.y, sizeof(float));
-    offset += sizeof(float);
-    memcpy(&buffer[offset], &data.angularVelocity.z, sizeof(float));
-    offset += sizeof(float);
-
-    memcpy(&buffer[offset], &data.orientation.x, sizeof(float));
-    offset += sizeof(float);
-    memcpy(&buffer[offset], &data.orientation.y, sizeof(float));
-    offset += sizeof(float);
-    memcpy(&buffer[offset], &data.orientation.z, sizeof(float));
-    offset += sizeof(float);
-
-    memcpy(&buffer[offset], &data.location.x, sizeof(float));
-    offset += sizeof(float);
-    memcpy(&buffer[offset], &data.location.y, sizeof(float));
-    offset += sizeof(float);
-    memcpy(&buffer[offset], &data.location.z, sizeof(float));
-    offset += sizeof(float);
-
-    // Serialize remaining fields
-    buffer[offset++] = (uint8_t)data.isLocationDeadReckoned;
-    // Split unsigned long locationFreshness into four bytes (little-endian)
-    buffer[offset++] = (uint8_t)(data.locationFreshness & 0xFF);
-    buffer[offset++] = (uint8_t)((data.locationFreshness >> 8) & 0xFF);
-    buffer[offset++] = (uint8_t)((data.locationFreshness >> 16) & 0xFF);
-    buffer[offset++] = (uint8_t)((data.locationFreshness >> 24) & 0xFF);
-    buffer[offset++] = (uint8_t)data.signalStrength;
-    buffer[offset++] = (uint8_t)data.batteryStatus;
+    uint8_t buffer[MqttPayload::SIZE];
+    MqttPayload::serialize(data, number, buffer);
 
-    
     // Publish with QoS 1
     bool ack = mqttClient.publish(MQTT_TOPIC, buffer, sizeof(buffer));
     if (ack) {
         Logger::info("Message sent");
+        if (firstPublishTime == 0) {
+            firstPublishTime = millis();
+            Logger::info("startup: time to first publish %lu ms", firstPublishTime);
+        }
     } else {
         Logger::warn("Failed to send message");
     }
@@ -200,59 +274,19 @@ void MqttClient::sendMqttMessage(const VehicleStatus& data) {
 
 }
 
-void MqttClient::sendSms(const VehicleStatus& data) {
-
-    char lat[12], lon[12], speed[8], acc[8], bat[8];
-
-    // Format float values manually
-    dtostrf(data.location.x, 5, 2, lat);
-    dtostrf(data.location.y, 5, 2, lon);
-
-    float speedVal = sqrt(
-        data.velocity.x * data.velocity.x +
-        data.velocity.y * data.velocity.y +
-        data.velocity.z * data.velocity.z);
-    dtostrf(speedVal, 4, 1, speed);
-
-    float accVal = sqrt(
-        data.acceleration.x * data.acceleration.x +
-        data.acceleration.y * data.acceleration.y +
-        data.acceleration.z * data.acceleration.z);
-    dtostrf(accVal, 4, 1, acc);
-
-    // Battery
-    if (data.batteryStatus < 0) {
-        strcpy(bat, "ADAPTER");
-    } else {
-        snprintf(bat, sizeof(bat), "%d%%", data.batteryStatus);
-    }
-
-    char sms[160];
-    snprintf(sms, sizeof(sms),
-        "[%02d:%02d:%02d %02d/%02d/%04d] "
-        "Lat:%s Lon:%s Spd:%sm/s Acc:%s "
-        "Sig:%d%% Bat:%s",
-        data.time.hour, data.time.minute, data.time.second,
-        data.time.day, data.time.month, data.time.year,
-        lat, lon, speed, acc,
-        data.signalStrength, bat);
-
-
-    gsmModem.sendSMS(EMERGENCY_PHONE_NUMBER, sms);
-    Logger::info("SMS sent: %s", sms);
-}
-
-void MqttClient::adjustStablityState(bool success) {
+template <class Fallback>
+void MqttClientT<Fallback>::adjustStablityState(bool success) {
+    const RuntimeSettings& settings = Settings::get();
     if (success) {
         missCount = 0;
-        if (++successCount >= 20 && stablityState > 0) {
+        if (++successCount >= settings.stableSuccesses && stablityState > 0) {
             stablityState--;
             successCount = 0;
             Logger::info("downgrading stability status");
         }
     } else {
         successCount = 0;
-        if (++missCount >= 3 && stablityState < MQTT_WORST_STABILITY_STATUS) {
+        if (++missCount >= settings.unstableMisses && stablityState < MQTT_WORST_STABILITY_STATUS) {
             stablityState++;
             missCount = 0;
             Logger::info("upgrading stability status");
@@ -260,43 +294,5 @@ void MqttClient::adjustStablityState(bool success) {
     }
 }
 
-
-
-
-bool MqttClient::checkConnection(unsigned long now) {
-
-    if(mqttClient.connected()){
-        return true;
-    }
-
-    if((now - lastConnectAttempt) < MQTT_RECONNECTION_INTERVAL)
-        return false;
-
-    lastConnectAttempt = now;
-
-    if((now - lastSuccessfullConnectionAttempt) >= NETWORK_RECONNECTION_INTERVAL){
-        
-        if (!gsmModem.isNetworkConnected()) {
-            Logger::warn("network disconnected");
-
-            if (!gsmModem.waitForNetwork(15000L, true) || !gsmModem.isNetworkConnected()) {
-                return false;
-            }
-        }
-
-        if(!gsmModem.isGprsConnected() || !gsmModem.gprsConnect(APN, GPRS_USER, GPRS_PASS)){
-            return false;
-        }
-
-    }
-
-    if (mqttClient.connect(MQTT_CLIENT_ID)) {
-      Logger::info("Connected to MQTT server");
-      lastSuccessfullConnectionAttempt = now;
-      return true;
-    } else {
-      Logger::warn("MQTT connection failed, rc=%d Retrying in 5 seconds...", mqttClient.state());
-    }
-
-    return false;
-}
+// Only the build profile's fallback channel is compiled
+template class MqttClientT<FallbackChannel>;
@@ -3,35 +3,61 @@
 
 #include "config.h"
 #include "SensorManager.h"
+#include "ConnectionManager.h"
+#include "FallbackChannel.h"
+#include "Health.h"
+#include "SequenceCounter.h"
+#include "Settings.h"
 #include <TinyGsmClient.h>
 #include <PubSubClient.h>
 
-class MqttClient {
+// Fallback is the channel used while MQTT is down (see FallbackChannel.h).
+// Only the instantiation selected in config.h is compiled, see MqttClient.cpp.
+template <class Fallback>
+class MqttClientT {
 public:
-    MqttClient(SensorManager& sensorManager, SoftwareSerial& sim808Serial);
+    MqttClientT(SensorManager& sensorManager, ModemStream& sim808Serial);
     void setup();
     void update(unsigned long now);
+    unsigned long getIdleBudget(unsigned long now);
+    unsigned long getSleepBudget(unsigned long now);
 
 private:
-    void sendMqttMessage(const VehicleStatus& data);
-    void sendSms(const VehicleStatus& data);
+    void sendMqttMessage(const VehicleStatus& data, uint32_t number);
+    void sendHealthReport(unsigned long now);
+    void sendTripSummaries();
+    void sendBlackBoxChunk(unsigned long now);
     void adjustStablityState(bool success);
-    bool checkConnection(unsigned long now);
+    void subscribeConfig();
+    void sendConfigAck();
+    static void onMessage(char* topic, uint8_t* payload, unsigned int length);
 
-    SoftwareSerial& sim808Serial;
+    static MqttClientT* instance;
+
+    ModemStream& sim808Serial;
     SensorManager& sensorManager;
     TinyGsm gsmModem;
-    TinyGsmClient gsmClient;
+    AsyncGsmClient gsmClient;
     PubSubClient mqttClient;
+    ConnectionManager connection;
+    Fallback fallback;
+    SequenceCounter sequence;
 
     int8_t stablityState;
     unsigned long lastSendTime;
     unsigned long lastGprsUpdate;
-    unsigned long lastConnectAttempt;
-    unsigned long lastSuccessfullConnectionAttempt;
+    unsigned long lastHealthReport;
+    unsigned long firstPublishTime;
+    bool hasReported;
     uint8_t missCount;
     uint16_t successCount;
+    bool isConfigSubscribed;
+    bool hasPendingAck;
+    uint16_t requestedVersion;
+    SettingsResult configResult;
     
 };
 
+using MqttClient = MqttClientT<FallbackChannel>;
+
 #endif
\ No newline at end of file
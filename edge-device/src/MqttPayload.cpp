@@ -0,0 +1,111 @@
+#include "MqttPayload.h"
+#include <string.h>
+
+// Writes SIZE bytes into buffer and returns the number written
+size_t MqttPayload::serialize(const VehicleStatus& data, uint32_t sequence, uint8_t* buffer) {
+
+    size_t offset = 0;
+
+    // Serialize Datetime (6 bytes)
+    buffer[offset++] = data.time.second;
+    buffer[offset++] = data.time.minute;
+    buffer[offset++] = data.time.hour;
+    buffer[offset++] = data.time.day;
+    buffer[offset++] = data.time.month;
+    // Split int16_t year into two bytes (little-endian)
+    buffer[offset++] = (uint8_t)(data.time.year & 0xFF);
+    buffer[offset++] = (uint8_t)(data.time.year >> 8);
+
+    // Serialize Vector fields (4 bytes per float, 12 bytes per Vector)
+    memcpy(&buffer[offset], &data.acceleration.x, sizeof(float));
+    offset += sizeof(float);
+    memcpy(&buffer[offset], &data.acceleration.y, sizeof(float));
+    offset += sizeof(float);
+    memcpy(&buffer[offset], &data.acceleration.z, sizeof(float));
+    offset += sizeof(float);
+
+    memcpy(&buffer[offset], &data.velocity.x, sizeof(float));
+    offset += sizeof(float);
+    memcpy(&buffer[offset], &data.velocity.y, sizeof(float));
+    offset += sizeof(float);
+    memcpy(&buffer[offset], &data.velocity.z, sizeof(float));
+    offset += sizeof(float);
+
+    memcpy(&buffer[offset], &data.angularVelocity.x, sizeof(float));
+    offset += sizeof(float);
+    memcpy(&buffer[offset], &data.angularVelocity.y, sizeof(float));
+    offset += sizeof(float);
+    memcpy(&buffer[offset], &data.angularVelocity.z, sizeof(float));
+    offset += sizeof(float);
+
+    memcpy(&buffer[offset], &data.orientation.x, sizeof(float));
+    offset += sizeof(float);
+    memcpy(&buffer[offset], &data.orientation.y, sizeof(float));
+    offset += sizeof(float);
+    memcpy(&buffer[offset], &data.orientation.z, sizeof(float));
+    offset += sizeof(float);
+
+    memcpy(&buffer[offset], &data.location.x, sizeof(float));
+    offset += sizeof(float);
+    memcpy(&buffer[offset], &data.location.y, sizeof(float));
+    offset += sizeof(float);
+    memcpy(&buffer[offset], &data.location.z, sizeof(float));
+    offset += sizeof(float);
+
+    // Serialize remaining fields
+    buffer[offset++] = (uint8_t)data.isLocationDeadReckoned;
+    // Split unsigned long locationFreshness into four bytes (little-endian)
+    buffer[offset++] = (uint8_t)(data.locationFreshness & 0xFF);
+    buffer[offset++] = (uint8_t)((data.locationFreshness >> 8) & 0xFF);
+    buffer[offset++] = (uint8_t)((data.locationFreshness >> 16) & 0xFF);
+    buffer[offset++] = (uint8_t)((data.locationFreshness >> 24) & 0xFF);
+    buffer[offset++] = (uint8_t)data.signalStrength;
+    buffer[offset++] = (uint8_t)data.batteryStatus;
+    // Sub-second part of the timestamp, appended so the first 74 bytes keep the old layout
+    buffer[offset++] = (uint8_t)(data.time.millisecond & 0xFF);
+    buffer[offset++] = (uint8_t)(data.time.millisecond >> 8);
+    // Per-device sequence number (little-endian) so the server can drop
+    // duplicates and restore order
+    buffer[offset++] = (uint8_t)(sequence & 0xFF);
+    buffer[offset++] = (uint8_t)((sequence >> 8) & 0xFF);
+    buffer[offset++] = (uint8_t)((sequence >> 16) & 0xFF);
+    buffer[offset++] = (uint8_t)((sequence >> 24) & 0xFF);
+
+    return offset;
+}
+
+// Little-endian fields in TripSummary order; writes TRIP_SIZE bytes
+size_t MqttPayload::serializeTrip(const TripSummary& trip, uint8_t* buffer) {
+
+    size_t offset = 0;
+
+    memcpy(&buffer[offset], &trip.startTime, sizeof(uint32_t));
+    offset += sizeof(uint32_t);
+    memcpy(&buffer[offset], &trip.endTime, sizeof(uint32_t));
+    offset += sizeof(uint32_t);
+
+    memcpy(&buffer[offset], &trip.startLatitude, sizeof(float));
+    offset += sizeof(float);
+    memcpy(&buffer[offset], &trip.startLongitude, sizeof(float));
+    offset += sizeof(float);
+    memcpy(&buffer[offset], &trip.endLatitude, sizeof(float));
+    offset += sizeof(float);
+    memcpy(&buffer[offset], &trip.endLongitude, sizeof(float));
+    offset += sizeof(float);
+
+    memcpy(&buffer[offset], &trip.distance, sizeof(float));
+    offset += sizeof(float);
+    memcpy(&buffer[offset], &trip.movingTime, sizeof(uint32_t));
+    offset += sizeof(uint32_t);
+    memcpy(&buffer[offset], &trip.maxSpeed, sizeof(float));
+    offset += sizeof(float);
+
+    memcpy(&buffer[offset], &trip.harshAccelerations, sizeof(uint16_t));
+    offset += sizeof(uint16_t);
+    memcpy(&buffer[offset], &trip.harshBrakings, sizeof(uint16_t));
+    offset += sizeof(uint16_t);
+    memcpy(&buffer[offset], &trip.harshCornerings, sizeof(uint16_t));
+    offset += sizeof(uint16_t);
+
+    return offset;
+}
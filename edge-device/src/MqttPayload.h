@@ -0,0 +1,19 @@
+#ifndef __MQTT_PAYLOAD_H__
+    #define __MQTT_PAYLOAD_H__
+
+#include <stddef.h>
+#include "dataStructures.h"
+
+// Binary status record published on MQTT_TOPIC. Fields are appended at the
+// end so older servers can keep reading the legacy 74-byte prefix.
+class MqttPayload {
+public:
+    static constexpr size_t SIZE = 80;
+    static size_t serialize(const VehicleStatus& data, uint32_t sequence, uint8_t* buffer);
+
+    // Trip summary published on MQTT_TRIP_TOPIC
+    static constexpr size_t TRIP_SIZE = 42;
+    static size_t serializeTrip(const TripSummary& trip, uint8_t* buffer);
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "NmeaParser.h"
+#include <Arduino.h>
+
+static const float KNOTS_TO_METERS_PER_SECOND = 0.514444f;
+static const uint8_t NMEA_MAX_FIELDS = 16;
+
+// "ddmm.mmmm" / "dddmm.mmmm" plus hemisphere to signed decimal degrees
+static float parseCoordinate(const char* value, const char* hemisphere) {
+    float raw = atof(value);
+    int degrees = (int)(raw / 100);
+    float result = degrees + (raw - degrees * 100) / 60.0f;
+    return (*hemisphere == 'S' || *hemisphere == 'W') ? -result : result;
+}
+
+static uint8_t twoDigits(const char* value) {
+    return (value[0] - '0') * 10 + (value[1] - '0');
+}
+
+static uint8_t hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return 0xFF;
+}
+
+NmeaParser::NmeaParser() {
+    reset();
+}
+
+void NmeaParser::reset() {
+    length = 0;
+    isCapturing = false;
+    altitude = 0.0f;
+    satellites = 0;
+}
+
+// XOR of every character between '$' and '*'
+uint8_t NmeaParser::checksum(const char* sentence) {
+    if (*sentence == '$') sentence++;
+    uint8_t sum = 0;
+    while (*sentence && *sentence != '*') sum ^= *sentence++;
+    return sum;
+}
+
+bool NmeaParser::feed(char c, GpsData& fix) {
+
+    if (c == '$') {
+        isCapturing = true;
+        length = 0;
+    }
+    if (!isCapturing) return false;
+
+    if (c == '\r' || c == '\n') {
+        isCapturing = false;
+        sentence[length] = '\0';
+        return parseSentence(fix);
+    }
+
+    if (length >= NMEA_MAX_SENTENCE_LENGTH) {
+        isCapturing = false; // garbage or a merged line, wait for the next '$'
+        return false;
+    }
+    sentence[length++] = c;
+    return false;
+}
+
+bool NmeaParser::parseSentence(GpsData& fix) {
+
+    char* star = strchr(sentence, '*');
+    if (!star || length < 7) return false;
+    uint8_t expected = hexValue(star[1]) << 4 | hexValue(star[2]);
+    if (checksum(sentence) != expected) return false;
+    *star = '\0';
+
+    // Split in place, keeping empty fields ("a,,b" has three)
+    char* fields[NMEA_MAX_FIELDS];
+    uint8_t count = 0;
+    char* cursor = sentence + 1;
+    fields[count++] = cursor;
+    while ((cursor = strchr(cursor, ',')) && count < NMEA_MAX_FIELDS) {
+        *cursor++ = '\0';
+        fields[count++] = cursor;
+    }
+
+    // Talker id (GP, GN, GL...) is ignored
+    const char* type = fields[0] + 2;
+    if (strcmp(type, "RMC") == 0) return parseRmc(fields, count, fix);
+    if (strcmp(type, "GGA") == 0) parseGga(fields, count);
+    return false;
+}
+
+// $xxRMC,time,status,lat,N/S,lon,E/W,speed(knots),course,date,...
+bool NmeaParser::parseRmc(char** fields, uint8_t count, GpsData& fix) {
+
+    if (count < 9 || *fields[2] != 'A') return false;
+
+    fix.latitude = parseCoordinate(fields[3], fields[4]);
+    fix.longitude = parseCoordinate(fields[5], fields[6]);
+    fix.speed = atof(fields[7]) * KNOTS_TO_METERS_PER_SECOND;
+    fix.heading = atof(fields[8]);
+    fix.altitude = altitude;
+    fix.satellites = satellites;
+
+    // hhmmss.sss and ddmmyy
+    const char* time = fields[1];
+    const char* date = fields[9];
+    if (count > 9 && strlen(time) >= 6 && strlen(date) == 6) {
+        fix.utcTime.hour = twoDigits(time);
+        fix.utcTime.minute = twoDigits(time + 2);
+        fix.utcTime.second = twoDigits(time + 4);
+        fix.utcTime.millisecond = time[6] == '.' ? (uint16_t)(atof(time + 6) * 1000 + 0.5f) : 0;
+        fix.utcTime.day = twoDigits(date);
+        fix.utcTime.month = twoDigits(date + 2);
+        fix.utcTime.year = 2000 + twoDigits(date + 4);
+    } else {
+        fix.utcTime.year = 0;
+    }
+    return true;
+}
+
+// $xxGGA,time,lat,N/S,lon,E/W,quality,satellites,hdop,altitude,M,...
+void NmeaParser::parseGga(char** fields, uint8_t count) {
+
+    if (count < 10 || atoi(fields[6]) == 0) return;
+
+    satellites = atoi(fields[7]);
+    altitude = atof(fields[9]);
+}
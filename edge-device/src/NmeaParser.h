@@ -0,0 +1,33 @@
+#ifndef __NMEA_PARSER_H__
+    #define __NMEA_PARSER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+#include "dataStructures.h"
+
+// Incremental parser for the RMC and GGA sentences of an NMEA stream. Feed it
+// one character at a time; a fix is produced on every valid RMC sentence, with
+// altitude and satellite count taken from the latest GGA. measureTime is left
+// to the caller, which knows when the sentence arrived.
+class NmeaParser {
+public:
+    NmeaParser();
+    bool feed(char c, GpsData& fix);
+    void reset();
+
+    static uint8_t checksum(const char* sentence);
+
+private:
+    bool parseSentence(GpsData& fix);
+    bool parseRmc(char** fields, uint8_t count, GpsData& fix);
+    void parseGga(char** fields, uint8_t count);
+
+    char sentence[NMEA_MAX_SENTENCE_LENGTH + 1];
+    uint8_t length;
+    bool isCapturing;
+    float altitude;
+    uint8_t satellites;
+};
+
+#endif
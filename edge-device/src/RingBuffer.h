@@ -0,0 +1,43 @@
+#ifndef __RING_BUFFER_H__
+    #define __RING_BUFFER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Fixed-capacity FIFO; push() drops the new element when full
+template <typename T, size_t N>
+class RingBuffer {
+public:
+    bool push(const T& value) {
+        if (count == N) return false;
+        items[(head + count) % N] = value;
+        count++;
+        return true;
+    }
+
+    bool pop(T& value) {
+        if (count == 0) return false;
+        value = items[head];
+        head = (head + 1) % N;
+        count--;
+        return true;
+    }
+
+    bool peek(T& value) const {
+        if (count == 0) return false;
+        value = items[head];
+        return true;
+    }
+
+    size_t size() const { return count; }
+    bool isEmpty() const { return count == 0; }
+    bool isFull() const { return count == N; }
+    void clear() { head = 0; count = 0; }
+
+private:
+    T items[N];
+    size_t head = 0;
+    size_t count = 0;
+};
+
+#endif
@@ -1,20 +1,23 @@
 #include "SensorManager.h"
 #include "utilities.h"
+#include "Settings.h"
 
-SensorManager::SensorManager(SoftwareSerial& sim808Serial) : 
+template <class Recorder>
+SensorManagerT<Recorder>::SensorManagerT(ModemStream& sim808Serial) : 
     gpsSensor(sim808Serial),
     mpuSensor() {
 
     lastGpsPeriod = 0;
+    firstFixTime = 0;
     isGpsUpdated = true;
 }
 
-void SensorManager::setup(){
+// Only kicks off GNSS power-up and IMU calibration; both are finished
+// cooperatively from update() while the modem registers in parallel.
+template <class Recorder>
+void SensorManagerT<Recorder>::setup(){
 
-    if (!gpsSensor.setup()) {
-        Logger::warn("failed to initialize gps. program halted");
-        while (1);
-    }
+    gpsSensor.setup();
 
     if(!mpuSensor.setup()){
         Logger::warn("failed to initialize mpu. program halted");
@@ -23,29 +26,167 @@ void SensorManager::setup(){
 
 }
 
-void SensorManager::update(unsigned long now){
+template <class Recorder>
+void SensorManagerT<Recorder>::update(unsigned long now){
+
+    if (mpuSensor.update(now)) {
+        if (Recorder::ENABLED) {
+            uint32_t epoch = clock.isSynced() ? (uint32_t)(clock.getEpochMillis(now) / 1000) : 0;
+            blackBox.record(now, epoch, mpuSensor.getRawAcceleration(), mpuSensor.getRawAngularVelocity());
+        }
+        updateTrip(now);
+        if (isGpsFresh() && gpsSensor.gpsData.speed < IMU_BIAS_TRACKING_MAX_SPEED) {
+            mpuSensor.trackBias();
+        }
+    }
 
-    mpuSensor.update(now);
-      
-    
-    if((now - lastGpsPeriod) >= GPS_UPDATE_INTERVAL){
+    if (!gpsSensor.updateSetup(now)) return;
+
+    bool hasNewFix = false;
+
+    if (GPS_NMEA_STREAMING) {
+        gpsSensor.updateStreamRate(now);
+        hasNewFix = gpsSensor.updateStream();
+        if (hasNewFix) {
+            isGpsUpdated = true;
+        } else if (millis() - gpsSensor.gpsData.measureTime >=
+                   (unsigned long)GPS_STREAM_MISSED_FIXES * gpsSensor.getStreamFixInterval()) {
+            isGpsUpdated = false;
+        }
+    } else if((now - lastGpsPeriod) >= Settings::get().gpsUpdateInterval){
         lastGpsPeriod = now;
-        isGpsUpdated = gpsSensor.updateGps();
-        if(isGpsUpdated){
-            mpuSensor.resetDisplacement();   
+        isGpsUpdated = hasNewFix = gpsSensor.updateGps();
+    }
+
+    if(hasNewFix){
+        mpuSensor.resetDisplacement();   
+        const Datetime& utc = gpsSensor.gpsData.utcTime;
+        if (utc.year != 0 && (clock.getSource() != ClockSource::GNSS || clock.needsSync(now) ||
+                              clock.getSyncAge(now) >= CLOCK_RESYNC_INTERVAL)) {
+            clock.sync(utc, gpsSensor.gpsData.measureTime, ClockSource::GNSS);
+        }
+        if (firstFixTime == 0) {
+            firstFixTime = millis();
+            Logger::info("startup: time to first fix %lu ms", firstFixTime);
         }
     }
 }
 
+// GNSS speed and course while fixes are fresh, the IMU otherwise
+template <class Recorder>
+void SensorManagerT<Recorder>::updateTrip(unsigned long now) {
+
+    const GpsData& gps = gpsSensor.gpsData;
+
+    float speed, heading;
+    bool isMoving;
+    if (isGpsFresh()) {
+        speed = gps.speed;
+        heading = gps.heading;
+        isMoving = speed >= TRIP_MOVING_SPEED;
+    } else {
+        Vector velocity = mpuSensor.getVelocity();
+        speed = sqrt(velocity.x * velocity.x + velocity.y * velocity.y);
+        heading = degrees(atan2(velocity.x, velocity.y));
+        isMoving = !mpuSensor.isAtRest();
+    }
+
+    tripTracker.update(now, clock, isMoving, speed, heading, mpuSensor.getAcceleration(), gps.latitude, gps.longitude);
+}
+
+template <class Recorder>
+bool SensorManagerT<Recorder>::peekTripSummary(TripSummary& summary) const {
+    return tripTracker.peekSummary(summary);
+}
 
+template <class Recorder>
+void SensorManagerT<Recorder>::popTripSummary() {
+    tripTracker.popSummary();
+}
 
+template <class Recorder>
+bool SensorManagerT<Recorder>::hasBlackBoxChunk() const {
+    return blackBox.hasChunk();
+}
 
+template <class Recorder>
+size_t SensorManagerT<Recorder>::peekBlackBoxChunk(uint8_t* buffer) const {
+    return blackBox.peekChunk(buffer);
+}
 
-VehicleStatus SensorManager::getVehicleStatus() {
+template <class Recorder>
+void SensorManagerT<Recorder>::popBlackBoxChunk() {
+    blackBox.popChunk();
+}
+
+// Milliseconds until a sensor needs the CPU again
+template <class Recorder>
+unsigned long SensorManagerT<Recorder>::getIdleBudget(unsigned long now) {
+
+    unsigned long budget = mpuSensor.getIdleBudget(now);
+    if (!gpsSensor.isReady()) return 0;
+
+    if (GPS_NMEA_STREAMING) {
+        // Sentences arrive on their own; keep draining them at the fix rate
+        budget = min(budget, (unsigned long)gpsSensor.getStreamFixInterval());
+    } else {
+        unsigned long interval = Settings::get().gpsUpdateInterval;
+        unsigned long elapsed = now - lastGpsPeriod;
+        budget = min(budget, elapsed >= interval ? 0 : interval - elapsed);
+    }
+    return budget;
+}
+
+template <class Recorder>
+bool SensorManagerT<Recorder>::isGpsFresh() const {
+    return isGpsUpdated && gpsSensor.gpsData.measureTime != 0;
+}
+
+// A quiet IMU alone is not enough: a smooth cruise looks the same. A fresh
+// fix has to show the vehicle standing, or, without one, no trip may be open.
+template <class Recorder>
+bool SensorManagerT<Recorder>::isAtRest() {
+    if (!gpsSensor.isReady() || !mpuSensor.isAtRest()) return false;
+    if (isGpsFresh()) return gpsSensor.gpsData.speed < TRIP_MOVING_SPEED;
+    return !tripTracker.isActive();
+}
+
+// Parks the modem and leaves the IMU watching for motion. Returns false if the
+// modem would not sleep, in which case nothing was changed.
+template <class Recorder>
+bool SensorManagerT<Recorder>::sleep() {
+
+    if (!gpsSensor.sleepModem()) return false;
+    mpuSensor.enableMotionWake();
+    return true;
+}
+
+template <class Recorder>
+void SensorManagerT<Recorder>::wake(unsigned long now) {
+
+    mpuSensor.disableMotionWake(now);
+    gpsSensor.wakeModem();
+    // millis() was advanced by the nominal watchdog periods, which are only good to about 10%
+    clock.markGap();
+}
+
+template <class Recorder>
+VehicleStatus SensorManagerT<Recorder>::getVehicleStatus() {
 
     VehicleStatus status;
 
-    status.time = gpsSensor.getDatetime();
+    // Network time is only fetched when GNSS has not disciplined the clock lately
+    unsigned long now = millis();
+    if (clock.needsSync(now)) {
+        int32_t utcOffset;
+        Datetime local = gpsSensor.getDatetime(&utcOffset);
+        clock.syncLocal(local, utcOffset, now);
+    }
+    if (clock.isSynced()) {
+        status.time = clock.getLocalTime(millis());
+    } else {
+        status.time = {0, 0, 0, 0, 0, 0, 0};
+    }
     status.signalStrength = gpsSensor.getSignalStrength();
     status.batteryStatus = gpsSensor.getBatteryStatus();
 
@@ -72,4 +213,7 @@ VehicleStatus SensorManager::getVehicleStatus() {
     status.locationFreshness = millis() - gpsSensor.gpsData.measureTime;  
 
     return status;
-}
\ No newline at end of file
+}
+
+// Only the build profile's recorder is compiled
+template class SensorManagerT<ImuRecorder>;
@@ -2,24 +2,49 @@
     #define __SENSOR_MANAGER_H__
 
 
-#include "datastructures.h"
+#include "dataStructures.h"
 #include "GpsSensor.h"
 #include "MpuSensor.h"
+#include "SoftwareClock.h"
+#include "TripTracker.h"
+#include "BlackBox.h"
 
-class SensorManager {
+// Recorder is the IMU capture policy (BlackBox or NoBlackBox). Only the
+// instantiation selected in config.h is compiled, see SensorManager.cpp.
+template <class Recorder>
+class SensorManagerT {
 public:
+    using RecorderType = Recorder;
 
-    SensorManager(SoftwareSerial& sim808Serial);
+    SensorManagerT(ModemStream& sim808Serial);
     void setup();
     void update(unsigned long now);
     VehicleStatus getVehicleStatus();
+    unsigned long getIdleBudget(unsigned long now);
+    bool isAtRest();
+    bool sleep();
+    bool peekTripSummary(TripSummary& summary) const;
+    void popTripSummary();
+    bool hasBlackBoxChunk() const;
+    size_t peekBlackBoxChunk(uint8_t* buffer) const;
+    void popBlackBoxChunk();
+    void wake(unsigned long now);
     
 
 private:
+    void updateTrip(unsigned long now);
+    bool isGpsFresh() const;
+
     GpsSensor gpsSensor;
     MpuSensor mpuSensor;
+    SoftwareClock clock;
+    TripTracker tripTracker;
+    Recorder blackBox;
     unsigned long lastGpsPeriod;
+    unsigned long firstFixTime;
     bool isGpsUpdated;
 };
 
+using SensorManager = SensorManagerT<ImuRecorder>;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,48 @@
+#include "SequenceCounter.h"
+#include "utilities.h"
+#include <EEPROM.h>
+
+static uint8_t sequenceChecksum(const SequenceRecord& record) {
+    const uint8_t* bytes = (const uint8_t*)&record;
+    uint8_t sum = 0;
+    for (size_t i = 0; i < offsetof(SequenceRecord, checksum); i++) sum += bytes[i];
+    return sum;
+}
+
+SequenceCounter::SequenceCounter() : current(0), blockEnd(0) {}
+
+void SequenceCounter::setup() {
+
+    SequenceRecord record;
+    EEPROM.get(SEQUENCE_EEPROM_ADDRESS, record);
+
+    if (record.magic == SEQUENCE_MAGIC && record.checksum == sequenceChecksum(record)) {
+        current = record.nextBlock;
+    } else {
+        Logger::info("no stored message sequence, starting at 0");
+        current = 0;
+    }
+    reserveBlock();
+    Logger::info("message sequence starts at %lu", current);
+}
+
+uint32_t SequenceCounter::next() {
+    if (current >= blockEnd) reserveBlock();
+    return current++;
+}
+
+uint32_t SequenceCounter::peek() const {
+    return current;
+}
+
+// Persists the end of the block before any number in it is handed out
+void SequenceCounter::reserveBlock() {
+
+    blockEnd = current + SEQUENCE_BLOCK_SIZE;
+
+    SequenceRecord record;
+    record.magic = SEQUENCE_MAGIC;
+    record.nextBlock = blockEnd;
+    record.checksum = sequenceChecksum(record);
+    EEPROM.put(SEQUENCE_EEPROM_ADDRESS, record);
+}
@@ -0,0 +1,29 @@
+#ifndef __SEQUENCE_COUNTER_H__
+    #define __SEQUENCE_COUNTER_H__
+
+#include "config.h"
+
+struct SequenceRecord {
+  uint16_t magic;
+  uint32_t nextBlock;
+  uint8_t checksum;
+};
+
+// Per-device message sequence that keeps increasing across reboots. Numbers
+// are reserved from EEPROM in blocks, so a reboot skips the rest of the
+// current block instead of writing the EEPROM for every message.
+class SequenceCounter {
+public:
+    SequenceCounter();
+    void setup();
+    uint32_t next();
+    uint32_t peek() const;
+
+private:
+    void reserveBlock();
+
+    uint32_t current;
+    uint32_t blockEnd;
+};
+
+#endif
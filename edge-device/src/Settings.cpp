@@ -0,0 +1,103 @@
+#include "Settings.h"
+#include "utilities.h"
+#include <EEPROM.h>
+#include <stddef.h>
+#include <string.h>
+
+static const uint8_t SETTINGS_FORMAT = 1;
+static const size_t SETTINGS_RECORD_SIZE = 21;
+
+// Accepted ranges; the IMU filter and rest detection are tuned around 50 Hz
+static const uint16_t GPS_INTERVAL_MIN = 200, GPS_INTERVAL_MAX = 60000;
+static const uint8_t MPU_INTERVAL_MIN = 10, MPU_INTERVAL_MAX = 50;
+static const uint32_t SEND_INTERVAL_MIN = 5000, SEND_INTERVAL_MAX = 3600000;
+
+RuntimeSettings Settings::current = {
+    0,
+    GPS_UPDATE_INTERVAL,
+    MPU_UPDATE_INTERVAL,
+    {MQTT_SEND_INTERVALS[0], MQTT_SEND_INTERVALS[1], MQTT_SEND_INTERVALS[2]},
+    MQTT_STABLE_SUCCESSES,
+    MQTT_UNSTABLE_MISSES
+};
+
+static uint8_t recordChecksum(const SettingsRecord& record) {
+    return crc8((const uint8_t*)&record, offsetof(SettingsRecord, checksum));
+}
+
+void Settings::load() {
+
+    SettingsRecord record;
+    EEPROM.get(SETTINGS_EEPROM_ADDRESS, record);
+
+    if (record.magic != SETTINGS_MAGIC || record.checksum != recordChecksum(record) || !isValid(record.settings)) {
+        Logger::info("no stored settings, using defaults");
+        return;
+    }
+    current = record.settings;
+    Logger::info("settings version %u loaded", current.version);
+}
+
+const RuntimeSettings& Settings::get() {
+    return current;
+}
+
+SettingsResult Settings::apply(const uint8_t* payload, size_t length) {
+
+    RuntimeSettings received;
+    if (!decode(payload, length, received) || !isValid(received)) {
+        Logger::warn("rejected invalid settings");
+        return SettingsResult::INVALID;
+    }
+    if (received.version == current.version) return SettingsResult::UNCHANGED;
+    if (received.version < current.version) {
+        Logger::warn("rejected settings version %u, %u is active", received.version, current.version);
+        return SettingsResult::STALE;
+    }
+
+    current = received;
+    save();
+    Logger::info("settings version %u applied", current.version);
+    return SettingsResult::APPLIED;
+}
+
+bool Settings::decode(const uint8_t* payload, size_t length, RuntimeSettings& settings) {
+
+    if (length != SETTINGS_RECORD_SIZE || payload[0] != SETTINGS_FORMAT) return false;
+    if (crc8(payload, length - 1) != payload[length - 1]) return false;
+
+    size_t offset = 1;
+    memcpy(&settings.version, &payload[offset], sizeof(uint16_t));
+    offset += sizeof(uint16_t);
+    memcpy(&settings.gpsUpdateInterval, &payload[offset], sizeof(uint16_t));
+    offset += sizeof(uint16_t);
+    settings.mpuUpdateInterval = payload[offset++];
+    for (uint8_t i = 0; i < 3; i++) {
+        memcpy(&settings.sendIntervals[i], &payload[offset], sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+    }
+    settings.stableSuccesses = payload[offset++];
+    settings.unstableMisses = payload[offset++];
+    return true;
+}
+
+bool Settings::isValid(const RuntimeSettings& settings) {
+
+    if (settings.gpsUpdateInterval < GPS_INTERVAL_MIN || settings.gpsUpdateInterval > GPS_INTERVAL_MAX) return false;
+    if (settings.mpuUpdateInterval < MPU_INTERVAL_MIN || settings.mpuUpdateInterval > MPU_INTERVAL_MAX) return false;
+    for (uint8_t i = 0; i < 3; i++) {
+        if (settings.sendIntervals[i] < SEND_INTERVAL_MIN || settings.sendIntervals[i] > SEND_INTERVAL_MAX) return false;
+        // A less stable link never reports more often
+        if (i > 0 && settings.sendIntervals[i] < settings.sendIntervals[i - 1]) return false;
+    }
+    return settings.stableSuccesses > 0 && settings.unstableMisses > 0;
+}
+
+// EEPROM.put only rewrites cells that changed
+void Settings::save() {
+    SettingsRecord record;
+    record.magic = SETTINGS_MAGIC;
+    record.settings = current;
+    record.checksum = recordChecksum(record);
+    EEPROM.put(SETTINGS_EEPROM_ADDRESS, record);
+}
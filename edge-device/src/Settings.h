@@ -0,0 +1,50 @@
+#ifndef __SETTINGS_H__
+    #define __SETTINGS_H__
+
+#include "config.h"
+
+// Parameters that can be tuned per device without reflashing
+struct RuntimeSettings {
+    uint16_t version;              // 0 = compiled-in defaults
+    uint16_t gpsUpdateInterval;    // ms; the NMEA fix rate when streaming
+    uint8_t mpuUpdateInterval;     // ms
+    uint32_t sendIntervals[3];     // ms, per stability state
+    uint8_t stableSuccesses;       // successes before a faster send interval
+    uint8_t unstableMisses;        // misses before a slower one
+};
+
+struct SettingsRecord {
+    uint16_t magic;
+    RuntimeSettings settings;
+    uint8_t checksum;
+};
+
+enum class SettingsResult : uint8_t {
+    APPLIED = 0,
+    UNCHANGED = 1,   // this version is already active
+    STALE = 2,       // older than the active version
+    INVALID = 3      // malformed or out of range, nothing changed
+};
+
+// Active runtime settings, read by every module like Logger is used. A new
+// set arrives on MQTT_CONFIG_TOPIC as a compact binary record; it is checked
+// as a whole, then swapped in and persisted to EEPROM in one step.
+//
+// Record (little-endian, 21 bytes):
+//   u8 format (1), u16 version, u16 gps interval, u8 mpu interval,
+//   3 x u32 send intervals, u8 stable successes, u8 unstable misses, u8 crc8
+class Settings {
+public:
+    static void load();
+    static const RuntimeSettings& get();
+    static SettingsResult apply(const uint8_t* payload, size_t length);
+
+private:
+    static bool decode(const uint8_t* payload, size_t length, RuntimeSettings& settings);
+    static bool isValid(const RuntimeSettings& settings);
+    static void save();
+
+    static RuntimeSettings current;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include "SmsPacker.h"
+#include "SoftwareClock.h"
+#include "utilities.h"
+
+static const uint8_t SMS_PACKED_VERSION = 2;
+static const uint8_t SMS_HEADER_BYTES = 19;
+static const uint8_t SMS_BATTERY_OFFSET = 17;
+static const char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void writeInt32(uint8_t* out, int32_t value) {
+    for (uint8_t i = 0; i < 4; i++) out[i] = (uint8_t)((uint32_t)value >> (8 * i));
+}
+
+// Fixed point in 1e-5 degree units
+static int32_t toDegreesE5(float degrees) {
+    return (int32_t)lround(degrees * 100000.0);
+}
+
+static uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+SmsPacker::SmsPacker() {
+    reset();
+}
+
+void SmsPacker::reset() {
+    length = 0;
+    count = 0;
+}
+
+uint8_t SmsPacker::getCount() const {
+    return count;
+}
+
+// Returns false, leaving the message untouched, if the fix does not fit. The
+// caller only hands over fixes taken with a synced clock.
+bool SmsPacker::add(const VehicleStatus& status, uint32_t sequence) {
+
+    uint32_t time = SoftwareClock::toEpochSeconds(status.time);
+    int32_t latitude = toDegreesE5(status.location.y);
+    int32_t longitude = toDegreesE5(status.location.x);
+
+    // Deltas are unsigned; a clock that stepped back or a restarted sequence starts a new message
+    if (count > 0 && (time < lastTime || sequence < lastSequence)) return false;
+
+    if (count == 0) {
+        buffer[0] = SMS_PACKED_VERSION;
+        writeInt32(buffer + 1, (int32_t)time);
+        writeInt32(buffer + 5, (int32_t)sequence);
+        writeInt32(buffer + 9, latitude);
+        writeInt32(buffer + 13, longitude);
+        length = SMS_HEADER_BYTES;
+        lastTime = time;
+        lastSequence = sequence;
+        lastLatitude = latitude;
+        lastLongitude = longitude;
+    }
+
+    float speed = sqrt(
+        status.velocity.x * status.velocity.x +
+        status.velocity.y * status.velocity.y +
+        status.velocity.z * status.velocity.z);
+    uint8_t speedByte = (uint8_t)min(speed * 2.0f + 0.5f, 127.0f);
+    if (status.isLocationDeadReckoned) speedByte |= 0x80;
+
+    uint8_t rollback = length;
+    bool fits = appendVarint(time - lastTime) &&
+        appendVarint(sequence - lastSequence) &&
+        appendVarint(zigzag(latitude - lastLatitude)) &&
+        appendVarint(zigzag(longitude - lastLongitude)) &&
+        length + 2 <= SMS_PACKED_MAX_BYTES; // speed byte + checksum
+
+    if (!fits) {
+        length = rollback;
+        if (count == 0) length = 0;
+        return false;
+    }
+
+    buffer[length++] = speedByte;
+    buffer[SMS_BATTERY_OFFSET] = (uint8_t)status.batteryStatus;
+    buffer[SMS_BATTERY_OFFSET + 1] = (uint8_t)status.signalStrength;
+
+    lastTime = time;
+    lastSequence = sequence;
+    lastLatitude = latitude;
+    lastLongitude = longitude;
+    count++;
+    return true;
+}
+
+bool SmsPacker::appendVarint(uint32_t value) {
+    do {
+        if (length >= SMS_PACKED_MAX_BYTES) return false;
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        buffer[length++] = value ? byte | 0x80 : byte;
+    } while (value);
+    return true;
+}
+
+// Appends the checksum and writes the base64 text (NUL terminated)
+bool SmsPacker::encode(char* sms, size_t smsSize) {
+
+    if (count == 0) return false;
+
+    uint8_t total = length;
+    buffer[total] = crc8(buffer, total);
+    total++;
+
+    if (((total + 2) / 3) * 4 + 1 > smsSize) return false;
+
+    size_t out = 0;
+    for (uint8_t i = 0; i < total; i += 3) {
+        uint32_t chunk = (uint32_t)buffer[i] << 16;
+        if (i + 1 < total) chunk |= (uint32_t)buffer[i + 1] << 8;
+        if (i + 2 < total) chunk |= buffer[i + 2];
+
+        sms[out++] = BASE64_ALPHABET[(chunk >> 18) & 0x3F];
+        sms[out++] = BASE64_ALPHABET[(chunk >> 12) & 0x3F];
+        sms[out++] = i + 1 < total ? BASE64_ALPHABET[(chunk >> 6) & 0x3F] : '=';
+        sms[out++] = i + 2 < total ? BASE64_ALPHABET[chunk & 0x3F] : '=';
+    }
+    sms[out] = '\0';
+    return true;
+}
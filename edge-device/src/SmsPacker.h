@@ -0,0 +1,44 @@
+#ifndef __SMS_PACKER_H__
+    #define __SMS_PACKER_H__
+
+#include "config.h"
+#include "dataStructures.h"
+
+// Packs several fixes into one 160-character SMS for the offline fallback.
+//
+// Binary layout (little-endian), base64 encoded so it survives the GSM 7-bit
+// alphabet:
+//   version     u8
+//   time        u32   seconds since 2000-01-01, device local time, never 0
+//   sequence    u32   message sequence number of the first fix, as on MQTT
+//   latitude    i32   1e-5 degrees
+//   longitude   i32   1e-5 degrees
+//   battery     i8    of the latest fix
+//   signal      i8    of the latest fix
+//   fixes       n x { dt varint (s, never negative), dseq varint, dlat zigzag varint,
+//                     dlon zigzag varint, u8 speed (0.5 m/s, bit 7 = dead reckoned) }
+//   checksum    u8    CRC-8 of everything before it
+// Deltas are against the previous fix; the first fix has all deltas zero.
+// Fixes are only packed with a synced clock, and a fix carries the sequence
+// number its MQTT copy would have, so the server stores both under one id.
+class SmsPacker {
+public:
+    SmsPacker();
+    void reset();
+    bool add(const VehicleStatus& status, uint32_t sequence);   // false: does not fit, send the batch first
+    uint8_t getCount() const;
+    bool encode(char* sms, size_t smsSize);
+
+private:
+    bool appendVarint(uint32_t value);
+
+    uint8_t buffer[SMS_PACKED_MAX_BYTES];
+    uint8_t length;
+    uint8_t count;
+    uint32_t lastTime;
+    uint32_t lastSequence;
+    int32_t lastLatitude;
+    int32_t lastLongitude;
+};
+
+#endif
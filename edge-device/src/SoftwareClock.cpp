@@ -0,0 +1,136 @@
+#include "SoftwareClock.h"
+#include "utilities.h"
+
+// Epoch is 2000-01-01 00:00:00 UTC; days counted with Howard Hinnant's
+// civil calendar algorithms (all longs, int is 16 bit on AVR)
+static const long DAYS_FROM_1970_TO_2000 = 10957L;
+
+static long daysFromCivil(long y, long m, long d) {
+    y -= m <= 2;
+    long era = y / 400;
+    long yoe = y - era * 400;
+    long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097L + doe - 719468L;
+}
+
+SoftwareClock::SoftwareClock()
+    :   anchorEpochMillis(0),
+        anchorMillis(0),
+        lastGnssSync(0),
+        driftPpm(0.0f),
+        utcOffset(CLOCK_DEFAULT_UTC_OFFSET),
+        source(ClockSource::NONE),
+        hasGap(false) {}
+
+void SoftwareClock::sync(const Datetime& utc, unsigned long atMillis, ClockSource newSource) {
+
+    if (utc.year < 2000 || utc.month == 0 || utc.day == 0) return;
+
+    uint64_t actual = (uint64_t)toEpochSeconds(utc) * 1000 + utc.millisecond;
+
+    if (newSource == ClockSource::GNSS && source == ClockSource::GNSS && !hasGap) {
+        unsigned long elapsed = atMillis - lastGnssSync;
+        if (elapsed >= CLOCK_DRIFT_MIN_INTERVAL) {
+            float error = (float)(int64_t)(actual - getEpochMillis(atMillis));
+            float observed = driftPpm + error * 1e6f / elapsed;
+            // No oscillator is that far off; the fix was stamped late, not the clock
+            if (fabs(observed) <= CLOCK_MAX_DRIFT_PPM) {
+                driftPpm += CLOCK_DRIFT_GAIN * (observed - driftPpm);
+            }
+            Logger::debug("clock resync: error %ld ms, drift %ld ppm", (long)error, (long)driftPpm);
+        }
+    }
+
+    if (newSource == ClockSource::GNSS) lastGnssSync = atMillis;
+
+    anchorEpochMillis = actual;
+    anchorMillis = atMillis;
+    source = newSource;
+    hasGap = false;
+}
+
+// Network time is local time; the modem also reports the zone it is in
+void SoftwareClock::syncLocal(const Datetime& local, int32_t offset, unsigned long atMillis) {
+
+    if (local.year < 2000 || local.month == 0 || local.day == 0) return;
+
+    utcOffset = offset;
+    Datetime utc = fromEpochSeconds(toEpochSeconds(local) - offset);
+    utc.millisecond = local.millisecond;
+    sync(utc, atMillis, ClockSource::NETWORK);
+}
+
+// millis() skipped time it could only estimate, e.g. a power-down timed by the
+// watchdog. The clock keeps running on the estimate until the next sync, which
+// does not update the drift: the error across the gap is not oscillator drift.
+void SoftwareClock::markGap() {
+    hasGap = true;
+}
+
+// A drift-corrected GNSS anchor is trusted much longer than a network one
+bool SoftwareClock::needsSync(unsigned long now) const {
+    if (source == ClockSource::NONE || hasGap) return true;
+    return getSyncAge(now) >= (source == ClockSource::GNSS ? CLOCK_GNSS_HOLDOVER : CLOCK_RESYNC_INTERVAL);
+}
+
+unsigned long SoftwareClock::getSyncAge(unsigned long now) const {
+    return now - anchorMillis;
+}
+
+bool SoftwareClock::isSynced() const {
+    return source != ClockSource::NONE;
+}
+
+ClockSource SoftwareClock::getSource() const {
+    return source;
+}
+
+float SoftwareClock::getDriftPpm() const {
+    return driftPpm;
+}
+
+void SoftwareClock::setUtcOffset(int32_t seconds) {
+    utcOffset = seconds;
+}
+
+uint64_t SoftwareClock::getEpochMillis(unsigned long now) const {
+    unsigned long elapsed = now - anchorMillis;
+    long correction = (long)(elapsed * (driftPpm / 1e6f));
+    return anchorEpochMillis + elapsed + correction;
+}
+
+Datetime SoftwareClock::getLocalTime(unsigned long now) const {
+    uint64_t local = getEpochMillis(now) + (int64_t)utcOffset * 1000;
+    Datetime dt = fromEpochSeconds((uint32_t)(local / 1000));
+    dt.millisecond = local % 1000;
+    return dt;
+}
+
+uint32_t SoftwareClock::toEpochSeconds(const Datetime& dt) {
+    long days = daysFromCivil(dt.year, dt.month, dt.day) - DAYS_FROM_1970_TO_2000;
+    return (uint32_t)days * 86400UL + dt.hour * 3600UL + dt.minute * 60UL + dt.second;
+}
+
+Datetime SoftwareClock::fromEpochSeconds(uint32_t seconds) {
+
+    long z = seconds / 86400UL + DAYS_FROM_1970_TO_2000 + 719468L;
+    uint32_t secondOfDay = seconds % 86400UL;
+
+    long era = z / 146097L;
+    long doe = z - era * 146097L;
+    long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long mp = (5 * doy + 2) / 153;
+    long month = mp < 10 ? mp + 3 : mp - 9;
+
+    Datetime dt;
+    dt.second = secondOfDay % 60;
+    dt.minute = (secondOfDay / 60) % 60;
+    dt.hour = secondOfDay / 3600;
+    dt.day = doy - (153 * mp + 2) / 5 + 1;
+    dt.month = month;
+    dt.year = yoe + era * 400 + (month <= 2);
+    dt.millisecond = 0;
+    return dt;
+}
@@ -0,0 +1,46 @@
+#ifndef __SOFTWARE_CLOCK_H__
+    #define __SOFTWARE_CLOCK_H__
+
+#include "config.h"
+#include "dataStructures.h"
+
+enum class ClockSource : uint8_t {
+    NONE = 0,
+    NETWORK = 1,  // AT+CCLK?, one second resolution
+    GNSS = 2      // UTC of a GNSS fix, millisecond resolution
+};
+
+// UTC clock anchored to an external time source and advanced by millis().
+// GNSS resyncs also estimate the drift of the MCU oscillator, which is then
+// applied between resyncs.
+class SoftwareClock {
+public:
+    SoftwareClock();
+    void sync(const Datetime& utc, unsigned long atMillis, ClockSource source);
+    void syncLocal(const Datetime& local, int32_t offset, unsigned long atMillis);
+    void markGap();
+    bool needsSync(unsigned long now) const;
+    unsigned long getSyncAge(unsigned long now) const;
+    bool isSynced() const;
+    ClockSource getSource() const;
+    float getDriftPpm() const;
+
+    uint64_t getEpochMillis(unsigned long now) const;
+    Datetime getLocalTime(unsigned long now) const;
+
+    void setUtcOffset(int32_t seconds);
+
+    static uint32_t toEpochSeconds(const Datetime& dt);
+    static Datetime fromEpochSeconds(uint32_t seconds);
+
+private:
+    uint64_t anchorEpochMillis;
+    unsigned long anchorMillis;
+    unsigned long lastGnssSync;
+    float driftPpm;
+    int32_t utcOffset;
+    ClockSource source;
+    bool hasGap;              // millis() was advanced by an estimate since the last sync
+};
+
+#endif
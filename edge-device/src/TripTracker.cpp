@@ -0,0 +1,139 @@
+#include "TripTracker.h"
+#include "utilities.h"
+
+TripTracker::TripTracker()
+    :   state(TripState::IDLE),
+        current(),
+        stateSince(0),
+        lastUpdate(0),
+        movingTime(0.0f),
+        isHarshAccelerating(false),
+        isHarshBraking(false),
+        isHarshCornering(false) {}
+
+// Called once per IMU sample. speed is in m/s, heading in degrees from north
+// and acceleration in the east/north/up frame.
+void TripTracker::update(unsigned long now, const SoftwareClock& clock, bool isMoving, float speed, float heading,
+                         const Vector& acceleration, float latitude, float longitude) {
+
+    float dt = lastUpdate ? (now - lastUpdate) / 1000.0f : 0.0f;
+    lastUpdate = now;
+
+    switch (state) {
+        case TripState::IDLE:
+            if (isMoving) begin(now, toEpoch(clock, now), latitude, longitude);
+            return;
+
+        case TripState::STARTING:
+            if (!isMoving) {
+                state = TripState::IDLE;
+                return;
+            }
+            if (now - stateSince >= TRIP_START_TIME) {
+                state = TripState::ACTIVE;
+                Logger::info("trip started");
+            }
+            break;
+
+        case TripState::ACTIVE:
+            if (!isMoving) {
+                // Where and when the vehicle stopped, unless it moves on again
+                state = TripState::STOPPING;
+                stateSince = now;
+                current.endTime = toEpoch(clock, now);
+                current.endLatitude = latitude;
+                current.endLongitude = longitude;
+            }
+            break;
+
+        case TripState::STOPPING:
+            if (isMoving) {
+                state = TripState::ACTIVE;
+            } else if (now - stateSince >= TRIP_STOP_TIME) {
+                finish();
+                return;
+            }
+            break;
+    }
+
+    accumulate(dt, isMoving, speed, heading, acceleration);
+}
+
+bool TripTracker::isActive() const {
+    return state == TripState::ACTIVE || state == TripState::STOPPING;
+}
+
+bool TripTracker::peekSummary(TripSummary& summary) const {
+    return finished.peek(summary);
+}
+
+void TripTracker::popSummary() {
+    TripSummary summary;
+    finished.pop(summary);
+}
+
+// The clock is only read on state changes; its 64-bit math is too slow for every sample
+uint32_t TripTracker::toEpoch(const SoftwareClock& clock, unsigned long now) {
+    return clock.isSynced() ? (uint32_t)(clock.getEpochMillis(now) / 1000) : 0;
+}
+
+void TripTracker::begin(unsigned long now, uint32_t epoch, float latitude, float longitude) {
+
+    current = TripSummary();
+    current.startTime = epoch;
+    current.startLatitude = latitude;
+    current.startLongitude = longitude;
+    movingTime = 0.0f;
+    isHarshAccelerating = isHarshBraking = isHarshCornering = false;
+
+    state = TripState::STARTING;
+    stateSince = now;
+}
+
+void TripTracker::accumulate(float dt, bool isMoving, float speed, float heading, const Vector& acceleration) {
+
+    if (isMoving) {
+        current.distance += speed * dt;
+        movingTime += dt;
+    }
+    if (speed > current.maxSpeed) current.maxSpeed = speed;
+
+    // Split the horizontal acceleration along and across the direction of travel
+    float headingRad = radians(heading);
+    float forwardX = sin(headingRad), forwardY = cos(headingRad);
+    float longitudinal = acceleration.x * forwardX + acceleration.y * forwardY;
+    float lateral = fabs(acceleration.x * forwardY - acceleration.y * forwardX);
+
+    // Each event counts once; it re-arms when the acceleration has clearly dropped
+    if (!isHarshAccelerating && longitudinal > HARSH_ACCELERATION) {
+        isHarshAccelerating = true;
+        current.harshAccelerations++;
+    } else if (longitudinal < HARSH_ACCELERATION * HARSH_REARM_RATIO) {
+        isHarshAccelerating = false;
+    }
+
+    if (!isHarshBraking && -longitudinal > HARSH_BRAKING) {
+        isHarshBraking = true;
+        current.harshBrakings++;
+    } else if (-longitudinal < HARSH_BRAKING * HARSH_REARM_RATIO) {
+        isHarshBraking = false;
+    }
+
+    if (!isHarshCornering && lateral > HARSH_CORNERING) {
+        isHarshCornering = true;
+        current.harshCornerings++;
+    } else if (lateral < HARSH_CORNERING * HARSH_REARM_RATIO) {
+        isHarshCornering = false;
+    }
+}
+
+void TripTracker::finish() {
+
+    current.movingTime = (uint32_t)movingTime;
+    state = TripState::IDLE;
+
+    Logger::info("trip ended: %lu m in %lu s moving", (unsigned long)current.distance, current.movingTime);
+    if (!finished.push(current)) {
+        Logger::warn("trip queue full, summary dropped");
+    }
+}
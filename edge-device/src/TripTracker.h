@@ -0,0 +1,45 @@
+#ifndef __TRIP_TRACKER_H__
+    #define __TRIP_TRACKER_H__
+
+#include "config.h"
+#include "dataStructures.h"
+#include "RingBuffer.h"
+#include "SoftwareClock.h"
+
+enum class TripState : uint8_t {
+    IDLE,
+    STARTING,   // moving, not yet for TRIP_START_TIME
+    ACTIVE,
+    STOPPING    // still, not yet for TRIP_STOP_TIME
+};
+
+// Splits the drive into trips on motion start and stop and accumulates their
+// statistics in constant memory. Finished trips wait in a small queue until
+// the uplink takes them.
+class TripTracker {
+public:
+    TripTracker();
+    void update(unsigned long now, const SoftwareClock& clock, bool isMoving, float speed, float heading,
+                const Vector& acceleration, float latitude, float longitude);
+    bool isActive() const;
+    bool peekSummary(TripSummary& summary) const;
+    void popSummary();
+
+private:
+    void begin(unsigned long now, uint32_t epoch, float latitude, float longitude);
+    static uint32_t toEpoch(const SoftwareClock& clock, unsigned long now);
+    void accumulate(float dt, bool isMoving, float speed, float heading, const Vector& acceleration);
+    void finish();
+
+    TripState state;
+    TripSummary current;
+    unsigned long stateSince;
+    unsigned long lastUpdate;
+    float movingTime;
+    bool isHarshAccelerating;
+    bool isHarshBraking;
+    bool isHarshCornering;
+    RingBuffer<TripSummary, TRIP_QUEUE_SIZE> finished;
+};
+
+#endif
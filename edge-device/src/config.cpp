@@ -9,7 +9,13 @@ const char* const GPRS_PASS  = "";
 // MQTT Configuration
 const char* const MQTT_SERVER    = "broker.hivemq.com"; //"test.mosquitto.org";
 const uint16_t MQTT_PORT         = 1883;
-const char* const MQTT_TOPIC     = "ut-cps/vehicle-monitoring";
 const char* const MQTT_CLIENT_ID = "vt";
+// Per device: all end with MQTT_CLIENT_ID, which the server takes as the vehicle id
+const char* const MQTT_TOPIC     = "ut-cps/vehicle-monitoring/vt";
+const char* const MQTT_HEALTH_TOPIC = "ut-cps/vehicle-monitoring/health/vt";
+const char* const MQTT_TRIP_TOPIC = "ut-cps/vehicle-monitoring/trip/vt";
+const char* const MQTT_BLACKBOX_TOPIC = "ut-cps/vehicle-monitoring/blackbox/vt";
+const char* const MQTT_CONFIG_TOPIC = "ut-cps/vehicle-monitoring/config/vt";
+const char* const MQTT_CONFIG_ACK_TOPIC = "ut-cps/vehicle-monitoring/config-ack/vt";
 
 const char* const EMERGENCY_PHONE_NUMBER = "+989210391148";
@@ -13,11 +13,27 @@
 #define LOG_LEVEL_WARN  1
 #define LOG_LEVEL_NONE  0
 
+#ifndef LOG_LEVEL
 #define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
 
 #define LOG_BUFFER_SIZE 256
 #define LOG_SERIAL_BUS_FREQUENCY 9600
 
+// Build profile: which optional paths are compiled in. Each can be overridden
+// from build_flags; platformio.ini has one environment per supported profile.
+#define FALLBACK_NONE       0   // no channel besides MQTT
+#define FALLBACK_SMS        1   // one readable SMS per fix
+#define FALLBACK_SMS_PACKED 2   // several fixes per SMS, see SmsPacker
+
+#ifndef FALLBACK_CHANNEL
+#define FALLBACK_CHANNEL FALLBACK_SMS_PACKED
+#endif
+
+#ifndef BLACKBOX_ENABLED
+#define BLACKBOX_ENABLED 1      // IMU capture around shocks, see BlackBox
+#endif
+
 // GPRS and Mqtt Configuration
 extern const char* const APN;
 extern const char* const GPRS_USER;
@@ -27,6 +43,11 @@ extern const char* const MQTT_SERVER;
 extern const uint16_t MQTT_PORT;
 extern const char* const MQTT_TOPIC;
 extern const char* const MQTT_CLIENT_ID;
+extern const char* const MQTT_HEALTH_TOPIC;
+extern const char* const MQTT_TRIP_TOPIC;
+extern const char* const MQTT_BLACKBOX_TOPIC;
+extern const char* const MQTT_CONFIG_TOPIC;
+extern const char* const MQTT_CONFIG_ACK_TOPIC;
 
 extern const char* const EMERGENCY_PHONE_NUMBER;
 
@@ -34,20 +55,139 @@ extern const char* const EMERGENCY_PHONE_NUMBER;
 constexpr int SIM808_RX_PIN = 13;
 constexpr int SIM808_TX_PIN = 12;
 constexpr unsigned long SIM808_BAUD_RATE = 9600;
+constexpr unsigned long SIM808_RESPONSE_TIMEOUT = 5000;
 
 // Timing Periods (in milliseconds)
+// GPS and MPU intervals, send intervals and stability thresholds are defaults;
+// the values in use come from Settings and can be changed over MQTT
 constexpr unsigned long GPS_UPDATE_INTERVAL = 1000;
 constexpr unsigned long MPU_UPDATE_INTERVAL = 20;
 constexpr unsigned long MODEM_UPDATE_INTERVAL = 500;
+constexpr unsigned long GPS_SETUP_RETRY_INTERVAL = 2000;
+
+// GNSS streaming: unsolicited RMC/GGA output instead of polling AT+CGNSINF
+constexpr bool GPS_NMEA_STREAMING = true;
+// Byte budget: one fix is an RMC and a GGA sentence, about 145 B. The modem
+// link is SoftwareSerial at SIM808_BAUD_RATE (9600 baud 8N1 = 960 B/s), half
+// duplex, its receive interrupt holds the CPU for every byte, and AT, GPRS
+// and MQTT traffic share it. 1 Hz takes ~15% of the link; 5 Hz, the SIM808
+// maximum, would take ~75% and starve the uplink. The stream runs at the GPS
+// interval setting, limited to this range (PMTK220 accepts up to 10 s).
+constexpr unsigned int GPS_STREAM_MIN_FIX_INTERVAL = 1000;
+constexpr unsigned int GPS_STREAM_MAX_FIX_INTERVAL = 10000;
+constexpr uint8_t GPS_STREAM_MISSED_FIXES = 3;           // intervals without a valid RMC = fix lost
+constexpr size_t NMEA_BUFFER_SIZE = 192;
+constexpr uint8_t NMEA_LINE_TIMES = 4;                 // arrival times of the sentences waiting in the buffer
+constexpr uint8_t NMEA_MAX_SENTENCE_LENGTH = 82;
+
+// Software clock
+constexpr unsigned long CLOCK_RESYNC_INTERVAL = 600000;
+constexpr unsigned long CLOCK_GNSS_HOLDOVER = 3600000;
+constexpr unsigned long CLOCK_DRIFT_MIN_INTERVAL = 60000;
+constexpr float CLOCK_DRIFT_GAIN = 0.25f;
+constexpr float CLOCK_MAX_DRIFT_PPM = 5000.0f;
+constexpr int32_t CLOCK_DEFAULT_UTC_OFFSET = 12600; // seconds, Asia/Tehran
 
 // Mpu consts
 constexpr float GRAVITY_ACCELERATION = 9.80665f;
+constexpr uint8_t MPU_I2C_ADDRESS = 0x68;
+constexpr uint8_t MPU_INTERRUPT_PIN = 19;   // INT2, edge detection works in power-down
+constexpr uint8_t MPU_WAKE_THRESHOLD = 20;  // wake-on-motion threshold, 4 mg per LSB
+
+constexpr float MAGNETIC_DECLINATION = 4.73f; // degrees, adjust as needed
+
+// Orientation filter
+constexpr float AHRS_BETA = 0.1f;
+
+// Mpu calibration persistence
+constexpr int IMU_CALIBRATION_EEPROM_ADDRESS = 0;
+constexpr uint16_t IMU_CALIBRATION_MAGIC = 0xCA1B;
+constexpr uint8_t IMU_CALIBRATION_VERSION = 2;
+constexpr float IMU_CALIBRATION_MAX_TEMPERATURE_DRIFT = 10.0f; // °C
+constexpr unsigned long IMU_FAST_BOOT_WARMUP = 2000;
+constexpr unsigned long IMU_CALIBRATION_SETTLE_TIME = 30000;
+constexpr unsigned long IMU_CALIBRATION_SAMPLE_TIME = 15000;
+constexpr unsigned long IMU_CALIBRATION_SAVE_INTERVAL = 3600000;
+
+// Message sequence numbers
+constexpr int SEQUENCE_EEPROM_ADDRESS = 128;           // after the IMU calibration record
+constexpr uint16_t SEQUENCE_MAGIC = 0x5E91;
+constexpr uint32_t SEQUENCE_BLOCK_SIZE = 256;          // numbers reserved per EEPROM write
+
+// Runtime settings persistence
+constexpr int SETTINGS_EEPROM_ADDRESS = 160;           // after the message sequence record
+constexpr uint16_t SETTINGS_MAGIC = 0x5E77;
+
+// Rest detection and online bias tracking while at rest
+constexpr unsigned long IMU_REST_SAMPLES = 150;       // quiet samples in a row that count as rest
+constexpr float IMU_REST_MAX_ANGULAR_VELOCITY = 1.0f; // deg/s
+constexpr float IMU_REST_MAX_ACCEL_VARIANCE = 1e-4f;  // g^2, accel magnitude; engine vibration alone exceeds it
+constexpr float IMU_REST_VARIANCE_WEIGHT = 0.05f;     // EWMA weight of the variance window, ~20 samples
+constexpr float IMU_BIAS_TRACKING_RATE = 0.005f;
+constexpr float IMU_BIAS_TRACKING_MAX_SPEED = 0.2f;   // m/s, GNSS speed that counts as standing
+
+// Trip segmentation: motion start and stop (no ignition line on the board)
+constexpr unsigned long TRIP_START_TIME = 10000;       // moving this long starts a trip
+constexpr unsigned long TRIP_STOP_TIME = 180000;       // still this long ends it
+constexpr float TRIP_MOVING_SPEED = 1.5f;              // m/s, GNSS speed that counts as moving
+constexpr float HARSH_ACCELERATION = 3.0f;             // m/s^2, longitudinal
+constexpr float HARSH_BRAKING = 3.5f;                  // m/s^2, longitudinal
+constexpr float HARSH_CORNERING = 4.0f;                // m/s^2, lateral
+constexpr float HARSH_REARM_RATIO = 0.7f;              // an event ends below this share of its threshold
+constexpr size_t TRIP_QUEUE_SIZE = 3;                  // finished trips waiting for the uplink
+
+// IMU black box: raw samples around a shock, uploaded in chunks while the link is idle
+constexpr uint16_t BLACKBOX_SAMPLES = 80;              // ring of 12-byte samples, 1.6 s at 50 Hz
+constexpr uint16_t BLACKBOX_POST_SAMPLES = 30;         // kept after the trigger; the rest precede it
+constexpr float BLACKBOX_TRIGGER_SHOCK = 1.5f;         // g, deviation of |a| from 1 g
+constexpr uint8_t BLACKBOX_CHUNK_SAMPLES = 25;         // per MQTT message
+constexpr unsigned long BLACKBOX_UPLOAD_GUARD = 2000;  // ms, no chunk this close to a status report
+constexpr float BLACKBOX_ACCEL_SCALE = 4096.0f;        // LSB per g, +-8 g
+constexpr float BLACKBOX_GYRO_SCALE = 16.0f;           // LSB per deg/s, +-2048 deg/s
 
 // MQTT Transmission Settings
 constexpr unsigned long MQTT_SEND_INTERVALS[3] = {30000, 150000, 300000};
 constexpr bool MQTT_ENABLE_SMS[3] = {false, false, true};
-constexpr int MQTT_WORST_STABILITY_STATUS = 3;
-constexpr unsigned long MQTT_RECONNECTION_INTERVAL = 5000;
-constexpr unsigned long NETWORK_RECONNECTION_INTERVAL = 30000;
+constexpr int MQTT_WORST_STABILITY_STATUS = 2;          // last index of MQTT_SEND_INTERVALS
+constexpr uint8_t MQTT_STABLE_SUCCESSES = 20;          // successes before a faster send interval
+constexpr uint8_t MQTT_UNSTABLE_MISSES = 3;            // misses before a slower one
+
+constexpr uint16_t MQTT_KEEPALIVE = 120;                // s, deep sleep wakes at half of it
+constexpr uint16_t MQTT_BUFFER_SIZE = 448;
+constexpr unsigned long HEALTH_REPORT_INTERVAL = 600000;
+constexpr size_t STACK_HEADROOM_WARN = 256;             // bytes left above the heap at the deepest stack use
+
+// SMS fallback (FALLBACK_SMS_PACKED)
+constexpr uint8_t SMS_PACKED_MAX_BYTES = 120;          // 160 base64 characters
+constexpr uint8_t SMS_BATCH_FIXES = 12;               // a partial batch goes out after this many report intervals
+constexpr unsigned long SMS_RETRY_INTERVAL = 60000;    // after a failed send
+
+// Connection Manager Settings
+constexpr unsigned long CONNECTION_BACKOFF_MIN = 1000;
+constexpr unsigned long CONNECTION_BACKOFF_MAX = 120000;
+constexpr uint8_t CONNECTION_MAX_STEP_FAILURES = 5;
+constexpr unsigned long MODEM_PROBE_TIMEOUT = 300;
+constexpr unsigned long NETWORK_POLL_INTERVAL = 1000;
+constexpr unsigned long NETWORK_ATTACH_TIMEOUT = 60000;
+// Slow modem operations are issued without waiting and their outcome polled,
+// so no single update blocks for longer than one short AT exchange
+constexpr unsigned long MODEM_COMMAND_TIMEOUT = 1000;   // ms, one AT command and its answer
+constexpr unsigned long MODEM_POLL_INTERVAL = 1000;
+constexpr unsigned long MODEM_LATE_RESPONSE_TIMEOUT = 50; // ms, per check for the late answer of CGATT=1/CIICR
+constexpr unsigned long GPRS_ATTACH_TIMEOUT = 60000;    // CGATT
+constexpr unsigned long GPRS_ACTIVATE_TIMEOUT = 85000;  // CIICR
+constexpr unsigned long MQTT_TCP_CONNECT_TIMEOUT = 75000;
+constexpr uint16_t MQTT_CONNACK_TIMEOUT = 3;            // s, PubSubClient waits this long in connect()
+
+// Power management
+constexpr unsigned long IDLE_POWER_DOWN_MIN = 5000;  // shorter gaps only use idle sleep
+constexpr unsigned long MODEM_WAKE_DELAY = 100;      // SIM808 needs this after the wake-up character
+
+// Typical draw per mode (mA) for the health report estimate
+constexpr unsigned int POWER_CURRENT_ACTIVE = 55;
+constexpr unsigned int POWER_CURRENT_IDLE = 35;
+constexpr unsigned int POWER_CURRENT_POWER_DOWN = 15;
+constexpr unsigned int POWER_CURRENT_MODEM_AWAKE = 80;
+constexpr unsigned int POWER_CURRENT_MODEM_SLEEP = 25;
 
 #endif 
@@ -16,6 +16,7 @@ struct Datetime {
     uint8_t day;          // 1–31
     uint8_t month;        // 1–12
     int16_t year;         // e.g., 2025
+    uint16_t millisecond; // 0–999
 };
 
 struct GpsData {
@@ -26,6 +27,7 @@ struct GpsData {
     float heading;        // Degrees
     unsigned long measureTime; // millis()
     uint8_t satellites;   // Number of satellites for validity check
+    Datetime utcTime;     // GNSS UTC of the fix, year 0 if not reported
 };
 
 struct VehicleStatus {
@@ -41,4 +43,19 @@ struct VehicleStatus {
     int8_t batteryStatus;    // Percentage (0–100) or negative value means adapter power supply
 };
 
+struct TripSummary {
+    uint32_t startTime;      // s since 2000-01-01 UTC, 0 if the clock was not set
+    uint32_t endTime;
+    float startLatitude;
+    float startLongitude;
+    float endLatitude;
+    float endLongitude;
+    float distance;          // m
+    uint32_t movingTime;     // s
+    float maxSpeed;          // m/s
+    uint16_t harshAccelerations;
+    uint16_t harshBrakings;
+    uint16_t harshCornerings;
+};
+
 #endif
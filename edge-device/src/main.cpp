@@ -1,20 +1,30 @@
 #include <Arduino.h>
+#include <SoftwareSerial.h>
 #include "SensorManager.h"
 #include "MqttClient.h"
+#include "IdleManager.h"
 #include "utilities.h"
+#include "Settings.h"
 
 // Example usage
 SoftwareSerial sim808Serial(SIM808_RX_PIN, SIM808_TX_PIN);
-SensorManager sensorManager(sim808Serial);
-MqttClient mqttClient(sensorManager, sim808Serial);
+ModemStream modemStream(sim808Serial);
+SensorManager sensorManager(modemStream);
+MqttClient mqttClient(sensorManager, modemStream);
+IdleManager idleManager(sensorManager, mqttClient, modemStream);
 
 
 void setup() {
     Logger::setup();    
     Logger::info("setup started");
     sim808Serial.begin(SIM808_BAUD_RATE);
-    mqttClient.setup();
+    // Stored settings apply from the first sample on
+    Settings::load();
+    // Both only start their bring-up; modem attach, GNSS power-up and IMU
+    // calibration then progress side by side from loop()
     sensorManager.setup();
+    mqttClient.setup();
+    idleManager.setup();
     Logger::info("setup finished");
 }
 
@@ -26,4 +36,6 @@ void loop() {
 
     mqttClient.update(now);
 
+    idleManager.update(millis());
+
 }
\ No newline at end of file
@@ -2,7 +2,9 @@
 #include <Arduino.h>
 #include <stdarg.h>
 
+#if LOG_LEVEL > LOG_LEVEL_NONE
 static char logBuffer[LOG_BUFFER_SIZE];
+#endif
 
 void Logger::setup(){
     #if LOG_LEVEL > LOG_LEVEL_NONE
@@ -72,4 +74,13 @@ void Logger::printTimestamp() {
     Serial.print('[');
     Serial.print(millis());
     Serial.print(" ms] ");
-}
\ No newline at end of file
+}
+uint8_t crc8(const uint8_t* data, size_t length) {
+    uint8_t crc = 0;
+    while (length--) {
+        crc ^= *data++;
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
@@ -15,4 +15,7 @@ private:
     static void printTimestamp();
 };
 
+// CRC-8, polynomial 0x07
+uint8_t crc8(const uint8_t* data, size_t length);
+
 #endif
\ No newline at end of file
@@ -10,7 +10,7 @@ import binascii
 # MQTT Configuration
 MQTT_SERVER = "broker.hivemq.com"
 MQTT_PORT = 1883
-MQTT_TOPIC = "ut-cps/vehicle-monitoring"
+MQTT_TOPIC = "ut-cps/vehicle-monitoring/+"  # <prefix>/<device client id>
 MQTT_CLIENT_ID = "python_vehicle_listener"
 
 
@@ -50,7 +50,13 @@ def on_message(client, userdata, msg):
 
     try:
         # Deserialize binary data (little-endian)
-        data = struct.unpack("<BBBBBH3f3f3f3f3fBIBb", msg.payload)
+        # 74-byte legacy record, 76 bytes with the trailing millisecond field,
+        # 80 bytes with the sequence number after it
+        payload_format = {
+            76: "<BBBBBH3f3f3f3f3fBIBbH",
+            80: "<BBBBBH3f3f3f3f3fBIBbHI",
+        }.get(payload_len, "<BBBBBH3f3f3f3f3fBIBb")
+        data = struct.unpack(payload_format, msg.payload)
 
         # Validate fields
         if not (0 <= data[0] <= 59 and 0 <= data[1] <= 59 and 0 <= data[2] <= 23 and
@@ -69,7 +75,8 @@ def on_message(client, userdata, msg):
                 hour=data[2],
                 day=data[3],
                 month=data[4],
-                year=data[5]
+                year=data[5],
+                microsecond=(data[25] if len(data) > 25 else 0) * 1000
             ),
             acceleration=Vector(x=data[6], y=data[7], z=data[8]),
             velocity=Vector(x=data[9], y=data[10], z=data[11]),
@@ -81,6 +88,8 @@ def on_message(client, userdata, msg):
             signal_strength=data[23],
             battery_status=data[24]
         )
+        if len(data) > 26:
+            print(f"Sequence: {data[26]}")
 
 
     except struct.error as e:
@@ -0,0 +1,88 @@
+"""Append-only archive of raw status payloads, for reprocessing history.
+
+Every payload received on the status topics is appended as it arrived, before
+any decoding, with the vehicle id taken from its topic, to one file per UTC day:
+
+    <archive dir>/status-YYYY-MM-DD.bin
+
+Record (little-endian): f64 arrival (s, epoch), u8 vehicle id length,
+u16 payload length, vehicle id (UTF-8), payload.
+A record cut short by a crash can only be the last one in a file: the
+service cuts it off before it appends to the file again, and a write that
+fails is undone, so a reader that stops at a short record has read
+everything.
+"""
+import struct
+import threading
+from datetime import datetime, timezone
+from pathlib import Path
+from typing import BinaryIO, Iterator
+
+RECORD_HEADER = struct.Struct("<dBH")
+
+
+def encode_record(arrival: float, vehicle: str, payload: bytes) -> bytes:
+    vehicle_id = vehicle.encode()
+    return RECORD_HEADER.pack(arrival, len(vehicle_id), len(payload)) + vehicle_id + payload
+
+
+class RawArchive:
+    def __init__(self, directory: str):
+        self.directory = Path(directory)
+        self.directory.mkdir(parents=True, exist_ok=True)
+        self.lock = threading.Lock()
+        self.file: BinaryIO | None = None
+        self.day = ""
+
+    def append(self, arrival: datetime, vehicle: str, payload: bytes):
+        day = arrival.astimezone(timezone.utc).strftime("%Y-%m-%d")
+        record = encode_record(arrival.timestamp(), vehicle, payload)
+        with self.lock:
+            if day != self.day:
+                if self.file:
+                    self.file.close()
+                path = self.directory / f"status-{day}.bin"
+                if path.exists():
+                    with open(path, "r+b") as file:
+                        file.truncate(whole_length(file))
+                # Unbuffered, so a failed write leaves nothing behind to flush later
+                self.file = open(path, "ab", buffering=0)
+                self.day = day
+            end = self.file.seek(0, 2)
+            try:
+                if self.file.write(record) != len(record):
+                    raise OSError(f"short write to {self.file.name}")
+            except OSError:
+                # Leaves no partial record for the next append to land behind
+                self.file.truncate(end)
+                raise
+
+
+def whole_length(file: BinaryIO) -> int:
+    """Length of the file up to the end of its last whole record."""
+    size = file.seek(0, 2)
+    offset = 0
+    while offset + RECORD_HEADER.size <= size:
+        file.seek(offset)
+        _, vehicle_length, length = RECORD_HEADER.unpack(file.read(RECORD_HEADER.size))
+        end = offset + RECORD_HEADER.size + vehicle_length + length
+        if end > size:
+            break
+        offset = end
+    return offset
+
+
+def read_records(path: Path, offset: int = 0) -> Iterator[tuple[int, float, str, bytes]]:
+    """(offset after the record, arrival, vehicle, payload) of every whole record from offset on."""
+    with open(path, "rb") as file:
+        file.seek(offset)
+        while True:
+            header = file.read(RECORD_HEADER.size)
+            if len(header) < RECORD_HEADER.size:
+                return
+            arrival, vehicle_length, length = RECORD_HEADER.unpack(header)
+            body = file.read(vehicle_length + length)
+            if len(body) < vehicle_length + length:
+                return
+            offset += RECORD_HEADER.size + len(body)
+            yield offset, arrival, body[:vehicle_length].decode(), body[vehicle_length:]
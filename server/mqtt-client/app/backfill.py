@@ -0,0 +1,264 @@
+"""Reprocesses archived raw status payloads into Elasticsearch.
+
+    python3 app/backfill.py /archive/status-2026-*.bin --workers 4 --streams 4
+    python3 app/backfill.py /archive/status-*.bin --index vehicle-status_v2
+
+Reads the archive written by main.py (see archive.py), decodes and maps the
+payloads with the service's own parse_payload and status_to_es_doc in a pool
+of worker processes and writes the documents through several concurrent bulk
+streams. Run it after a change to the mapping or a decoding fix.
+
+Documents get the id the live service gives them (status_doc_id), so
+reprocessing overwrites them in place. A mapping change only applies to new indices: write into a new
+base with --index, then drop the old indices, since both match the read
+pattern. The new base must not start with "<ES_INDEX>-", or the live index
+template would match it too. Fields added after indexing are not reproduced:
+the reorder window's sequence_gap and is_late, and the DR correction, which a
+later pass of dr_correction.py applies again. Rollups are not touched.
+
+Backpressure: at most twice --workers batches are decoding and --streams are
+queued for writing at any time, so reading slows to what Elasticsearch
+accepts. A batch whose bulk request keeps failing stops the run.
+
+Progress is checkpointed per file as the offset up to which every batch has
+been written; a rerun with the same --checkpoint resumes there, and only
+batches that were in flight are written twice. Archive files of the current
+day keep growing; a rerun picks up what was appended since.
+"""
+import argparse
+import json
+import os
+import queue
+import threading
+import time
+from collections import deque
+from concurrent.futures import ProcessPoolExecutor
+from dataclasses import dataclass, field
+from datetime import datetime
+from pathlib import Path
+from typing import Iterator
+
+from elasticsearch import helpers
+
+from archive import read_records
+from main import (LOCAL_TZ, STATUS_MAPPING, config, ensure_template_exists, es, logger,
+                  parse_payload, partition_index, status_doc_id, status_to_es_doc)
+
+
+@dataclass
+class Batch:
+    path: str
+    start: int                  # file offsets of the first and after the last record
+    end: int
+    records: list[tuple[float, str, bytes]]
+
+
+@dataclass
+class Transformed:
+    path: str
+    start: int
+    end: int
+    actions: list[dict]
+    invalid: int
+
+
+def transform(batch: Batch, base_index: str) -> Transformed:
+    """Runs in a worker process."""
+    actions = []
+    invalid = 0
+    for arrival, vehicle, payload in batch.records:
+        status = parse_payload(payload)
+        if status is None:
+            invalid += 1
+            continue
+        actions.append({
+            "_index": partition_index(base_index, status.time, config.es_index_partition),
+            "_id": status_doc_id(vehicle, status),
+            "_source": status_to_es_doc(vehicle, status, datetime.fromtimestamp(arrival, LOCAL_TZ)),
+        })
+    return Transformed(batch.path, batch.start, batch.end, actions, invalid)
+
+
+def read_batches(paths: list[Path], checkpoint: "Checkpoint", batch_size: int) -> Iterator[Batch]:
+    for path in paths:
+        start = checkpoint.offset(str(path))
+        records = []
+        end = start
+        for end, arrival, vehicle, payload in read_records(path, start):
+            records.append((arrival, vehicle, payload))
+            if len(records) == batch_size:
+                yield Batch(str(path), start, end, records)
+                start, records = end, []
+        if records:
+            yield Batch(str(path), start, end, records)
+
+
+@dataclass
+class FileProgress:
+    offset: int = 0
+    # Batches written ahead of the offset, start -> end
+    pending: dict[int, int] = field(default_factory=dict)
+
+
+class Checkpoint:
+    def __init__(self, path: Path, interval: float):
+        self.path = path
+        self.interval = interval
+        self.files: dict[str, FileProgress] = {}
+        self.lock = threading.Lock()
+        self.saved = time.monotonic()
+        if path.exists():
+            for name, offset in json.loads(path.read_text()).items():
+                self.files[name] = FileProgress(offset)
+
+    def offset(self, name: str) -> int:
+        with self.lock:
+            return self.files.setdefault(name, FileProgress()).offset
+
+    def complete(self, name: str, start: int, end: int):
+        """Batches finish out of order; the offset only moves over a contiguous run."""
+        with self.lock:
+            progress = self.files.setdefault(name, FileProgress())
+            progress.pending[start] = end
+            while progress.offset in progress.pending:
+                progress.offset = progress.pending.pop(progress.offset)
+            if time.monotonic() - self.saved >= self.interval:
+                self.save_locked()
+
+    def save(self):
+        with self.lock:
+            self.save_locked()
+
+    def save_locked(self):
+        temporary = self.path.with_name(self.path.name + ".tmp")
+        temporary.write_text(json.dumps({name: progress.offset for name, progress in self.files.items()}, indent=1))
+        os.replace(temporary, self.path)
+        self.saved = time.monotonic()
+
+
+@dataclass
+class Stats:
+    started: float = field(default_factory=time.monotonic)
+    records: int = 0
+    invalid: int = 0
+    indexed: int = 0
+    rejected: int = 0
+    requests: int = 0
+    retries: int = 0
+    lock: threading.Lock = field(default_factory=threading.Lock)
+
+    def add(self, **counts: int):
+        with self.lock:
+            for name, count in counts.items():
+                setattr(self, name, getattr(self, name) + count)
+
+    def rate(self) -> float:
+        return self.indexed / max(time.monotonic() - self.started, 1e-9)
+
+
+class Backfill:
+    def __init__(self, args):
+        self.args = args
+        self.checkpoint = Checkpoint(Path(args.checkpoint), args.checkpoint_interval)
+        self.stats = Stats()
+        self.write_queue: queue.Queue[Transformed | None] = queue.Queue(maxsize=args.streams)
+        self.failed = threading.Event()
+        self.done = threading.Event()
+
+    def write_stream(self):
+        while True:
+            batch = self.write_queue.get()
+            if batch is None:
+                return
+            if not self.failed.is_set() and self.write(batch):
+                self.checkpoint.complete(batch.path, batch.start, batch.end)
+
+    def write(self, batch: Transformed) -> bool:
+        self.stats.add(records=len(batch.actions) + batch.invalid, invalid=batch.invalid)
+        if not batch.actions:
+            return True
+        for attempt in range(self.args.retries + 1):
+            try:
+                indexed, errors = helpers.bulk(es, batch.actions, chunk_size=len(batch.actions),
+                                               raise_on_error=False, raise_on_exception=True)
+            except Exception as e:
+                if attempt == self.args.retries:
+                    logger.error(f"Bulk write of {batch.path} [{batch.start}, {batch.end}) failed: {e}")
+                    self.failed.set()
+                    return False
+                self.stats.add(retries=1)
+                time.sleep(min(30.0, 0.5 * 2 ** attempt))
+                continue
+            # Documents Elasticsearch refused would be refused again; they are counted, not retried
+            self.stats.add(indexed=indexed, rejected=len(errors), requests=1)
+            if errors:
+                logger.warning(f"{len(errors)} documents rejected, first: {errors[0]}")
+            return True
+        return False
+
+    def report(self):
+        last_time, last_indexed = time.monotonic(), 0
+        while not self.done.wait(self.args.report):
+            now, indexed = time.monotonic(), self.stats.indexed
+            logger.info(f"{self.stats.records} records read, {indexed} indexed "
+                        f"({(indexed - last_indexed) / (now - last_time):.0f}/s now, {self.stats.rate():.0f}/s overall), "
+                        f"{self.stats.invalid} undecodable, {self.stats.rejected} rejected, "
+                        f"write queue {self.write_queue.qsize()}/{self.write_queue.maxsize}")
+            last_time, last_indexed = now, indexed
+
+    def run(self, paths: list[Path]) -> bool:
+        ensure_template_exists(self.args.index, STATUS_MAPPING)
+        writers = [threading.Thread(target=self.write_stream, daemon=True) for _ in range(self.args.streams)]
+        for writer in writers:
+            writer.start()
+        reporter = threading.Thread(target=self.report, daemon=True)
+        reporter.start()
+
+        in_flight: deque = deque()
+        with ProcessPoolExecutor(max_workers=self.args.workers) as pool:
+            for batch in read_batches(paths, self.checkpoint, self.args.batch):
+                if self.failed.is_set():
+                    break
+                in_flight.append(pool.submit(transform, batch, self.args.index))
+                if len(in_flight) >= 2 * self.args.workers:
+                    # Blocks while every write stream is busy
+                    self.write_queue.put(in_flight.popleft().result())
+            while in_flight and not self.failed.is_set():
+                self.write_queue.put(in_flight.popleft().result())
+            for future in in_flight:
+                future.cancel()
+
+        for _ in writers:
+            self.write_queue.put(None)
+        for writer in writers:
+            writer.join()
+        self.done.set()
+        self.checkpoint.save()
+
+        elapsed = time.monotonic() - self.stats.started
+        logger.info(f"Backfill {'stopped' if self.failed.is_set() else 'finished'} after {elapsed:.1f} s: "
+                    f"{self.stats.records} records, {self.stats.indexed} indexed ({self.stats.rate():.0f}/s) "
+                    f"in {self.stats.requests} bulk requests, {self.stats.invalid} undecodable, "
+                    f"{self.stats.rejected} rejected, {self.stats.retries} retries")
+        return not self.failed.is_set()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("paths", nargs="+", type=Path, help="archive files, processed in the order given")
+    parser.add_argument("--index", default=config.es_index, help="base of the status indices written")
+    parser.add_argument("--workers", type=int, default=os.cpu_count() or 1, help="decoding processes")
+    parser.add_argument("--streams", type=int, default=4, help="concurrent bulk requests")
+    parser.add_argument("--batch", type=int, default=1000, help="records per bulk request")
+    parser.add_argument("--retries", type=int, default=5, help="attempts per bulk request after the first")
+    parser.add_argument("--checkpoint", default="backfill-checkpoint.json", help="progress file, resumed from")
+    parser.add_argument("--checkpoint-interval", type=float, default=5, help="s between checkpoint writes")
+    parser.add_argument("--report", type=float, default=10, help="s between progress reports")
+    args = parser.parse_args()
+
+    if not Backfill(args).run(args.paths):
+        raise SystemExit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,146 @@
+"""Reassembly of IMU black-box captures uploaded in chunks.
+
+Mirrors edge-device/src/BlackBox.h. Chunks of one capture may arrive late,
+twice or interleaved with other traffic; a capture is stored once every chunk
+is in, or with the chunks it has when no more arrive for a while (the device
+rebooted and lost it, or it was cut short).
+"""
+import struct
+import threading
+import time
+from dataclasses import dataclass, field
+from datetime import datetime, timedelta, timezone
+
+CHUNK_HEADER_FORMAT = "<IIHHHBB"
+CHUNK_HEADER_SIZE = struct.calcsize(CHUNK_HEADER_FORMAT)
+SAMPLE_FORMAT = "<6h"
+SAMPLE_SIZE = struct.calcsize(SAMPLE_FORMAT)
+
+# BLACKBOX_ACCEL_SCALE / BLACKBOX_GYRO_SCALE in the firmware
+ACCEL_SCALE = 4096.0  # LSB per g
+GYRO_SCALE = 16.0     # LSB per deg/s
+
+EPOCH = datetime(2000, 1, 1, tzinfo=timezone.utc)
+
+STORED_MEMORY = 24 * 3600  # s a stored capture's id is remembered
+
+
+@dataclass
+class Chunk:
+    capture_id: int
+    trigger_time: int
+    sample_interval: int
+    trigger_index: int
+    sample_count: int
+    index: int
+    count: int
+    samples: list[tuple[int, ...]]
+
+
+def parse_chunk(payload: bytes) -> Chunk | None:
+    if len(payload) < CHUNK_HEADER_SIZE or (len(payload) - CHUNK_HEADER_SIZE) % SAMPLE_SIZE:
+        return None
+    header = struct.unpack_from(CHUNK_HEADER_FORMAT, payload)
+    samples = [sample for sample in struct.iter_unpack(SAMPLE_FORMAT, payload[CHUNK_HEADER_SIZE:])]
+    chunk = Chunk(*header, samples=samples)
+    if chunk.count == 0 or chunk.index >= chunk.count or not samples:
+        return None
+    return chunk
+
+
+@dataclass
+class Capture:
+    vehicle: str
+    first: Chunk
+    chunks: dict[int, list[tuple[int, ...]]] = field(default_factory=dict)
+    updated: float = 0.0
+
+    @property
+    def is_complete(self) -> bool:
+        return len(self.chunks) == self.first.count
+
+    @property
+    def id(self) -> str:
+        return f"{self.vehicle}-{self.first.trigger_time}-{self.first.capture_id}"
+
+    def chunk_size(self) -> int:
+        """Samples per chunk; every chunk but the last is full."""
+        header = self.first
+        for index, samples in self.chunks.items():
+            if index < header.count - 1:
+                return len(samples)
+        last = self.chunks[header.count - 1]
+        return (header.sample_count - len(last)) // (header.count - 1) if header.count > 1 else len(last)
+
+    def to_es_doc(self) -> dict:
+        header = self.first
+        samples = [sample for index in sorted(self.chunks) for sample in self.chunks[index]]
+        # Samples of a missing chunk are left out; offsets keep the others in place
+        chunk_size = self.chunk_size()
+        offsets = []
+        for index in sorted(self.chunks):
+            start = index * chunk_size
+            offsets.extend(range(start, start + len(self.chunks[index])))
+
+        ax, ay, az, gx, gy, gz = (list(axis) for axis in zip(*samples)) if samples else ([],) * 6
+        peak = max((sum((value / ACCEL_SCALE) ** 2 for value in sample[:3]) ** 0.5 for sample in samples), default=0.0)
+        trigger_time = EPOCH + timedelta(seconds=header.trigger_time) if header.trigger_time else None
+        return {
+            "vehicle": self.vehicle,
+            "capture_id": header.capture_id,
+            "trigger_time": trigger_time.isoformat() if trigger_time else None,
+            "received": datetime.now(timezone.utc).isoformat(),
+            "sample_interval_ms": header.sample_interval,
+            "trigger_index": header.trigger_index,
+            "sample_count": header.sample_count,
+            "chunks_received": len(self.chunks),
+            "chunk_count": header.count,
+            "complete": self.is_complete,
+            "peak_acceleration_g": peak,
+            "samples": {
+                "offset_ms": [(offset - header.trigger_index) * header.sample_interval for offset in offsets],
+                "acceleration_g": {"x": [v / ACCEL_SCALE for v in ax], "y": [v / ACCEL_SCALE for v in ay],
+                                   "z": [v / ACCEL_SCALE for v in az]},
+                "angular_velocity_dps": {"x": [v / GYRO_SCALE for v in gx], "y": [v / GYRO_SCALE for v in gy],
+                                         "z": [v / GYRO_SCALE for v in gz]},
+            },
+        }
+
+
+class BlackBoxAssembler:
+    def __init__(self, timeout: float):
+        self.timeout = timeout
+        self.captures: dict[tuple[str, int, int], Capture] = {}
+        # Stored captures, so a late duplicate chunk does not start a partial copy
+        self.stored: dict[tuple[str, int, int], float] = {}
+        self.lock = threading.Lock()
+
+    def add(self, vehicle: str, chunk: Chunk) -> Capture | None:
+        """Stores the chunk; returns the capture once its last chunk is in."""
+        key = (vehicle, chunk.trigger_time, chunk.capture_id)
+        with self.lock:
+            if key in self.stored:
+                return None
+            capture = self.captures.get(key)
+            if capture is None:
+                capture = self.captures[key] = Capture(vehicle, chunk)
+            # A redelivered chunk replaces itself
+            capture.chunks[chunk.index] = chunk.samples
+            capture.updated = time.monotonic()
+            if capture.is_complete:
+                del self.captures[key]
+                self.stored[key] = capture.updated
+                return capture
+        return None
+
+    def expire(self) -> list[Capture]:
+        """Incomplete captures that stopped receiving chunks."""
+        now = time.monotonic()
+        with self.lock:
+            for key, stored in list(self.stored.items()):
+                if now - stored > STORED_MEMORY:
+                    del self.stored[key]
+            expired = [key for key, capture in self.captures.items() if now - capture.updated > self.timeout]
+            for key in expired:
+                self.stored[key] = now
+            return [self.captures.pop(key) for key in expired]
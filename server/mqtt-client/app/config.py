@@ -6,10 +6,27 @@ class Config:
         self.mqtt_server = os.getenv("MQTT_SERVER", "broker.hivemq.com")
         self.mqtt_port = int(os.getenv("MQTT_PORT", 1883))
         self.mqtt_topic = os.getenv("MQTT_TOPIC", "ut-cps/vehicle-monitoring")
+        self.mqtt_health_topic = os.getenv("MQTT_HEALTH_TOPIC", "ut-cps/vehicle-monitoring/health")
+        self.mqtt_trip_topic = os.getenv("MQTT_TRIP_TOPIC", "ut-cps/vehicle-monitoring/trip")
+        self.mqtt_blackbox_topic = os.getenv("MQTT_BLACKBOX_TOPIC", "ut-cps/vehicle-monitoring/blackbox")
+        # Per-device downlink: <prefix>/<device client id>
+        self.mqtt_config_topic = os.getenv("MQTT_CONFIG_TOPIC", "ut-cps/vehicle-monitoring/config")
+        self.mqtt_config_ack_topic = os.getenv("MQTT_CONFIG_ACK_TOPIC", "ut-cps/vehicle-monitoring/config-ack")
         self.mqtt_client_id = os.getenv("MQTT_CLIENT_ID", "python_vehicle_listener")
         
         self.es_host = os.getenv("ES_HOST", "https://localhost:9200")
         self.es_index = os.getenv("ES_INDEX", "vehicle-status")
+        self.es_health_index = os.getenv("ES_HEALTH_INDEX", "vehicle-health")
+        self.es_trip_index = os.getenv("ES_TRIP_INDEX", "vehicle-trips")
+        self.es_blackbox_index = os.getenv("ES_BLACKBOX_INDEX", "vehicle-blackbox")
+        # An incomplete black-box capture is stored this long after its last chunk
+        self.blackbox_timeout = float(os.getenv("BLACKBOX_TIMEOUT", 600))  # s
+
+        # Status records go to <es_index>-<period> by their own time: daily, weekly or none
+        self.es_index_partition = os.getenv("ES_INDEX_PARTITION", "daily")
+        # 1-minute and 1-hour rollups: <es_rollup_index>-<resolution>-<month>
+        self.es_rollup_index = os.getenv("ES_ROLLUP_INDEX", "vehicle-rollup")
+        self.rollup_flush_interval = float(os.getenv("ROLLUP_FLUSH_INTERVAL", 30))  # s
 
         es_username = os.getenv("ES_USER")
         es_password = os.getenv("ES_PASSWORD")
@@ -21,6 +38,28 @@ class Config:
 
         self.es_ca_certificate = os.getenv("ES_CA_CERT", None)
 
+        # Reorder/dedup window for sequenced records; the block size must
+        # match SEQUENCE_BLOCK_SIZE in the firmware
+        self.reorder_window_size = int(os.getenv("REORDER_WINDOW_SIZE", 16))
+        self.reorder_timeout = float(os.getenv("REORDER_TIMEOUT", 60))
+        self.sequence_block_size = int(os.getenv("SEQUENCE_BLOCK_SIZE", 256))
+
+        # Raw status payloads are archived here for app/backfill.py; unset disables
+        self.raw_archive_dir = os.getenv("RAW_ARCHIVE_DIR")
+
+        # The gateway authenticates with "Authorization: Bearer <secret>"
+        self.sms_gateway_host = os.getenv("SMS_GATEWAY_HOST", "127.0.0.1")
+        self.sms_gateway_port = int(os.getenv("SMS_GATEWAY_PORT", 8081))
+        self.sms_gateway_secret = os.getenv("SMS_GATEWAY_SECRET")
+        # Vehicle id of each device SIM: "+98912...=vt,+98935...=vt2"; unlisted senders keep their number
+        self.sms_senders = dict(entry.split("=", 1) for entry in os.getenv("SMS_SENDERS", "").split(",") if "=" in entry)
+
+        # In-memory latest-state store and its query API
+        self.live_api_port = int(os.getenv("LIVE_API_PORT", 8082))
+        self.live_trail_length = int(os.getenv("LIVE_TRAIL_LENGTH", 60))
+        self.live_cell_size = float(os.getenv("LIVE_CELL_SIZE", 0.05))           # degrees
+        self.live_publish_interval = float(os.getenv("LIVE_PUBLISH_INTERVAL", 0.1))  # s
+
     def create_elasticsearch_client(self):
 
         if(self.es_ca_certificate):
@@ -0,0 +1,136 @@
+"""Rewrites dead-reckoned locations once the fix that ends their outage is indexed.
+
+    python3 app/dr_correction.py --since 24 --workers 8
+    python3 app/dr_correction.py --every 300        # keep running
+
+Each vehicle's recent track is read in time order, every dead-reckoned run
+with a fix on both sides is corrected by dr_smoother and the segment is
+rewritten with one bulk request. Vehicles are processed in parallel. The
+original location is kept in dr_location and corrected records are marked
+dr_corrected, so a segment is never corrected twice; runs still open at the
+end of the track are picked up by a later pass.
+"""
+import argparse
+import time
+from concurrent.futures import ThreadPoolExecutor
+from dataclasses import dataclass
+from datetime import datetime
+
+from elasticsearch import helpers
+
+from dr_smoother import TrackPoint, correct_segment, distance, find_segments
+from main import STATUS_READ_PATTERN, es, logger
+
+
+@dataclass
+class VehicleResult:
+    vehicle: str
+    segments: int = 0
+    points: int = 0
+    max_correction: float = 0.0
+
+
+def hit_to_point(hit: dict) -> TrackPoint:
+    doc = hit["_source"]
+    velocity = doc.get("velocity") or {}
+    return TrackPoint(
+        time=datetime.fromisoformat(doc["time"]).timestamp(),
+        lat=doc["location"]["lat"],
+        lon=doc["location"]["lon"],
+        alt=doc.get("altitude", 0.0),
+        east=velocity.get("x"),
+        north=velocity.get("y"),
+        dead_reckoned=doc.get("is_location_dead_reckoned", False),
+        # Packed SMS fixes carry no freshness
+        freshness=doc.get("location_freshness", 0) / 1000,
+        corrected=doc.get("dr_corrected", False),
+        id=hit["_id"],
+        index=hit["_index"],
+    )
+
+
+def load_track(vehicle: str, since_hours: float) -> list[TrackPoint]:
+    query = {
+        "query": {"bool": {"filter": [
+            {"term": {"vehicle": vehicle}},
+            {"range": {"time": {"gte": f"now-{since_hours}h"}}},
+        ]}},
+        "sort": [{"time": "asc"}],
+    }
+    hits = helpers.scan(es, index=STATUS_READ_PATTERN, query=query, preserve_order=True,
+                        _source=["time", "location", "altitude", "velocity", "is_location_dead_reckoned",
+                                 "location_freshness", "dr_corrected"])
+    return [hit_to_point(hit) for hit in hits]
+
+
+def correct_vehicle(vehicle: str, since_hours: float, order: float, dry_run: bool) -> VehicleResult:
+    result = VehicleResult(vehicle)
+    actions = []
+
+    for segment in find_segments(load_track(vehicle, since_hours)):
+        if any(point.corrected for point in segment.points):
+            continue
+        result.segments += 1
+        for point, (lat, lon, alt) in zip(segment.points, correct_segment(segment, order)):
+            result.points += 1
+            result.max_correction = max(result.max_correction, distance((point.lat, point.lon), (lat, lon)))
+            actions.append({
+                "_op_type": "update",
+                "_index": point.index,
+                "_id": point.id,
+                "doc": {
+                    "location": {"lat": lat, "lon": lon},
+                    "altitude": alt,
+                    "dr_location": {"lat": point.lat, "lon": point.lon},
+                    "dr_corrected": True,
+                },
+            })
+
+    if actions and not dry_run:
+        helpers.bulk(es, actions)
+    return result
+
+
+def list_vehicles() -> list[str]:
+    response = es.search(index=STATUS_READ_PATTERN, size=0,
+                         aggs={"vehicles": {"terms": {"field": "vehicle", "size": 10000}}})
+    return [bucket["key"] for bucket in response["aggregations"]["vehicles"]["buckets"]]
+
+
+def correct_all(since_hours: float, workers: int, order: float, dry_run: bool):
+    started = time.monotonic()
+    vehicles = list_vehicles()
+    with ThreadPoolExecutor(max_workers=workers) as pool:
+        results = list(pool.map(lambda vehicle: correct_vehicle(vehicle, since_hours, order, dry_run), vehicles))
+
+    for result in results:
+        if result.segments:
+            logger.info(f"{result.vehicle}: corrected {result.points} records in {result.segments} segments, "
+                        f"largest shift {result.max_correction:.1f} m")
+    logger.info(f"DR correction of {len(vehicles)} vehicles took {time.monotonic() - started:.1f} s"
+                f"{' (dry run)' if dry_run else ''}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--since", type=float, default=24, help="hours of track to read per vehicle")
+    parser.add_argument("--workers", type=int, default=8, help="vehicles processed in parallel")
+    parser.add_argument("--order", type=float, default=2.0, help="drift growth: 2 for accelerometer bias, 1 for velocity error")
+    parser.add_argument("--every", type=float, help="repeat every this many seconds")
+    parser.add_argument("--dry-run", action="store_true", help="compute and log, write nothing")
+    args = parser.parse_args()
+
+    while True:
+        try:
+            correct_all(args.since, args.workers, args.order, args.dry_run)
+        except Exception:
+            logger.exception("DR correction pass failed")
+            if not args.every:
+                raise
+        if not args.every:
+            break
+        time.sleep(args.every)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,105 @@
+"""Retroactive correction of dead-reckoned track segments.
+
+While GNSS is out the device reports the last fix plus the displacement
+integrated from the IMU (MpuSensor::getNewLocation). When a fix returns the
+device snaps to it, leaving the whole segment off by a drift that grew from
+zero at the last fix to the jump seen at the closing fix.
+
+Anchored drift distribution: the error at the closing fix is spread back over
+the segment in proportion to (elapsed / segment duration) ** order. Order 2
+matches drift from a constant accelerometer bias, which is integrated twice;
+order 1 matches a velocity error at the start of the outage.
+"""
+import math
+from dataclasses import dataclass
+from typing import Iterator, Sequence
+
+EARTH_RADIUS = 6371000.0  # m, as in the firmware
+
+
+@dataclass
+class TrackPoint:
+    time: float                 # s, epoch
+    lat: float
+    lon: float
+    alt: float = 0.0
+    east: float | None = None   # m/s, reported velocity
+    north: float | None = None
+    dead_reckoned: bool = False
+    freshness: float = 0.0      # s since the fix the location is based on
+    corrected: bool = False
+    id: str | None = None
+    index: str | None = None
+
+
+@dataclass
+class Segment:
+    before: TrackPoint          # last fix before the outage
+    points: list[TrackPoint]    # dead-reckoned reports, in time order
+    after: TrackPoint           # fix that ended it
+
+
+def find_segments(track: Sequence[TrackPoint]) -> Iterator[Segment]:
+    """Dead-reckoned runs bounded by a fix on both sides; an open run at the end is left alone."""
+    before = None
+    points: list[TrackPoint] = []
+    for point in track:
+        if point.dead_reckoned:
+            if before is not None:
+                points.append(point)
+            continue
+        if before is not None and points:
+            yield Segment(before, points, point)
+        before = point
+        points = []
+
+
+def to_local(origin: TrackPoint, lat: float, lon: float) -> tuple[float, float]:
+    """East/north metres from origin, on the same flat-earth model as the firmware."""
+    north = math.radians(lat - origin.lat) * EARTH_RADIUS
+    east = math.radians(lon - origin.lon) * EARTH_RADIUS * math.cos(math.radians(origin.lat))
+    return east, north
+
+
+def from_local(origin: TrackPoint, east: float, north: float) -> tuple[float, float]:
+    lat = origin.lat + math.degrees(north / EARTH_RADIUS)
+    lon = origin.lon + math.degrees(east / (EARTH_RADIUS * math.cos(math.radians(origin.lat))))
+    return lat, lon
+
+
+def closing_error(segment: Segment) -> tuple[float, float, float, float]:
+    """(east, north, up) error of dead reckoning at the closing fix, and the time since the anchor."""
+    anchor_time = segment.before.time - segment.before.freshness
+    last = segment.points[-1]
+    fix_time = segment.after.time - segment.after.freshness
+
+    # Where dead reckoning would have put the vehicle at the closing fix
+    east, north = to_local(segment.before, last.lat, last.lon)
+    if last.east is not None and last.north is not None:
+        gap = max(0.0, fix_time - last.time)
+        east += last.east * gap
+        north += last.north * gap
+
+    fix_east, fix_north = to_local(segment.before, segment.after.lat, segment.after.lon)
+    return fix_east - east, fix_north - north, segment.after.alt - last.alt, fix_time - anchor_time
+
+
+def correct_segment(segment: Segment, order: float = 2.0) -> list[tuple[float, float, float]]:
+    """Corrected (lat, lon, alt) of every point in the segment."""
+    error_east, error_north, error_up, duration = closing_error(segment)
+    anchor_time = segment.before.time - segment.before.freshness
+
+    corrected = []
+    for point in segment.points:
+        share = min(1.0, max(0.0, (point.time - anchor_time) / duration)) ** order if duration > 0 else 1.0
+        east, north = to_local(segment.before, point.lat, point.lon)
+        lat, lon = from_local(segment.before, east + error_east * share, north + error_north * share)
+        corrected.append((lat, lon, point.alt + error_up * share))
+    return corrected
+
+
+def distance(a: tuple[float, float], b: tuple[float, float]) -> float:
+    """Metres between two (lat, lon) pairs, small-distance approximation."""
+    north = math.radians(b[0] - a[0]) * EARTH_RADIUS
+    east = math.radians(b[1] - a[1]) * EARTH_RADIUS * math.cos(math.radians(a[0]))
+    return math.hypot(east, north)
@@ -0,0 +1,80 @@
+"""Read-only HTTP/JSON API over the in-memory latest-state store.
+
+GET /vehicles                                   latest state of every vehicle
+GET /vehicles?bbox=min_lon,min_lat,max_lon,max_lat
+GET /vehicles/nearest?lat=..&lon=..&n=..        closest vehicles with distance_m
+GET /vehicles/<id>                              latest state with its recent trail
+"""
+import json
+import logging
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+from live_state import LatestStateStore
+
+logger = logging.getLogger("VehicleMonitor")
+
+
+class LiveApiHandler(BaseHTTPRequestHandler):
+    store: LatestStateStore
+
+    def do_GET(self):
+        url = urlparse(self.path)
+        query = {key: values[0] for key, values in parse_qs(url.query).items()}
+        parts = [part for part in url.path.split("/") if part]
+
+        try:
+            if parts == ["vehicles"]:
+                body = self.list_vehicles(query)
+            elif parts == ["vehicles", "nearest"]:
+                body = self.nearest(query)
+            elif len(parts) == 2 and parts[0] == "vehicles":
+                state = self.store.get(parts[1])
+                if state is None:
+                    self.send_error(404)
+                    return
+                body = state.to_dict(with_trail=True)
+            else:
+                self.send_error(404)
+                return
+        except (KeyError, ValueError) as e:
+            self.send_error(400, f"Bad query: {e}")
+            return
+
+        payload = json.dumps(body).encode()
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(payload)))
+        self.end_headers()
+        self.wfile.write(payload)
+
+    def list_vehicles(self, query: dict) -> list:
+        if "bbox" not in query:
+            return [state.to_dict() for state in self.store.all()]
+        min_lon, min_lat, max_lon, max_lat = (float(value) for value in query["bbox"].split(","))
+        return [state.to_dict() for state in self.store.within(min_lat, min_lon, max_lat, max_lon)]
+
+    def nearest(self, query: dict) -> list:
+        found = self.store.nearest(float(query["lat"]), float(query["lon"]), int(query.get("n", 10)))
+        return [dict(state.to_dict(), distance_m=round(meters, 1)) for meters, state in found]
+
+    def log_message(self, format, *args):
+        logger.debug(format % args)
+
+
+def serve(store: LatestStateStore, port: int) -> ThreadingHTTPServer:
+    """Starts the API and the snapshot publisher on daemon threads."""
+
+    def publish_loop():
+        while True:
+            time.sleep(store.publish_interval)
+            store.publish()
+
+    handler = type("BoundLiveApiHandler", (LiveApiHandler,), {"store": store})
+    server = ThreadingHTTPServer(("0.0.0.0", port), handler)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    threading.Thread(target=publish_loop, daemon=True).start()
+    logger.info(f"Live state API listening on port {port}")
+    return server
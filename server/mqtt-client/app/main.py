@@ -1,12 +1,22 @@
+import json
 import logging
 import struct
 import math
+import threading
+import time
 from dataclasses import dataclass, asdict
-from datetime import datetime
+from datetime import datetime, timedelta, timezone
 from typing import NamedTuple
 import paho.mqtt.client as mqtt
+from elasticsearch import helpers
 from paho.mqtt.enums import CallbackAPIVersion
 from config import Config
+from reorder import Released, ReorderWindow
+from live_state import LatestStateStore, VehicleState
+from rollups import RollupStore
+from blackbox import BlackBoxAssembler, Capture, parse_chunk
+from archive import RawArchive
+import live_api
 
 logging.basicConfig(
     level=logging.INFO,
@@ -19,22 +29,138 @@ LOCAL_TZ = ZoneInfo("Asia/Tehran")
 
 es = config.create_elasticsearch_client()
 
+# Devices publish on <topic>/<device client id>, which is their vehicle id;
+# firmware from before that publishes on the bare topics and gets this one
+LEGACY_VEHICLE_ID = "cps-tracer"
+
+
+def topic_vehicle(topic: str, base: str) -> str:
+    return topic[len(base) + 1:] if topic.startswith(base + "/") else LEGACY_VEHICLE_ID
+
+
+STATUS_MAPPING = {
+    "mappings": {
+        "properties": {
+            "location": {"type": "geo_point"},
+            "vehicle": {"type": "keyword"},
+            "altitude": {"type": "float"},
+            "acceleration_magnitude": {"type": "float"},
+            "velocity_magnitude": {"type": "float"},
+            "time": {"type": "date"},
+            "sequence": {"type": "long"},
+            "sequence_gap": {"type": "integer"},
+            "dr_location": {"type": "geo_point"},
+            "dr_corrected": {"type": "boolean"}
+        }
+    }
+}
+
+# Mirrors edge-device/src/Health.cpp
+HEALTH_MAPPING = {
+    "mappings": {
+        "properties": {
+            "time": {"type": "date"},
+            "vehicle": {"type": "keyword"},
+            "device": {"type": "keyword"},
+            "uptime_ms": {"type": "long"},
+            "period_ms": {"type": "long"},
+            "active_ms": {"type": "long"},
+            "idle_ms": {"type": "long"},
+            "power_down_ms": {"type": "long"},
+            "modem_sleep_ms": {"type": "long"},
+            "active_ma": {"type": "integer"},
+            "idle_ma": {"type": "integer"},
+            "power_down_ma": {"type": "integer"},
+            "modem_awake_ma": {"type": "integer"},
+            "modem_sleep_ma": {"type": "integer"},
+            "average_ma": {"type": "integer"},
+            "static_ram": {"type": "integer"},
+            "free_stack": {"type": "integer"},
+            "free_heap": {"type": "integer"},
+            "stack_headroom": {"type": "integer"},
+            "stack_high_water": {"type": "integer"}
+        }
+    }
+}
+
+TRIP_MAPPING = {
+    "mappings": {
+        "properties": {
+            "vehicle": {"type": "keyword"},
+            "start_time": {"type": "date"},
+            "end_time": {"type": "date"},
+            "start_location": {"type": "geo_point"},
+            "end_location": {"type": "geo_point"},
+            "distance_m": {"type": "float"},
+            "moving_time_s": {"type": "long"},
+            "max_speed": {"type": "float"},
+            "average_speed": {"type": "float"}
+        }
+    }
+}
+
+ROLLUP_MAPPING = {
+    "mappings": {
+        "properties": {
+            "vehicle": {"type": "keyword"},
+            "resolution": {"type": "keyword"},
+            "bucket_start": {"type": "date"},
+            "bucket_end": {"type": "date"},
+            "first_time": {"type": "date"},
+            "last_time": {"type": "date"},
+            "count": {"type": "integer"},
+            "dead_reckoned_count": {"type": "integer"},
+            "distance_m": {"type": "float"},
+            "speed_min": {"type": "float"},
+            "speed_max": {"type": "float"},
+            "speed_avg": {"type": "float"},
+            "bbox_top_left": {"type": "geo_point"},
+            "bbox_bottom_right": {"type": "geo_point"},
+            "location": {"type": "geo_point"}
+        }
+    }
+}
+
+PARTITION_FORMATS = {
+    "daily": "%Y.%m.%d",
+    "weekly": "%G.w%V",
+    "monthly": "%Y.%m",
+}
+
+BLACKBOX_MAPPING = {
+    "mappings": {
+        "properties": {
+            "vehicle": {"type": "keyword"},
+            "capture_id": {"type": "long"},
+            "trigger_time": {"type": "date"},
+            "received": {"type": "date"},
+            "complete": {"type": "boolean"},
+            "peak_acceleration_g": {"type": "float"},
+            # Sample arrays are stored, not indexed
+            "samples": {"type": "object", "enabled": False}
+        }
+    }
+}
+
+
+def partition_index(base: str, time: datetime, period: str) -> str:
+    """Index a record belongs in by its own (UTC) time, so late records land in the right partition."""
+    if period not in PARTITION_FORMATS:
+        return base
+    return f"{base}-{time.astimezone(timezone.utc).strftime(PARTITION_FORMATS[period])}"
+
+
+def status_index(time: datetime) -> str:
+    return partition_index(config.es_index, time, config.es_index_partition)
+
+
+# Reads cover the partitions and the unpartitioned index written before them
+STATUS_READ_PATTERN = f"{config.es_index}*"
+
 
-def ensure_index_exists(index_name: str):
+def ensure_index_exists(index_name: str, mapping: dict):
     try:
         if not es.indices.exists(index=index_name):
-            mapping = {
-                "mappings": {
-                    "properties": {
-                        "location": {"type": "geo_point"},
-                        "vehicle": {"type": "keyword"},
-                        "altitude": {"type": "float"},
-                        "acceleration_magnitude": {"type": "float"},
-                        "velocity_magnitude": {"type": "float"},
-                        "time": {"type": "date"}
-                    }
-                }
-            }
             es.indices.create(index=index_name, body=mapping)
             logger.info(f"Created index '{index_name}' with mapping")
         else:
@@ -44,6 +170,17 @@ def ensure_index_exists(index_name: str):
         exit(1)
 
 
+def ensure_template_exists(base: str, mapping: dict):
+    """Every partition <base>-* is created with the mapping on its first write."""
+    try:
+        es.indices.put_index_template(name=base, index_patterns=[f"{base}-*"],
+                                      template={"mappings": mapping["mappings"]})
+        logger.info(f"Index template '{base}-*' is in place")
+    except Exception as e:
+        logger.error(f"Failed to put index template '{base}-*': {e}")
+        exit(1)
+
+
 class Vector(NamedTuple):
     x: float
     y: float
@@ -68,15 +205,25 @@ class VehicleStatus:
     location_freshness: int
     signal_strength: int
     battery_status: int
+    sequence: int | None = None
+
+
+# Payload layouts by size; newer firmware appends fields to the legacy 74-byte record
+PAYLOAD_FORMATS = {
+    74: "<BBBBBH3f3f3f3f3fBIBb",
+    76: "<BBBBBH3f3f3f3f3fBIBbH",   # + millisecond
+    80: "<BBBBBH3f3f3f3f3fBIBbHI",  # + sequence
+}
 
 
 def parse_payload(payload: bytes) -> VehicleStatus | None:
-    if len(payload) != 74:
+    payload_format = PAYLOAD_FORMATS.get(len(payload))
+    if payload_format is None:
         logger.warning(f"Unexpected payload size: {len(payload)} bytes")
         return None
 
     try:
-        data = struct.unpack("<BBBBBH3f3f3f3f3fBIBb", payload)
+        data = struct.unpack(payload_format, payload)
     except struct.error as e:
         logger.error(f"Payload deserialization failed: {e}")
         return None
@@ -91,9 +238,15 @@ def parse_payload(payload: bytes) -> VehicleStatus | None:
         logger.warning(f"Invalid signal_strength: {data[23]}")
         return None
 
+    millisecond = data[25] if len(data) > 25 else 0
+    if millisecond > 999:
+        logger.warning(f"Invalid millisecond: {millisecond}")
+        return None
+
     return VehicleStatus(
         time=datetime(second=data[0], minute=data[1], hour=data[2],
-                      day=data[3], month=data[4], year=data[5], tzinfo=LOCAL_TZ), #todo:timezone
+                      day=data[3], month=data[4], year=data[5],
+                      microsecond=millisecond * 1000, tzinfo=LOCAL_TZ), #todo:timezone
         acceleration=Vector(data[6], data[7], data[8]),
         velocity=Vector(data[9], data[10], data[11]),
         angular_velocity=Vector(data[12], data[13], data[14]),
@@ -102,13 +255,77 @@ def parse_payload(payload: bytes) -> VehicleStatus | None:
         is_location_dead_reckoned=bool(data[21]),
         location_freshness=data[22],
         signal_strength=data[23],
-        battery_status=data[24]
+        battery_status=data[24],
+        sequence=data[26] if len(data) > 26 else None
+    )
+
+
+# Mirrors MqttPayload::serializeTrip; times are UTC seconds since 2000-01-01
+TRIP_FORMAT = "<II4ffIf3H"
+TRIP_EPOCH = datetime(2000, 1, 1, tzinfo=timezone.utc)
+
+
+@dataclass
+class TripSummary:
+    start_time: datetime | None
+    end_time: datetime | None
+    start_location: Vector
+    end_location: Vector
+    distance: float
+    moving_time: int
+    max_speed: float
+    harsh_accelerations: int
+    harsh_brakings: int
+    harsh_cornerings: int
+
+
+def parse_trip_payload(payload: bytes) -> TripSummary | None:
+    if len(payload) != struct.calcsize(TRIP_FORMAT):
+        logger.warning(f"Unexpected trip payload size: {len(payload)} bytes")
+        return None
+
+    data = struct.unpack(TRIP_FORMAT, payload)
+
+    def to_time(seconds: int) -> datetime | None:
+        # 0 when the device clock was not set yet
+        return (TRIP_EPOCH + timedelta(seconds=seconds)).astimezone(LOCAL_TZ) if seconds else None
+
+    return TripSummary(
+        start_time=to_time(data[0]),
+        end_time=to_time(data[1]),
+        start_location=Vector(data[3], data[2], 0.0),
+        end_location=Vector(data[5], data[4], 0.0),
+        distance=data[6],
+        moving_time=data[7],
+        max_speed=data[8],
+        harsh_accelerations=data[9],
+        harsh_brakings=data[10],
+        harsh_cornerings=data[11],
     )
 
 
-def status_to_es_doc(status: VehicleStatus) -> dict:
+def trip_to_es_doc(vehicle: str, trip: TripSummary) -> dict:
     return {
         "message_arrival": datetime.now(LOCAL_TZ).isoformat(),
+        "vehicle": vehicle,
+        "start_time": trip.start_time.isoformat() if trip.start_time else None,
+        "end_time": trip.end_time.isoformat() if trip.end_time else None,
+        "duration_s": (trip.end_time - trip.start_time).total_seconds() if trip.start_time and trip.end_time else None,
+        "start_location": {"lat": trip.start_location.y, "lon": trip.start_location.x},
+        "end_location": {"lat": trip.end_location.y, "lon": trip.end_location.x},
+        "distance_m": trip.distance,
+        "moving_time_s": trip.moving_time,
+        "max_speed": trip.max_speed,
+        "average_speed": trip.distance / trip.moving_time if trip.moving_time else 0.0,
+        "harsh_accelerations": trip.harsh_accelerations,
+        "harsh_brakings": trip.harsh_brakings,
+        "harsh_cornerings": trip.harsh_cornerings,
+    }
+
+
+def status_to_es_doc(vehicle: str, status: VehicleStatus, arrival: datetime | None = None) -> dict:
+    doc = {
+        "message_arrival": (arrival or datetime.now(LOCAL_TZ)).isoformat(),
         "time": status.time.isoformat(),
         "acceleration": status.acceleration.to_dict(),
         "acceleration_magnitude": status.acceleration.magnitude(),
@@ -120,34 +337,158 @@ def status_to_es_doc(status: VehicleStatus) -> dict:
             "lat": status.location.y,
             "lon": status.location.x,
         },
-        "vehicle": "cps-tracer",
+        "vehicle": vehicle,
         "altitude": status.location.z,
         "is_location_dead_reckoned": status.is_location_dead_reckoned,
         "location_freshness": status.location_freshness,
         "signal_strength": status.signal_strength,
         "battery_status": status.battery_status,
     }
+    if status.sequence is not None:
+        doc["sequence"] = status.sequence
+    return doc
+
+
+def sequence_doc_id(vehicle: str, sequence: int) -> str:
+    """Id of the record a device sent under `sequence`, whichever channel carried it."""
+    return f"{vehicle}-{sequence}"
+
+
+def status_doc_id(vehicle: str, status: VehicleStatus) -> str:
+    """The same on the live path and in backfill.py, so either overwrites the other."""
+    if status.sequence is not None:
+        return sequence_doc_id(vehicle, status.sequence)
+    # Legacy firmware: keyed by device time
+    return f"{vehicle}-t{int(status.time.timestamp() * 1000)}"
+
+
+def index_status(vehicle: str, status: VehicleStatus, arrival: datetime, **extra):
+    rollup_store.update(vehicle, status.time, status.location.y, status.location.x,
+                        status.velocity.magnitude(), status.is_location_dead_reckoned)
+    try:
+        doc = status_to_es_doc(vehicle, status, arrival)
+        doc.update(extra)
+        # With a deterministic id a redelivered record overwrites itself; the
+        # partition follows the record's time, so it lands in the same index
+        es.index(index=status_index(status.time), id=status_doc_id(vehicle, status), document=doc)
+        logger.info(f"Data of {vehicle} indexed at {status.time.isoformat()}")
+    except Exception as e:
+        logger.exception(f"Failed to index data: {e}")
+
+
+rollup_store = RollupStore()
+
+
+def flush_rollups():
+    while True:
+        time.sleep(config.rollup_flush_interval)
+        changed = rollup_store.collect()
+        if not changed:
+            continue
+        actions = ({
+            "_index": partition_index(f"{config.es_rollup_index}-{bucket.resolution.name}", bucket.start, "monthly"),
+            "_id": bucket.id,
+            "_source": doc,
+        } for bucket, doc in changed)
+        try:
+            helpers.bulk(es, actions)
+        except Exception as e:
+            logger.exception(f"Failed to flush {len(changed)} rollups: {e}")
+            rollup_store.restore([bucket for bucket, _ in changed])
+        if rollup_store.late:
+            logger.warning(f"{rollup_store.late} records arrived too late to be rolled up")
+            rollup_store.late = 0
+
+
+live_store = LatestStateStore(
+    trail_length=config.live_trail_length,
+    cell_size=config.live_cell_size,
+    publish_interval=config.live_publish_interval,
+)
+
+
+def status_to_live_state(vehicle: str, status: VehicleStatus) -> VehicleState:
+    # Velocity is east/north/up
+    east, north = status.velocity.x, status.velocity.y
+    return VehicleState(
+        vehicle=vehicle,
+        time=status.time,
+        lat=status.location.y,
+        lon=status.location.x,
+        altitude=status.location.z,
+        speed=math.hypot(east, north),
+        heading=math.degrees(math.atan2(east, north)) % 360,
+        is_location_dead_reckoned=status.is_location_dead_reckoned,
+        signal_strength=status.signal_strength,
+        battery_status=status.battery_status,
+        trail=(),
+    )
+
+
+def on_release(vehicle: str, record: Released):
+    status, arrival = record.item
+    if record.gap:
+        stats = reorder_window.stats(vehicle)
+        logger.warning(f"{vehicle}: {record.gap} records missing before #{record.sequence} "
+                       f"(total gaps={stats.gaps}, duplicates={stats.duplicates}, late={stats.late})")
+    index_status(vehicle, status, arrival, sequence_gap=record.gap, is_late=record.late)
+
+
+reorder_window = ReorderWindow(
+    size=config.reorder_window_size,
+    timeout=config.reorder_timeout,
+    block_size=config.sequence_block_size,
+    on_release=on_release,
+)
+
+
+def flush_reorder_window():
+    while True:
+        time.sleep(1)
+        reorder_window.flush_expired()
+
+
+def subscriptions() -> list[str]:
+    topics = [config.mqtt_topic, config.mqtt_health_topic, config.mqtt_trip_topic, config.mqtt_blackbox_topic]
+    filters = [f"{topic}/+" for topic in topics]
+    # The bare topics of legacy firmware, unless a per-device filter already
+    # matches them (the broker may deliver once per matching subscription)
+    filters += [topic for topic in topics if not any(mqtt.topic_matches_sub(f, topic) for f in filters)]
+    return filters
 
 
 def on_connect(client, userdata, flags, reason_code, properties):
     if reason_code == 0:
         logger.info("Connected to MQTT broker")
-        client.subscribe(config.mqtt_topic)
-        logger.info(f"Subscribed to topic: {config.mqtt_topic}")
+        for topic in subscriptions():
+            client.subscribe(topic)
+            logger.info(f"Subscribed to topic: {topic}")
     else:
         logger.error(f"Connection failed with reason code {reason_code}")
 
 
+raw_archive = RawArchive(config.raw_archive_dir) if config.raw_archive_dir else None
+
+
 def on_message(client, userdata, msg):
 
     userdata
+    arrival = datetime.now(LOCAL_TZ)
+    vehicle = topic_vehicle(msg.topic, config.mqtt_topic)
+    # Archived before decoding, so a decoding fix can be replayed over history
+    if raw_archive:
+        try:
+            raw_archive.append(arrival, vehicle, msg.payload)
+        except OSError as e:
+            logger.error(f"Failed to archive payload: {e}")
+
     status = parse_payload(msg.payload)
 
     if not status:
         return
     
     logger.info(
-        f"New status @ {status.time.strftime('%Y-%m-%d %H:%M:%S')} | "
+        f"New status from {vehicle} @ {status.time.strftime('%Y-%m-%d %H:%M:%S.%f')[:-3]} | "
         f"Loc: ({status.location.x:.5f}, {status.location.y:.5f}, alt={status.location.z:.1f}m, "
         f"{'DR' if status.is_location_dead_reckoned else 'GNSS'}) | "
         f"Vel: |v|={status.velocity.magnitude():.2f} m/s | "
@@ -155,12 +496,90 @@ def on_message(client, userdata, msg):
         f"Sig: {status.signal_strength}% | Bat: {status.battery_status}"
     )
 
+    # The live view does not wait for the reorder window; stale records are ignored by time
+    live_store.update(status_to_live_state(vehicle, status))
+
+    if status.sequence is None:
+        # Legacy firmware: nothing to order by; its time-based id deduplicates
+        index_status(vehicle, status, arrival)
+    else:
+        reorder_window.push(vehicle, status.sequence, (status, arrival))
+
+
+def on_health_message(client, userdata, msg):
+
+    try:
+        report = json.loads(msg.payload)
+    except ValueError:
+        logger.warning(f"Invalid health report: {msg.payload!r}")
+        return
+
+    # Uptime is device relative; the report is stamped on arrival
+    report["time"] = datetime.now(LOCAL_TZ).isoformat()
+    report["vehicle"] = topic_vehicle(msg.topic, config.mqtt_health_topic)
+    logger.info(
+        f"Health from {report['vehicle']} | "
+        f"active={report.get('active_ms')}ms idle={report.get('idle_ms')}ms "
+        f"power_down={report.get('power_down_ms')}ms | avg={report.get('average_ma')}mA"
+    )
+
     try:
-        doc = status_to_es_doc(status)
-        es.index(index=config.es_index, document=doc)
-        logger.info(f"Data indexed at {status.time.isoformat()}")
+        es.index(index=config.es_health_index, document=report)
     except Exception as e:
-        logger.exception(f"Failed to index data: {e}")
+        logger.exception(f"Failed to index health report: {e}")
+
+
+def on_trip_message(client, userdata, msg):
+
+    trip = parse_trip_payload(msg.payload)
+    if not trip:
+        return
+
+    vehicle = topic_vehicle(msg.topic, config.mqtt_trip_topic)
+    logger.info(
+        f"Trip of {vehicle} {trip.start_time} -> {trip.end_time} | {trip.distance / 1000:.2f} km in {trip.moving_time} s | "
+        f"max {trip.max_speed:.1f} m/s | harsh acc/brk/corner "
+        f"{trip.harsh_accelerations}/{trip.harsh_brakings}/{trip.harsh_cornerings}"
+    )
+
+    # A trip is identified by its start, so a redelivered summary overwrites itself
+    doc_id = f"{vehicle}-{int(trip.start_time.timestamp())}" if trip.start_time else None
+    try:
+        es.index(index=config.es_trip_index, id=doc_id, document=trip_to_es_doc(vehicle, trip))
+    except Exception as e:
+        logger.exception(f"Failed to index trip summary: {e}")
+
+
+blackbox_assembler = BlackBoxAssembler(timeout=config.blackbox_timeout)
+
+
+def store_capture(capture: Capture):
+    doc = capture.to_es_doc()
+    logger.info(f"Black box capture {capture.id}: {doc['chunks_received']}/{doc['chunk_count']} chunks, "
+                f"peak {doc['peak_acceleration_g']:.2f} g")
+    try:
+        es.index(index=config.es_blackbox_index, id=capture.id, document=doc)
+    except Exception as e:
+        logger.exception(f"Failed to index black box capture: {e}")
+
+
+def on_blackbox_message(client, userdata, msg):
+
+    chunk = parse_chunk(msg.payload)
+    if not chunk:
+        logger.warning(f"Invalid black box chunk of {len(msg.payload)} bytes")
+        return
+
+    capture = blackbox_assembler.add(topic_vehicle(msg.topic, config.mqtt_blackbox_topic), chunk)
+    if capture:
+        store_capture(capture)
+
+
+def flush_blackbox_captures():
+    while True:
+        time.sleep(60)
+        for capture in blackbox_assembler.expire():
+            store_capture(capture)
 
 
 def on_disconnect(client, userdata, disconnect_flags, reason_code, properties):
@@ -169,7 +588,12 @@ def on_disconnect(client, userdata, disconnect_flags, reason_code, properties):
 
 # Main
 if __name__ == "__main__":
-    ensure_index_exists(config.es_index)
+    ensure_template_exists(config.es_index, STATUS_MAPPING)
+    ensure_template_exists(f"{config.es_rollup_index}-1m", ROLLUP_MAPPING)
+    ensure_template_exists(f"{config.es_rollup_index}-1h", ROLLUP_MAPPING)
+    ensure_index_exists(config.es_health_index, HEALTH_MAPPING)
+    ensure_index_exists(config.es_trip_index, TRIP_MAPPING)
+    ensure_index_exists(config.es_blackbox_index, BLACKBOX_MAPPING)
 
     client = mqtt.Client(
         client_id=config.mqtt_client_id,
@@ -178,6 +602,11 @@ if __name__ == "__main__":
     )
     client.on_connect = on_connect
     client.on_message = on_message
+    for topic, callback in ((config.mqtt_health_topic, on_health_message),
+                            (config.mqtt_trip_topic, on_trip_message),
+                            (config.mqtt_blackbox_topic, on_blackbox_message)):
+        client.message_callback_add(topic, callback)
+        client.message_callback_add(f"{topic}/+", callback)
     client.on_disconnect = on_disconnect
 
     try:
@@ -187,6 +616,11 @@ if __name__ == "__main__":
         logger.error(f"MQTT connection failed: {e}")
         exit(1)
 
+    threading.Thread(target=flush_reorder_window, daemon=True).start()
+    threading.Thread(target=flush_rollups, daemon=True).start()
+    threading.Thread(target=flush_blackbox_captures, daemon=True).start()
+    live_api.serve(live_store, config.live_api_port)
+
     logger.info("Starting MQTT loop")
     try:
         client.loop_forever(timeout=2, retry_first_connection=True)
@@ -0,0 +1,87 @@
+"""Pushes runtime settings to a device and waits for its acknowledgement.
+
+    python3 push_config.py vt --version 3 --gps-interval 2000 \\
+        --send-intervals 60000 150000 300000
+
+The settings are published retained (QoS 1) on <config topic>/<device>, so a
+device that is offline picks them up on its next connection. Every field that
+is not given gets the firmware default. The device checks the whole set
+(Settings.cpp), applies it only if the version is newer than the active one,
+and answers on <config ack topic>/<device>.
+"""
+import argparse
+import struct
+import sys
+import threading
+
+import paho.mqtt.client as mqtt
+from paho.mqtt.enums import CallbackAPIVersion
+
+from config import Config
+from sms import crc8
+
+SETTINGS_FORMAT = 1
+SETTINGS_STRUCT = struct.Struct("<BHHB3IBB")
+ACK_STRUCT = struct.Struct("<HHB")
+RESULTS = {0: "applied", 1: "unchanged", 2: "stale", 3: "invalid"}
+
+
+def build_payload(args) -> bytes:
+    body = SETTINGS_STRUCT.pack(
+        SETTINGS_FORMAT, args.version, args.gps_interval, args.mpu_interval,
+        *args.send_intervals, args.stable_successes, args.unstable_misses,
+    )
+    return body + bytes([crc8(body)])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("device", help="device MQTT client id")
+    parser.add_argument("--version", type=int, required=True, help="must be above the active version to apply")
+    parser.add_argument("--gps-interval", type=int, default=1000, help="ms, 200..60000")
+    parser.add_argument("--mpu-interval", type=int, default=20, help="ms, 10..50")
+    parser.add_argument("--send-intervals", type=int, nargs=3, default=[30000, 150000, 300000],
+                        metavar=("STABLE", "DEGRADED", "UNSTABLE"), help="ms, 5000..3600000, non-decreasing")
+    parser.add_argument("--stable-successes", type=int, default=20)
+    parser.add_argument("--unstable-misses", type=int, default=3)
+    parser.add_argument("--timeout", type=float, default=60, help="s to wait for the ack")
+    args = parser.parse_args()
+
+    config = Config()
+    config_topic = f"{config.mqtt_config_topic}/{args.device}"
+    ack_topic = f"{config.mqtt_config_ack_topic}/{args.device}"
+    payload = build_payload(args)
+    acked = threading.Event()
+
+    def on_connect(client, userdata, flags, reason_code, properties):
+        client.subscribe(ack_topic, qos=1)
+        client.publish(config_topic, payload, qos=1, retain=True)
+        print(f"published settings version {args.version} to {config_topic}")
+
+    def on_message(client, userdata, msg):
+        if len(msg.payload) != ACK_STRUCT.size:
+            return
+        requested, active, result = ACK_STRUCT.unpack(msg.payload)
+        print(f"device {args.device}: version {requested} {RESULTS.get(result, result)}, active version {active}")
+        if requested == args.version:
+            acked.set()
+
+    client = mqtt.Client(
+        client_id=f"{config.mqtt_client_id}-config",
+        protocol=mqtt.MQTTv311,
+        callback_api_version=CallbackAPIVersion.VERSION2,
+    )
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(config.mqtt_server, config.mqtt_port)
+    client.loop_start()
+    try:
+        if not acked.wait(args.timeout):
+            sys.exit("no ack yet; the retained settings apply when the device reconnects")
+    finally:
+        client.loop_stop()
+        client.disconnect()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,166 @@
+import threading
+import time
+from collections import deque
+from dataclasses import dataclass, field
+from typing import Any, Callable
+
+
+@dataclass
+class Released:
+    sequence: int
+    item: Any
+    gap: int        # sequence numbers skipped right before this one
+    late: bool      # filled a gap that had already been given up on
+
+
+@dataclass
+class LinkStats:
+    received: int = 0
+    duplicates: int = 0
+    gaps: int = 0
+    late: int = 0
+    restarts: int = 0
+
+
+@dataclass
+class _VehicleWindow:
+    next_sequence: int | None = None
+    pending: dict[int, tuple[float, Any]] = field(default_factory=dict)
+    missing: set[int] = field(default_factory=set)
+    released: set[int] = field(default_factory=set)
+    release_order: deque[int] = field(default_factory=deque)
+    stats: LinkStats = field(default_factory=LinkStats)
+
+
+class ReorderWindow:
+    """Per-vehicle reorder and dedup buffer keyed by the device sequence number.
+
+    Records are released in sequence order. A record that arrives ahead of a
+    missing one is held until the hole is filled, the window holds `size`
+    records, or the oldest held record waited `timeout` seconds; the hole is
+    then counted as a gap. The first records after a service start are held
+    the same way, so one that overtook its predecessor does not fix the
+    starting point.
+
+    Only numbers among the last `size` released are dropped as duplicates.
+    Anything else below the released position is released as late: document
+    ids derive from the sequence number, so indexing a record twice is
+    harmless while dropping one is not. A number more than `size` behind
+    that was never seen is taken as a device that lost its stored sequence;
+    whatever is held is flushed and numbering starts over from it.
+    """
+
+    def __init__(self, size: int, timeout: float, block_size: int,
+                 on_release: Callable[[str, Released], None], clock: Callable[[], float] = time.monotonic):
+        self.size = size
+        self.timeout = timeout
+        self.block_size = block_size
+        self.on_release = on_release
+        self.clock = clock
+        self.vehicles: dict[str, _VehicleWindow] = {}
+        self.lock = threading.Lock()
+
+    def push(self, vehicle: str, sequence: int, item: Any) -> None:
+        with self.lock:
+            released = self._push(vehicle, sequence, item)
+        for record in released:
+            self.on_release(vehicle, record)
+
+    def flush_expired(self) -> None:
+        now = self.clock()
+        with self.lock:
+            released = {vehicle: self._drain(window, now) for vehicle, window in self.vehicles.items()}
+        for vehicle, records in released.items():
+            for record in records:
+                self.on_release(vehicle, record)
+
+    def stats(self, vehicle: str) -> LinkStats:
+        with self.lock:
+            window = self.vehicles.get(vehicle)
+            return LinkStats(**vars(window.stats)) if window else LinkStats()
+
+    def _push(self, vehicle: str, sequence: int, item: Any) -> list[Released]:
+        window = self.vehicles.setdefault(vehicle, _VehicleWindow())
+        window.stats.received += 1
+        now = self.clock()
+
+        if window.next_sequence is not None and sequence < window.next_sequence:
+            if sequence in window.missing:
+                window.missing.discard(sequence)
+                window.stats.late += 1
+                window.stats.gaps -= 1
+                return [self._release(window, sequence, item, 0, True)] + self._drain(window, now)
+            if sequence in window.released:
+                window.stats.duplicates += 1
+                return self._drain(window, now)
+            if window.next_sequence - sequence <= self.size:
+                # Released too long ago to remember, or never seen; indexing it again is idempotent
+                window.stats.late += 1
+                return [self._release(window, sequence, item, 0, True)] + self._drain(window, now)
+
+            # Far behind anything seen: the device lost its stored sequence
+            window.stats.restarts += 1
+            released = self._drain(window, now, flush=True)
+            window.next_sequence = sequence
+            window.missing.clear()
+            window.released.clear()
+            window.release_order.clear()
+            window.pending[sequence] = (now, item)
+            return released + self._drain(window, now)
+
+        if sequence in window.pending:
+            window.stats.duplicates += 1
+            return self._drain(window, now)
+
+        window.pending[sequence] = (now, item)
+        return self._drain(window, now)
+
+    def _release(self, window: _VehicleWindow, sequence: int, item: Any, gap: int, late: bool) -> Released:
+        window.released.add(sequence)
+        window.release_order.append(sequence)
+        if len(window.release_order) > self.size:
+            window.released.discard(window.release_order.popleft())
+        return Released(sequence, item, gap, late)
+
+    def _resume_point(self, last: int) -> int:
+        """Where a device resumes after a reboot that followed `last`.
+
+        The device reserves numbers in blocks and restarts at the end of the
+        block it had reserved, so the unused rest of that block is not lost
+        traffic. A jump anywhere else, including to a later block start, is.
+        """
+        return (last // self.block_size + 1) * self.block_size
+
+    def _drain(self, window: _VehicleWindow, now: float, flush: bool = False) -> list[Released]:
+        released = []
+        while window.pending:
+            if window.next_sequence in window.pending:
+                _, item = window.pending.pop(window.next_sequence)
+                released.append(self._release(window, window.next_sequence, item, 0, False))
+                window.next_sequence += 1
+                continue
+
+            lowest = min(window.pending)
+            oldest = min(arrival for arrival, _ in window.pending.values())
+            if not flush and len(window.pending) < self.size and now - oldest < self.timeout:
+                break
+
+            if window.next_sequence is None:
+                # First records since the service started: begin at the lowest held
+                window.next_sequence = lowest
+                continue
+
+            gap = lowest - window.next_sequence
+            if lowest == self._resume_point(window.next_sequence - 1):
+                window.stats.restarts += 1
+                gap = 0
+            else:
+                window.stats.gaps += gap
+                window.missing.update(range(window.next_sequence, lowest))
+                if len(window.missing) > self.block_size:
+                    window.missing = set(sorted(window.missing)[-self.block_size:])
+
+            _, item = window.pending.pop(lowest)
+            released.append(self._release(window, lowest, item, gap, False))
+            window.next_sequence = lowest + 1
+        return released
@@ -0,0 +1,168 @@
+"""Streaming per-vehicle rollups of the status stream.
+
+Every record is folded into a 1-minute and a 1-hour bucket of its vehicle:
+record and dead-reckoned counts, distance driven, speed min/max/mean and the
+bounding box. Buckets are flushed as whole documents with a deterministic id,
+so a bucket that keeps changing is simply rewritten on the next flush.
+Closed buckets stay in memory for a while to absorb records that arrive late;
+a record older than that is not rolled up.
+"""
+import math
+import threading
+from dataclasses import dataclass, field
+from datetime import datetime, timedelta, timezone
+
+EARTH_RADIUS = 6371000.0  # m
+
+# Consecutive records further apart than this are not joined into distance
+MAX_DISTANCE_GAP = timedelta(minutes=10)
+
+
+@dataclass(frozen=True)
+class Resolution:
+    name: str
+    length: timedelta
+    retention: timedelta      # how long a closed bucket still accepts late records
+
+
+RESOLUTIONS = (
+    Resolution("1m", timedelta(minutes=1), timedelta(hours=2)),
+    Resolution("1h", timedelta(hours=1), timedelta(days=2)),
+)
+
+
+@dataclass
+class Bucket:
+    vehicle: str
+    resolution: Resolution
+    start: datetime
+    count: int = 0
+    dead_reckoned: int = 0
+    distance: float = 0.0
+    speed_min: float = math.inf
+    speed_max: float = 0.0
+    speed_sum: float = 0.0
+    min_lat: float = math.inf
+    max_lat: float = -math.inf
+    min_lon: float = math.inf
+    max_lon: float = -math.inf
+    first_time: datetime | None = None
+    last_time: datetime | None = None
+    last_location: tuple[float, float] = (0.0, 0.0)
+    dirty: bool = True
+
+    def add(self, time: datetime, lat: float, lon: float, speed: float, dead_reckoned: bool, distance: float):
+        self.count += 1
+        self.dead_reckoned += dead_reckoned
+        self.distance += distance
+        self.speed_min = min(self.speed_min, speed)
+        self.speed_max = max(self.speed_max, speed)
+        self.speed_sum += speed
+        self.min_lat, self.max_lat = min(self.min_lat, lat), max(self.max_lat, lat)
+        self.min_lon, self.max_lon = min(self.min_lon, lon), max(self.max_lon, lon)
+        if self.first_time is None or time < self.first_time:
+            self.first_time = time
+        if self.last_time is None or time >= self.last_time:
+            self.last_time = time
+            self.last_location = (lat, lon)
+        self.dirty = True
+
+    @property
+    def id(self) -> str:
+        return f"{self.vehicle}-{self.resolution.name}-{int(self.start.timestamp())}"
+
+    def to_es_doc(self) -> dict:
+        return {
+            "vehicle": self.vehicle,
+            "resolution": self.resolution.name,
+            "bucket_start": self.start.isoformat(),
+            "bucket_end": (self.start + self.resolution.length).isoformat(),
+            "first_time": self.first_time.isoformat(),
+            "last_time": self.last_time.isoformat(),
+            "count": self.count,
+            "dead_reckoned_count": self.dead_reckoned,
+            "distance_m": self.distance,
+            "speed_min": self.speed_min,
+            "speed_max": self.speed_max,
+            "speed_avg": self.speed_sum / self.count,
+            "bbox_top_left": {"lat": self.max_lat, "lon": self.min_lon},
+            "bbox_bottom_right": {"lat": self.min_lat, "lon": self.max_lon},
+            "location": {"lat": self.last_location[0], "lon": self.last_location[1]},
+        }
+
+
+def bucket_start(time: datetime, length: timedelta) -> datetime:
+    utc = time.astimezone(timezone.utc)
+    seconds = int(length.total_seconds())
+    epoch = int(utc.timestamp())
+    return datetime.fromtimestamp(epoch - epoch % seconds, timezone.utc)
+
+
+def distance(a: tuple[float, float], b: tuple[float, float]) -> float:
+    north = math.radians(b[0] - a[0]) * EARTH_RADIUS
+    east = math.radians(b[1] - a[1]) * EARTH_RADIUS * math.cos(math.radians(a[0]))
+    return math.hypot(east, north)
+
+
+@dataclass
+class VehicleRollups:
+    last_time: datetime | None = None
+    last_location: tuple[float, float] | None = None
+    buckets: dict[tuple[str, datetime], Bucket] = field(default_factory=dict)
+
+
+class RollupStore:
+    def __init__(self, resolutions: tuple[Resolution, ...] = RESOLUTIONS):
+        self.resolutions = resolutions
+        self.vehicles: dict[str, VehicleRollups] = {}
+        self.lock = threading.Lock()
+        self.late = 0
+
+    def update(self, vehicle: str, time: datetime, lat: float, lon: float, speed: float, dead_reckoned: bool):
+        """Folds one record in; records are expected in time order per vehicle."""
+        with self.lock:
+            state = self.vehicles.setdefault(vehicle, VehicleRollups())
+
+            step = 0.0
+            if state.last_time is not None and state.last_location is not None:
+                # Distance is the path from the previous record; an older record adds none
+                if timedelta(0) < time - state.last_time <= MAX_DISTANCE_GAP:
+                    step = distance(state.last_location, (lat, lon))
+            if state.last_time is None or time >= state.last_time:
+                state.last_time = time
+                state.last_location = (lat, lon)
+
+            for resolution in self.resolutions:
+                start = bucket_start(time, resolution.length)
+                bucket = state.buckets.get((resolution.name, start))
+                if bucket is None:
+                    if state.last_time - (start + resolution.length) > resolution.retention:
+                        self.late += 1
+                        continue
+                    bucket = Bucket(vehicle, resolution, start)
+                    state.buckets[(resolution.name, start)] = bucket
+                bucket.add(time, lat, lon, speed, dead_reckoned, step)
+
+    def collect(self) -> list[tuple[Bucket, dict]]:
+        """Buckets changed since the last call with their documents.
+
+        A bucket past its retention is dropped only once it is clean, i.e. the
+        flush that took its last change went through; a failed flush hands it
+        back through restore() and it is collected again.
+        """
+        changed = []
+        with self.lock:
+            for state in self.vehicles.values():
+                for key, bucket in list(state.buckets.items()):
+                    if bucket.dirty:
+                        bucket.dirty = False
+                        changed.append((bucket, bucket.to_es_doc()))
+                    elif state.last_time - (bucket.start + bucket.resolution.length) > bucket.resolution.retention:
+                        del state.buckets[key]
+        return changed
+
+    def restore(self, buckets: list[Bucket]):
+        """Marks buckets whose flush failed as changed again."""
+        with self.lock:
+            for bucket in buckets:
+                bucket.dirty = True
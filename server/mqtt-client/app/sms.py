@@ -0,0 +1,98 @@
+import base64
+import struct
+from dataclasses import dataclass
+from datetime import datetime, timedelta, tzinfo
+
+# Mirrors edge-device/src/SmsPacker.h
+SMS_PACKED_VERSION = 2
+SMS_HEADER_FORMAT = "<BIIiibb"
+SMS_HEADER_SIZE = struct.calcsize(SMS_HEADER_FORMAT)
+SMS_EPOCH = datetime(2000, 1, 1)
+
+
+@dataclass
+class PackedFix:
+    time: datetime
+    sequence: int
+    latitude: float
+    longitude: float
+    speed: float
+    is_location_dead_reckoned: bool
+    battery_status: int
+    signal_strength: int
+
+
+def crc8(data: bytes) -> int:
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def _read_varint(data: bytes, offset: int) -> tuple[int, int]:
+    value = shift = 0
+    while True:
+        if offset >= len(data):
+            raise ValueError("truncated varint")
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, offset
+
+
+def _unzigzag(value: int) -> int:
+    return (value >> 1) ^ -(value & 1)
+
+
+def decode_packed_sms(text: str, tz: tzinfo) -> list[PackedFix]:
+    """Rebuilds the track of a packed SMS; raises ValueError if it is not one."""
+    try:
+        data = base64.b64decode(text.strip(), validate=True)
+    except ValueError as e:
+        raise ValueError(f"not base64: {e}")
+
+    if len(data) < SMS_HEADER_SIZE + 1:
+        raise ValueError("too short")
+    if crc8(data[:-1]) != data[-1]:
+        raise ValueError("checksum mismatch")
+
+    version, time, sequence, latitude, longitude, battery, signal = struct.unpack_from(SMS_HEADER_FORMAT, data)
+    if version != SMS_PACKED_VERSION:
+        raise ValueError(f"unsupported version {version}")
+    if time == 0:
+        # The device only packs fixes with a synced clock; 0 is 2000-01-01
+        raise ValueError("no device time")
+
+    fixes = []
+    offset = SMS_HEADER_SIZE
+    body_end = len(data) - 1
+    while offset < body_end:
+        dt, offset = _read_varint(data, offset)
+        dseq, offset = _read_varint(data, offset)
+        dlat, offset = _read_varint(data, offset)
+        dlon, offset = _read_varint(data, offset)
+        if offset >= body_end:
+            raise ValueError("truncated fix")
+        speed = data[offset]
+        offset += 1
+
+        time = (time + dt) & 0xFFFFFFFF  # u32 on the device
+        sequence = (sequence + dseq) & 0xFFFFFFFF
+        latitude += _unzigzag(dlat)
+        longitude += _unzigzag(dlon)
+        fixes.append(PackedFix(
+            time=(SMS_EPOCH + timedelta(seconds=time)).replace(tzinfo=tz),
+            sequence=sequence,
+            latitude=latitude / 100000,
+            longitude=longitude / 100000,
+            speed=(speed & 0x7F) / 2,
+            is_location_dead_reckoned=bool(speed & 0x80),
+            battery_status=battery,
+            signal_strength=signal,
+        ))
+
+    return fixes
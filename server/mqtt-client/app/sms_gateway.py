@@ -0,0 +1,112 @@
+"""Local stand-in for an SMS gateway webhook.
+
+Accepts POST /sms with either form fields or JSON ({"from": ..., "text": ...}),
+decodes packed fallback SMS from the devices and indexes every fix they carry.
+Requests must carry "Authorization: Bearer <SMS_GATEWAY_SECRET>". A fix is
+keyed by vehicle and sequence number like its MQTT copy. It is only created
+if neither that copy nor an earlier delivery of the SMS is stored, so the
+richer MQTT record is never overwritten. The vehicle is looked up by sender
+number in SMS_SENDERS.
+"""
+import hmac
+import json
+from datetime import datetime
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs
+
+from elasticsearch import helpers
+
+from main import LOCAL_TZ, STATUS_MAPPING, config, ensure_template_exists, es, logger, sequence_doc_id, status_index
+from sms import PackedFix, decode_packed_sms
+
+
+def fix_to_es_doc(vehicle: str, fix: PackedFix, sender: str) -> dict:
+    return {
+        "message_arrival": datetime.now(LOCAL_TZ).isoformat(),
+        "time": fix.time.isoformat(),
+        "location": {
+            "lat": fix.latitude,
+            "lon": fix.longitude,
+        },
+        "vehicle": vehicle,
+        "sequence": fix.sequence,
+        "velocity_magnitude": fix.speed,
+        "is_location_dead_reckoned": fix.is_location_dead_reckoned,
+        "signal_strength": fix.signal_strength,
+        "battery_status": fix.battery_status,
+        "channel": "sms",
+        "sms_sender": sender,
+    }
+
+
+def handle_sms(sender: str, text: str) -> int:
+    fixes = decode_packed_sms(text, LOCAL_TZ)
+    vehicle = config.sms_senders.get(sender, sender)
+    actions = ({
+        "_op_type": "create",
+        "_index": status_index(fix.time),
+        "_id": sequence_doc_id(vehicle, fix.sequence),
+        "_source": fix_to_es_doc(vehicle, fix, sender),
+    } for fix in fixes)
+    created, errors = helpers.bulk(es, actions, raise_on_error=False)
+    failed = [e for e in errors if e.get("create", {}).get("status") != 409]
+    if failed:
+        raise RuntimeError(f"{len(failed)} fixes not indexed: {failed[0]}")
+    logger.info(f"Indexed {created} of {len(fixes)} fixes of {vehicle} from SMS of {sender}, "
+                f"{len(fixes) - created} already stored")
+    return created
+
+
+def is_authorized(header: str) -> bool:
+    expected = f"Bearer {config.sms_gateway_secret}"
+    return hmac.compare_digest(header.encode(), expected.encode())
+
+
+class SmsHandler(BaseHTTPRequestHandler):
+
+    def do_POST(self):
+        if self.path != "/sms":
+            self.send_error(404)
+            return
+        if not is_authorized(self.headers.get("Authorization", "")):
+            logger.warning(f"Rejected unauthorized SMS request from {self.client_address[0]}")
+            self.send_error(401)
+            return
+
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0))).decode()
+        if self.headers.get("Content-Type", "").startswith("application/json"):
+            message = json.loads(body)
+        else:
+            message = {key: values[0] for key, values in parse_qs(body).items()}
+
+        try:
+            count = handle_sms(message.get("from", ""), message.get("text", ""))
+        except ValueError as e:
+            logger.warning(f"Rejected SMS: {e}")
+            self.send_error(400, str(e))
+            return
+        except Exception as e:
+            logger.exception(f"Failed to index SMS: {e}")
+            self.send_error(502)
+            return
+
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.end_headers()
+        self.wfile.write(json.dumps({"fixes": count}).encode())
+
+    def log_message(self, format, *args):
+        logger.debug(format % args)
+
+
+if __name__ == "__main__":
+    if not config.sms_gateway_secret:
+        logger.error("SMS_GATEWAY_SECRET is not set")
+        raise SystemExit(1)
+    ensure_template_exists(config.es_index, STATUS_MAPPING)
+    server = ThreadingHTTPServer((config.sms_gateway_host, config.sms_gateway_port), SmsHandler)
+    logger.info(f"SMS gateway listening on {config.sms_gateway_host}:{config.sms_gateway_port}")
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        server.shutdown()
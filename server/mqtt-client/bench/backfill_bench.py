@@ -0,0 +1,162 @@
+"""Throughput and resume check of the backfill tool (app/backfill.py).
+
+    python3 bench/backfill_bench.py --records 200000 --streams 1 2 4 8 --write-delay 0.02
+
+Writes a synthetic raw archive (80-byte sequenced records over several days,
+with a share of undecodable payloads and a record cut short at the end of the
+last file) and runs the tool against the in-process Elasticsearch stand-in
+(bench/es_standin.py), whose write delay stands in for a cluster's service
+time per bulk request. Every run reports wall time and indexing throughput
+and checks that each decodable record was indexed exactly once, by its
+sequence number.
+
+The resume check makes the stand-in fail once part of the archive is written,
+so the first run stops, then reruns with the same checkpoint and reports how
+many records were written twice (the batches in flight at the failure).
+"""
+import argparse
+import os
+import random
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+from datetime import datetime, timedelta
+from pathlib import Path
+from zoneinfo import ZoneInfo
+
+import es_standin
+
+APP = Path(__file__).resolve().parent.parent / "app"
+sys.path.insert(0, str(APP))
+from archive import encode_record  # noqa: E402
+
+BACKFILL = APP / "backfill.py"
+LOCAL_TZ = ZoneInfo("Asia/Tehran")
+STATUS_FORMAT = struct.Struct("<BBBBBH3f3f3f3f3fBIBbHI")  # PAYLOAD_FORMATS[80] in app/main.py
+STATUS_INDEX = "bench-backfill"
+VEHICLE = "bench-0"
+RECORDS_PER_FILE = 86400 // 5  # one day at a 5 s report interval
+
+
+def status_payload(time: datetime, sequence: int, rng: random.Random) -> bytes:
+    return STATUS_FORMAT.pack(
+        time.second, time.minute, time.hour, time.day, time.month, time.year,
+        *(rng.uniform(-1, 1) for _ in range(3)),
+        rng.uniform(0, 20), rng.uniform(0, 20), 0.0,
+        *(rng.uniform(-5, 5) for _ in range(3)),
+        *(rng.uniform(-180, 180) for _ in range(3)),
+        51.39 + rng.uniform(-0.1, 0.1), 35.70 + rng.uniform(-0.1, 0.1), 1190.0,
+        rng.random() < 0.1, rng.randint(0, 60000), rng.randint(30, 90), rng.randint(-1, 100),
+        time.microsecond // 1000, sequence,
+    )
+
+
+def write_archive(directory: Path, records: int, invalid_share: float) -> tuple[list[Path], set[int]]:
+    """Archive files and the sequence numbers of their decodable records."""
+    rng = random.Random(1)
+    start = datetime(2026, 1, 1, tzinfo=LOCAL_TZ)
+    paths, valid = [], set()
+    file = None
+    for sequence in range(records):
+        if sequence % RECORDS_PER_FILE == 0:
+            if file:
+                file.close()
+            path = directory / f"status-{(start + timedelta(days=len(paths))).strftime('%Y-%m-%d')}.bin"
+            paths.append(path)
+            file = open(path, "wb")
+        time = start + timedelta(seconds=5 * sequence)
+        if rng.random() < invalid_share:
+            payload = bytes(rng.randrange(256) for _ in range(rng.choice([12, 74, 80])))
+            payload = b"\xff" + payload[1:]  # seconds out of range
+        else:
+            payload = status_payload(time, sequence, rng)
+            valid.add(sequence)
+        file.write(encode_record(time.timestamp(), VEHICLE, payload))
+    # A record cut short by a crash of the writer
+    file.write(encode_record(0.0, VEHICLE, b"\x00" * 80)[:20])
+    file.close()
+    return paths, valid
+
+
+class Receiver:
+    def __init__(self, fail_after: int | None = None):
+        self.lock = threading.Lock()
+        self.sequences: dict[int, int] = {}
+        self.documents = 0
+        self.fail_after = fail_after
+
+    def on_document(self, index: str, doc: dict, arrival: float):
+        if not index.startswith(STATUS_INDEX):
+            return
+        with self.lock:
+            if self.fail_after is not None and self.documents >= self.fail_after:
+                raise ConnectionResetError("stand-in failure")
+            self.documents += 1
+            self.sequences[doc["sequence"]] = self.sequences.get(doc["sequence"], 0) + 1
+
+
+def run_backfill(paths: list[Path], receiver: Receiver, args, streams: int, checkpoint: Path,
+                 retries: int) -> tuple[int, float]:
+    server = es_standin.serve(receiver.on_document, args.write_delay)
+    env = dict(os.environ, ES_HOST=f"http://127.0.0.1:{server.server_port}", ES_INDEX=STATUS_INDEX,
+               ES_USER="", ES_PASSWORD="", ES_CA_CERT="", RAW_ARCHIVE_DIR="")
+    started = time.monotonic()
+    result = subprocess.run(
+        [sys.executable, str(BACKFILL), *map(str, paths), "--workers", str(args.workers),
+         "--streams", str(streams), "--batch", str(args.batch), "--retries", str(retries),
+         "--checkpoint", str(checkpoint), "--report", "5"],
+        env=env, cwd=APP, capture_output=not args.verbose, text=True,
+    )
+    elapsed = time.monotonic() - started
+    server.shutdown()
+    if result.returncode and not args.verbose and retries:
+        print(result.stderr[-2000:])
+    return result.returncode, elapsed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--records", type=int, default=100000)
+    parser.add_argument("--invalid", type=float, default=0.01, help="share of undecodable payloads")
+    parser.add_argument("--streams", type=int, nargs="+", default=[1, 2, 4, 8])
+    parser.add_argument("--workers", type=int, default=os.cpu_count() or 1)
+    parser.add_argument("--batch", type=int, default=1000)
+    parser.add_argument("--write-delay", type=float, default=0.02, help="s per bulk request at the stand-in")
+    parser.add_argument("--verbose", action="store_true", help="show the tool's log")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as directory:
+        directory = Path(directory)
+        paths, valid = write_archive(directory, args.records, args.invalid)
+        print(f"{args.records} records in {len(paths)} files, {len(valid)} decodable, "
+              f"batches of {args.batch}, {args.workers} workers, {args.write_delay * 1000:.0f} ms per bulk")
+
+        print(f"{'streams':>8}{'time s':>10}{'docs/s':>10}{'missing':>9}{'twice':>7}")
+        for streams in args.streams:
+            receiver = Receiver()
+            checkpoint = directory / f"checkpoint-{streams}.json"
+            code, elapsed = run_backfill(paths, receiver, args, streams, checkpoint, retries=2)
+            missing = len(valid - receiver.sequences.keys())
+            twice = sum(1 for count in receiver.sequences.values() if count > 1)
+            status = "" if code == 0 else f"  exit {code}"
+            print(f"{streams:>8}{elapsed:>10.2f}{len(receiver.sequences) / elapsed:>10.0f}{missing:>9}{twice:>7}{status}")
+
+        # Resume: fail half way, then rerun from the checkpoint
+        streams = max(args.streams)
+        checkpoint = directory / "checkpoint-resume.json"
+        receiver = Receiver(fail_after=len(valid) // 2)
+        first, _ = run_backfill(paths, receiver, args, streams, checkpoint, retries=0)
+        written = dict(receiver.sequences)
+        receiver.fail_after = None
+        second, _ = run_backfill(paths, receiver, args, streams, checkpoint, retries=2)
+        missing = len(valid - receiver.sequences.keys())
+        twice = sum(1 for count in receiver.sequences.values() if count > 1)
+        print(f"resume: first run exit {first} after {len(written)} records, second run exit {second}, "
+              f"{missing} missing, {twice} written twice")
+
+
+if __name__ == "__main__":
+    main()
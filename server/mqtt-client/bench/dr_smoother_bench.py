@@ -0,0 +1,162 @@
+"""Accuracy and speed of the dead-reckoning correction (app/dr_smoother.py).
+
+    python3 bench/dr_smoother_bench.py                       # synthetic fleet
+    python3 bench/dr_smoother_bench.py --trace status.jsonl  # recorded tracks
+
+GNSS outages are cut into tracks whose true positions are known, and the
+records inside them are replaced by what the device reports while dead
+reckoning: the last fix plus an IMU displacement that drifts through an
+accelerometer bias and a velocity error at the start of the outage. The fix
+that ends the outage carries GNSS noise.
+
+The error against the true track is reported for the uncorrected segment
+(what the device leaves behind) and for each drift order, together with the
+correction throughput on one core.
+
+A recorded trace is one status document per line as indexed in
+vehicle-status (e.g. an export of _source). Its GNSS records serve as the
+true track; records that were already dead-reckoned are dropped.
+"""
+import argparse
+import json
+import math
+import random
+import sys
+import time
+from datetime import datetime
+from pathlib import Path
+
+sys.path.insert(0, str(Path(__file__).resolve().parent.parent / "app"))
+
+from dr_smoother import EARTH_RADIUS, Segment, TrackPoint, correct_segment, distance, find_segments  # noqa: E402
+
+GNSS_NOISE = 3.0  # m
+
+
+def synthetic_track(rng: random.Random, length: int, interval: float) -> list[TrackPoint]:
+    lat, lon = 35.70 + rng.uniform(-0.1, 0.1), 51.39 + rng.uniform(-0.1, 0.1)
+    heading, speed = rng.uniform(0, 2 * math.pi), rng.uniform(0, 20)
+    track = []
+    for i in range(length):
+        heading += rng.gauss(0, 0.15)
+        speed = min(30.0, max(0.0, speed + rng.gauss(0, 1.0)))
+        east, north = speed * math.sin(heading), speed * math.cos(heading)
+        lat += math.degrees(north * interval / EARTH_RADIUS)
+        lon += math.degrees(east * interval / (EARTH_RADIUS * math.cos(math.radians(lat))))
+        track.append(TrackPoint(time=i * interval, lat=lat, lon=lon, alt=1190.0, east=east, north=north))
+    return track
+
+
+def recorded_tracks(path: Path) -> list[list[TrackPoint]]:
+    vehicles: dict[str, list[TrackPoint]] = {}
+    with path.open() as lines:
+        for line in lines:
+            if not line.strip():
+                continue
+            doc = json.loads(line)
+            doc = doc.get("_source", doc)
+            if doc.get("is_location_dead_reckoned") or "location" not in doc:
+                continue
+            velocity = doc.get("velocity") or {}
+            vehicles.setdefault(doc.get("vehicle", ""), []).append(TrackPoint(
+                time=datetime.fromisoformat(doc["time"]).timestamp(),
+                lat=doc["location"]["lat"], lon=doc["location"]["lon"], alt=doc.get("altitude", 0.0),
+                east=velocity.get("x"), north=velocity.get("y"),
+            ))
+    return [sorted(track, key=lambda point: point.time) for track in vehicles.values()]
+
+
+def shift(point: TrackPoint, east: float, north: float) -> tuple[float, float]:
+    lat = point.lat + math.degrees(north / EARTH_RADIUS)
+    lon = point.lon + math.degrees(east / (EARTH_RADIUS * math.cos(math.radians(point.lat))))
+    return lat, lon
+
+
+def cut_outages(rng: random.Random, truth: list[TrackPoint], outage_rate: float, bias: float,
+                velocity_error: float) -> tuple[list[TrackPoint], dict[int, TrackPoint]]:
+    """Observed track with dead-reckoned outages, and the true point of every dead-reckoned record by id()."""
+    observed: list[TrackPoint] = []
+    hidden: dict[int, TrackPoint] = {}
+    i = 0
+    while i < len(truth):
+        point = truth[i]
+        if observed and not observed[-1].dead_reckoned and i < len(truth) - 1 and rng.random() < outage_rate:
+            fix = observed[-1]
+            true_fix = truth[i - 1]
+            length = rng.randint(3, 40)
+            bias_e, bias_n = rng.gauss(0, bias), rng.gauss(0, bias)
+            error_e, error_n = rng.gauss(0, velocity_error), rng.gauss(0, velocity_error)
+            for j in range(i, min(i + length, len(truth) - 1)):
+                true = truth[j]
+                tau = true.time - true_fix.time
+                # The IMU displacement is taken from the last fix, drift included
+                east = math.radians(true.lon - true_fix.lon) * EARTH_RADIUS * math.cos(math.radians(true_fix.lat))
+                north = math.radians(true.lat - true_fix.lat) * EARTH_RADIUS
+                east += error_e * tau + 0.5 * bias_e * tau * tau
+                north += error_n * tau + 0.5 * bias_n * tau * tau
+                lat, lon = shift(fix, east, north)
+                east_v = true.east + error_e + bias_e * tau if true.east is not None else None
+                north_v = true.north + error_n + bias_n * tau if true.north is not None else None
+                reported = TrackPoint(time=true.time, lat=lat, lon=lon, alt=true.alt, east=east_v, north=north_v,
+                                      dead_reckoned=True, freshness=tau)
+                hidden[id(reported)] = true
+                observed.append(reported)
+                i = j + 1
+            continue
+        lat, lon = shift(point, rng.gauss(0, GNSS_NOISE), rng.gauss(0, GNSS_NOISE))
+        observed.append(TrackPoint(time=point.time, lat=lat, lon=lon, alt=point.alt,
+                                   east=point.east, north=point.north))
+        i += 1
+    return observed, hidden
+
+
+def summary(errors: list[float]) -> str:
+    errors = sorted(errors)
+    if not errors:
+        return "no samples"
+    return (f"mean {sum(errors) / len(errors):7.1f} m  p95 {errors[int(0.95 * (len(errors) - 1))]:7.1f} m  "
+            f"max {errors[-1]:7.1f} m")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--trace", type=Path, help="recorded status documents, one JSON object per line")
+    parser.add_argument("--vehicles", type=int, default=200, help="synthetic vehicles")
+    parser.add_argument("--length", type=int, default=2000, help="synthetic reports per vehicle")
+    parser.add_argument("--interval", type=float, default=5.0, help="s between synthetic reports")
+    parser.add_argument("--outage-rate", type=float, default=0.01, help="chance per fix that GNSS drops out")
+    parser.add_argument("--bias", type=float, default=0.02, help="m/s^2, accelerometer bias sigma")
+    parser.add_argument("--velocity-error", type=float, default=0.3, help="m/s, velocity error sigma")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    if args.trace:
+        truths = recorded_tracks(args.trace)
+    else:
+        truths = [synthetic_track(rng, args.length, args.interval) for _ in range(args.vehicles)]
+
+    cases: list[tuple[Segment, list[TrackPoint]]] = []
+    for truth in truths:
+        observed, hidden = cut_outages(rng, truth, args.outage_rate, args.bias, args.velocity_error)
+        for segment in find_segments(observed):
+            cases.append((segment, [hidden[id(point)] for point in segment.points]))
+
+    points = sum(len(segment.points) for segment, _ in cases)
+    print(f"{len(truths)} tracks, {len(cases)} outages, {points} dead-reckoned records")
+    raw = [distance((p.lat, p.lon), (t.lat, t.lon)) for segment, true in cases for p, t in zip(segment.points, true)]
+    print(f"  {'uncorrected':<12}{summary(raw)}")
+
+    for order in (1.0, 2.0):
+        errors = []
+        started = time.perf_counter()
+        corrected = [correct_segment(segment, order) for segment, _ in cases]
+        elapsed = time.perf_counter() - started
+        for (segment, true), positions in zip(cases, corrected):
+            errors.extend(distance((lat, lon), (t.lat, t.lon)) for (lat, lon, _), t in zip(positions, true))
+        rate = points / elapsed if elapsed else math.inf
+        print(f"  {f'order {order:g}':<12}{summary(errors)}   {rate / 1000:8.1f} k records/s")
+
+
+if __name__ == "__main__":
+    main()
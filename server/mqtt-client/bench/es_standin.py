@@ -0,0 +1,113 @@
+"""Minimal Elasticsearch stand-in for benchmarks.
+
+Answers the calls the mqtt-client service makes (index templates, index
+exists/create, document and bulk writes) without storing anything, and hands
+every written document to a callback together with the monotonic time it
+arrived. An optional delay per write stands in for the service time of a real
+cluster. A callback that raises fails the request with 503, as an overloaded
+cluster would.
+"""
+import json
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from typing import Callable
+
+# elasticsearch-py 8 refuses servers that do not identify as Elasticsearch
+PRODUCT_HEADERS = {"X-Elastic-Product": "Elasticsearch", "Content-Type": "application/json"}
+
+OnDocument = Callable[[str, dict, float], None]
+
+
+class StandInHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    on_document: OnDocument
+    write_delay: float
+    indices: set
+
+    def do_HEAD(self):
+        index = self.path_parts()[0] if self.path_parts() else ""
+        self.reply(200 if index in self.indices else 404, None)
+
+    def do_GET(self):
+        self.reply(200, {"name": "standin", "version": {"number": "8.0.0"}, "tagline": "You Know, for Search"})
+
+    def do_PUT(self):
+        self.write()
+
+    def do_POST(self):
+        self.write()
+
+    def write(self):
+        arrival = time.monotonic()
+        length = int(self.headers.get("Content-Length", 0))
+        body = self.rfile.read(length) if length else b""
+        parts = self.path_parts()
+
+        if parts and parts[0] == "_index_template":
+            self.reply(200, {"acknowledged": True})
+            return
+        if parts == ["_bulk"]:
+            self.bulk(body, arrival)
+            return
+        if len(parts) == 1:
+            self.indices.add(parts[0])
+            self.reply(200, {"acknowledged": True, "shards_acknowledged": True, "index": parts[0]})
+            return
+        if len(parts) < 2 or parts[1] != "_doc":
+            self.reply(400, {"error": f"unsupported path {self.path}"})
+            return
+
+        if self.write_delay:
+            time.sleep(self.write_delay)
+        try:
+            self.on_document(parts[0], json.loads(body), arrival)
+        except Exception as e:
+            self.reply(503, {"error": str(e)})
+            return
+        self.reply(201, {
+            "_index": parts[0], "_id": parts[2] if len(parts) > 2 else "standin", "_version": 1,
+            "result": "created", "_shards": {"total": 1, "successful": 1, "failed": 0},
+            "_seq_no": 0, "_primary_term": 1,
+        })
+
+    def bulk(self, body: bytes, arrival: float):
+        lines = [line for line in body.splitlines() if line.strip()]
+        if self.write_delay:
+            time.sleep(self.write_delay)
+        items = []
+        for action_line, source_line in zip(lines[::2], lines[1::2]):
+            operation, meta = next(iter(json.loads(action_line).items()))
+            try:
+                self.on_document(meta["_index"], json.loads(source_line), arrival)
+            except Exception as e:
+                self.reply(503, {"error": str(e)})
+                return
+            items.append({operation: {"_index": meta["_index"], "_id": meta.get("_id", "standin"), "status": 201}})
+        self.reply(200, {"took": 0, "errors": False, "items": items})
+
+    def path_parts(self) -> list[str]:
+        return [part for part in self.path.split("?")[0].split("/") if part]
+
+    def reply(self, status: int, body: dict | None):
+        data = json.dumps(body).encode() if body is not None else b""
+        self.send_response(status)
+        for name, value in PRODUCT_HEADERS.items():
+            self.send_header(name, value)
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        if data and self.command != "HEAD":
+            self.wfile.write(data)
+
+    def log_message(self, format, *args):
+        pass
+
+
+def serve(on_document: OnDocument, write_delay: float = 0.0, port: int = 0) -> ThreadingHTTPServer:
+    """Starts the stand-in on a daemon thread; server.server_port is the bound port."""
+    handler = type("BoundStandInHandler", (StandInHandler,), {
+        "on_document": staticmethod(on_document), "write_delay": write_delay, "indices": set(),
+    })
+    server = ThreadingHTTPServer(("127.0.0.1", port), handler)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    return server
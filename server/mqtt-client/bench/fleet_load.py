@@ -0,0 +1,402 @@
+"""Fleet load generator and end-to-end latency benchmark for the mqtt-client service.
+
+    python3 bench/fleet_load.py --devices 100 500 1000 --interval 5 --duration 60
+    python3 bench/fleet_load.py --devices 1000 --format 74   # legacy firmware
+
+Per run it starts app/main.py against a local MQTT broker and an in-process
+Elasticsearch stand-in (bench/es_standin.py), then lets N simulated vehicles
+publish VehicleStatus records to it. Latency is measured from the publish call
+to the moment the service's document write reaches the stand-in. Each run
+reports the offered rate, the sustained indexing throughput, p50/p99/max
+latency and the backlog: records published but not indexed yet, its growth
+rate over the run and the time needed to drain it once publishing stops.
+
+Devices drive around on their own headings and go through the same patterns
+as the firmware: GNSS outages, during which locations are dead-reckoned and
+their freshness grows, and uplink outages, during which nothing reaches the
+broker (the device falls back to SMS).
+
+Every device publishes on <topic>/<vehicle id>, as the firmware does, so the
+service keeps one reorder window, live state and rollup series per vehicle.
+By default the records use the current 80-byte layout, with a per-device
+sequence number, and go through the reorder window; a record is matched to
+its document by vehicle and sequence. --format 74 sends the legacy layout,
+which the service indexes directly; such a record is matched by vehicle,
+device time (whole seconds) and float32 latitude and longitude.
+
+Needs paho-mqtt and a broker, e.g. `mosquitto -p 1883`.
+"""
+import argparse
+import heapq
+import json
+import math
+import os
+import random
+import struct
+import subprocess
+import sys
+import threading
+import time
+from dataclasses import asdict, dataclass
+from datetime import datetime
+from pathlib import Path
+from zoneinfo import ZoneInfo
+
+import paho.mqtt.client as mqtt
+from paho.mqtt.enums import CallbackAPIVersion
+
+import es_standin
+
+SERVICE = Path(__file__).resolve().parent.parent / "app" / "main.py"
+LOCAL_TZ = ZoneInfo("Asia/Tehran")
+PAYLOAD_FORMATS = {
+    74: struct.Struct("<BBBBBH3f3f3f3f3fBIBb"),     # PAYLOAD_FORMATS in app/main.py
+    80: struct.Struct("<BBBBBH3f3f3f3f3fBIBbHI"),   # + millisecond, sequence
+}
+STATUS_INDEX = "bench-status"
+EARTH_RADIUS = 6371000.0  # m
+GRID_SPACING = 0.002  # degrees between starting points
+GRID_COLUMNS = 100
+BASE_LAT, BASE_LON = 35.70, 51.39
+
+
+def float32(value: float) -> float:
+    return struct.unpack("<f", struct.pack("<f", value))[0]
+
+
+class SimulatedDevice:
+    """One vehicle publishing on the firmware's report cycle."""
+
+    def __init__(self, vehicle: str, index: int, rng: random.Random, payload_size: int,
+                 gps_outage_rate: float, uplink_outage_rate: float):
+        self.vehicle = vehicle
+        self.payload_format = PAYLOAD_FORMATS[payload_size]
+        # Numbers are only taken by records that are published, as on the device
+        self.sequence = 0 if payload_size == 80 else None
+        self.lat = BASE_LAT + GRID_SPACING * (index // GRID_COLUMNS)
+        self.lon = BASE_LON + GRID_SPACING * (index % GRID_COLUMNS)
+        self.alt = 1190.0 + rng.uniform(-20, 20)
+        self.heading = rng.uniform(0, 360)
+        self.speed = rng.uniform(0, 20)
+        self.signal = rng.randint(40, 90)
+        self.battery = rng.choice([-1, rng.randint(20, 100)])
+        self.rng = rng
+        self.gps_outage_rate = gps_outage_rate
+        self.uplink_outage_rate = uplink_outage_rate
+        self.gps_outage_left = 0
+        self.uplink_outage_left = 0
+        self.last_fix = time.monotonic()
+
+    def next_record(self, interval: float) -> tuple[bytes, tuple] | None:
+        """Advances the vehicle by one report interval; None while the uplink is down."""
+        now = time.monotonic()
+        rng = self.rng
+
+        self.heading = (self.heading + rng.gauss(0, 15)) % 360
+        self.speed = min(30.0, max(0.0, self.speed + rng.gauss(0, 1.5)))
+        # Still vehicles stay exactly where they are, as on the device
+        if self.speed < 0.5:
+            self.speed = 0.0
+        distance = self.speed * interval
+        heading = math.radians(self.heading)
+        self.lat += math.degrees(distance * math.cos(heading) / EARTH_RADIUS)
+        self.lon += math.degrees(distance * math.sin(heading) / (EARTH_RADIUS * math.cos(math.radians(self.lat))))
+
+        if self.uplink_outage_left:
+            self.uplink_outage_left -= 1
+            return None
+        if rng.random() < self.uplink_outage_rate:
+            self.uplink_outage_left = rng.randint(5, 30)
+            return None
+
+        if self.gps_outage_left:
+            self.gps_outage_left -= 1
+        elif rng.random() < self.gps_outage_rate:
+            self.gps_outage_left = rng.randint(3, 20)
+        dead_reckoned = self.gps_outage_left > 0
+        if not dead_reckoned:
+            self.last_fix = now
+
+        t = datetime.now(LOCAL_TZ)
+        lat, lon = float32(self.lat), float32(self.lon)
+        east, north = self.speed * math.sin(heading), self.speed * math.cos(heading)
+        fields = (
+            t.second, t.minute, t.hour, t.day, t.month, t.year,
+            rng.gauss(0, 0.3), rng.gauss(0, 0.3), rng.gauss(0, 0.05),
+            east, north, 0.0,
+            rng.gauss(0, 0.02), rng.gauss(0, 0.02), rng.gauss(0, 0.1),
+            rng.gauss(0, 2), rng.gauss(0, 2), self.heading,
+            lon, lat, self.alt,
+            dead_reckoned, int((now - self.last_fix) * 1000), self.signal, self.battery,
+        )
+        if self.sequence is None:
+            return self.payload_format.pack(*fields), record_key(self.vehicle, t, lat, lon)
+        self.sequence += 1
+        payload = self.payload_format.pack(*fields, t.microsecond // 1000, self.sequence - 1)
+        return payload, (self.vehicle, self.sequence - 1)
+
+
+def record_key(vehicle: str, t: datetime, lat: float, lon: float) -> tuple:
+    return vehicle, t.year, t.month, t.day, t.hour, t.minute, t.second, lat, lon
+
+
+@dataclass
+class RunResult:
+    devices: int
+    interval: float
+    duration: float
+    offered_rate: float
+    throughput: float
+    latency_p50_ms: float
+    latency_p99_ms: float
+    latency_max_ms: float
+    backlog_end: int
+    backlog_growth: float
+    drain_s: float
+    lost: int
+    unmatched: int
+    max_schedule_lag_ms: float
+
+
+class RunStats:
+    """Publish times of records in flight, matched against the stand-in's writes."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.pending: dict[tuple, float] = {}
+        self.latencies: list[tuple[float, float]] = []  # (publish time, latency)
+        self.arrivals: list[float] = []
+        self.unmatched = 0
+
+    def published(self, key: tuple, at: float):
+        with self.lock:
+            self.pending[key] = at
+
+    def on_document(self, index: str, doc: dict, arrival: float):
+        # Status records land in time partitions, STATUS_INDEX-<day>
+        if not index.startswith(STATUS_INDEX):
+            return
+        if "sequence" in doc:
+            key = (doc["vehicle"], doc["sequence"])
+        else:
+            t = datetime.fromisoformat(doc["time"])
+            key = record_key(doc["vehicle"], t, doc["location"]["lat"], doc["location"]["lon"])
+        with self.lock:
+            self.arrivals.append(arrival)
+            published = self.pending.pop(key, None)
+            if published is None:
+                self.unmatched += 1
+            else:
+                self.latencies.append((published, arrival - published))
+
+    def backlog(self) -> int:
+        with self.lock:
+            return len(self.pending)
+
+
+def percentile(values: list[float], q: float) -> float:
+    if not values:
+        return math.nan
+    values = sorted(values)
+    return values[min(len(values) - 1, int(q * len(values)))]
+
+
+def slope(samples: list[tuple[float, int]]) -> float:
+    """Least-squares growth per second of (time, value) samples."""
+    if len(samples) < 2:
+        return 0.0
+    mean_t = sum(t for t, _ in samples) / len(samples)
+    mean_v = sum(v for _, v in samples) / len(samples)
+    var = sum((t - mean_t) ** 2 for t, _ in samples)
+    return sum((t - mean_t) * (v - mean_v) for t, v in samples) / var if var else 0.0
+
+
+class Bench:
+    def __init__(self, args):
+        self.args = args
+        self.stats = RunStats()
+        self.standin = es_standin.serve(lambda *event: self.stats.on_document(*event), args.es_write_delay / 1000)
+
+    def start_service(self, run_id: str, topic: str) -> subprocess.Popen:
+        env = dict(os.environ)
+        for name in ("ES_CA_CERT", "ES_USER", "ES_PASSWORD"):
+            env.pop(name, None)
+        env.update({
+            "MQTT_SERVER": self.args.broker,
+            "MQTT_PORT": str(self.args.port),
+            "MQTT_TOPIC": topic,
+            "MQTT_HEALTH_TOPIC": f"{topic}/health",
+            "MQTT_TRIP_TOPIC": f"{topic}/trip",
+            "MQTT_BLACKBOX_TOPIC": f"{topic}/blackbox",
+            "MQTT_CLIENT_ID": f"fleet-bench-{run_id}",
+            "ES_HOST": f"http://127.0.0.1:{self.standin.server_port}",
+            "ES_INDEX": STATUS_INDEX,
+            "ES_HEALTH_INDEX": "bench-health",
+            "ES_TRIP_INDEX": "bench-trips",
+            "ES_ROLLUP_INDEX": "bench-rollup",
+            "LIVE_API_PORT": "0",
+        })
+        log = open(self.args.service_log, "a") if self.args.service_log else subprocess.DEVNULL
+        return subprocess.Popen([sys.executable, str(SERVICE)], cwd=SERVICE.parent, env=env,
+                                stdout=log, stderr=subprocess.STDOUT)
+
+    def connect_publishers(self, run_id: str) -> list[mqtt.Client]:
+        clients = []
+        for i in range(self.args.connections):
+            client = mqtt.Client(client_id=f"fleet-bench-{run_id}-{i}", protocol=mqtt.MQTTv311,
+                                 callback_api_version=CallbackAPIVersion.VERSION2)
+            client.connect(self.args.broker, self.args.port)
+            client.loop_start()
+            clients.append(client)
+        return clients
+
+    def wait_until_ready(self, client: mqtt.Client, topic: str, service: subprocess.Popen):
+        """Publishes probe records until one comes out the other end."""
+        probe = SimulatedDevice("bench-probe", 0, random.Random(0), self.args.format, 0.0, 0.0)
+        probe.lat, probe.lon = BASE_LAT - 1.0, BASE_LON - 1.0
+        deadline = time.monotonic() + self.args.startup_timeout
+        while not self.stats.arrivals:
+            if service.poll() is not None:
+                sys.exit(f"service exited with {service.returncode}; rerun with --service-log")
+            if time.monotonic() > deadline:
+                sys.exit("service did not index a probe record; is the broker running?")
+            probe.lat += GRID_SPACING / 10
+            payload, key = probe.next_record(1.0)
+            self.stats.published(key, time.monotonic())
+            client.publish(f"{topic}/{probe.vehicle}", payload)
+            time.sleep(0.5)
+
+    def run(self, devices: int) -> RunResult:
+        run_id = f"{os.getpid()}-{devices}"
+        topic = f"bench/{run_id}/vehicle-monitoring"
+        service = self.start_service(run_id, topic)
+        clients = self.connect_publishers(run_id)
+        try:
+            self.wait_until_ready(clients[0], topic, service)
+            self.stats = RunStats()
+            return self.measure(devices, clients, topic)
+        finally:
+            for client in clients:
+                client.loop_stop()
+                client.disconnect()
+            service.terminate()
+            service.wait()
+
+    def measure(self, devices: int, clients: list[mqtt.Client], topic: str) -> RunResult:
+        args = self.args
+        rng = random.Random(args.seed)
+        fleet = [SimulatedDevice(f"bench-{i}", i, random.Random(rng.random()), args.format,
+                                 args.gps_outage_rate, args.uplink_outage_rate)
+                 for i in range(devices)]
+
+        start = time.monotonic()
+        window_start = start + args.warmup
+        end = window_start + args.duration
+        # Reports are spread over the interval like unsynchronised devices
+        schedule = [(start + rng.uniform(0, args.interval), i) for i in range(devices)]
+        heapq.heapify(schedule)
+
+        samples: list[tuple[float, int]] = []
+        next_sample = window_start
+        published = 0
+        max_lag = 0.0
+
+        while schedule[0][0] < end:
+            due, i = heapq.heappop(schedule)
+            now = time.monotonic()
+            if due > now:
+                time.sleep(due - now)
+            else:
+                max_lag = max(max_lag, now - due)
+            record = fleet[i].next_record(args.interval)
+            if record:
+                payload, key = record
+                at = time.monotonic()
+                self.stats.published(key, at)
+                # QoS 0, like the firmware's PubSubClient publish
+                clients[i % len(clients)].publish(f"{topic}/{fleet[i].vehicle}", payload)
+                if at >= window_start:
+                    published += 1
+            heapq.heappush(schedule, (due + args.interval, i))
+
+            if now >= next_sample:
+                samples.append((now - window_start, self.stats.backlog()))
+                next_sample += 1.0
+
+        backlog_end = self.stats.backlog()
+        drain_start = time.monotonic()
+        while self.stats.backlog() and time.monotonic() - drain_start < args.drain_timeout:
+            time.sleep(0.05)
+        drain = time.monotonic() - drain_start
+
+        with self.stats.lock:
+            latencies = [latency * 1000 for at, latency in self.stats.latencies if at >= window_start]
+            indexed = sum(1 for at in self.stats.arrivals if window_start <= at < end)
+            lost = len(self.stats.pending)
+            unmatched = self.stats.unmatched
+
+        return RunResult(
+            devices=devices,
+            interval=args.interval,
+            duration=args.duration,
+            offered_rate=published / args.duration,
+            throughput=indexed / args.duration,
+            latency_p50_ms=percentile(latencies, 0.50),
+            latency_p99_ms=percentile(latencies, 0.99),
+            latency_max_ms=max(latencies, default=math.nan),
+            backlog_end=backlog_end,
+            backlog_growth=slope(samples),
+            drain_s=drain,
+            lost=lost,
+            unmatched=unmatched,
+            max_schedule_lag_ms=max_lag * 1000,
+        )
+
+
+def print_result(result: RunResult):
+    print(f"{result.devices:>7} {result.offered_rate:>9.1f} {result.throughput:>9.1f} "
+          f"{result.latency_p50_ms:>8.1f} {result.latency_p99_ms:>8.1f} {result.latency_max_ms:>8.1f} "
+          f"{result.backlog_end:>8} {result.backlog_growth:>+8.2f} {result.drain_s:>7.1f} {result.lost:>5}")
+    if result.max_schedule_lag_ms > 1000 * result.interval / 10:
+        print(f"        generator fell {result.max_schedule_lag_ms:.0f} ms behind schedule; "
+              f"the offered rate is below the target")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--devices", type=int, nargs="+", default=[100], help="fleet size per run")
+    parser.add_argument("--interval", type=float, default=30.0, help="s between reports of one device")
+    parser.add_argument("--format", type=int, choices=sorted(PAYLOAD_FORMATS), default=80,
+                        help="status record size: 80 sequenced, 74 legacy")
+    parser.add_argument("--duration", type=float, default=60.0, help="s measured per run")
+    parser.add_argument("--warmup", type=float, default=10.0, help="s published before measuring")
+    parser.add_argument("--drain-timeout", type=float, default=60.0, help="s to wait for the backlog after a run")
+    parser.add_argument("--gps-outage-rate", type=float, default=0.02, help="chance per report to lose GNSS")
+    parser.add_argument("--uplink-outage-rate", type=float, default=0.005, help="chance per report to lose GPRS")
+    parser.add_argument("--connections", type=int, default=8, help="publisher connections shared by the fleet")
+    parser.add_argument("--es-write-delay", type=float, default=0.0, help="ms the stand-in spends per write")
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--startup-timeout", type=float, default=60.0)
+    parser.add_argument("--service-log", help="append the service's output to this file")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--json", help="also write the results to this file")
+    args = parser.parse_args()
+    if args.format == 74 and args.interval < 1:
+        parser.error("--interval below 1 s: legacy records carry whole seconds only")
+
+    bench = Bench(args)
+    results = []
+    print(f"{'devices':>7} {'offered/s':>9} {'indexed/s':>9} {'p50 ms':>8} {'p99 ms':>8} {'max ms':>8} "
+          f"{'backlog':>8} {'growth/s':>8} {'drain s':>7} {'lost':>5}")
+    for devices in args.devices:
+        result = bench.run(devices)
+        print_result(result)
+        results.append(result)
+
+    if args.json:
+        Path(args.json).write_text(json.dumps([asdict(result) for result in results], indent=2) + "\n")
+
+
+if __name__ == "__main__":
+    main()
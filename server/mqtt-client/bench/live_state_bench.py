@@ -0,0 +1,80 @@
+"""Cost of publishing the live store's snapshot (app/live_state.py).
+
+    python3 bench/live_state_bench.py --vehicles 1000 10000 100000
+
+Fills the store with a fleet spread over a city-sized grid, then applies one
+publish interval's worth of updates (every vehicle reports once per
+--report-interval) and publishes, over and over. Reports the time per update,
+per publish and the share of one core the publishes take at the configured
+publish interval.
+"""
+import argparse
+import math
+import random
+import sys
+import time
+from datetime import datetime, timedelta
+from pathlib import Path
+from zoneinfo import ZoneInfo
+
+sys.path.insert(0, str(Path(__file__).resolve().parent.parent / "app"))
+
+from live_state import LatestStateStore, VehicleState  # noqa: E402
+
+LOCAL_TZ = ZoneInfo("Asia/Tehran")
+
+
+def state(vehicle: str, time: datetime, rng: random.Random) -> VehicleState:
+    return VehicleState(
+        vehicle=vehicle, time=time,
+        lat=35.70 + rng.uniform(-0.3, 0.3), lon=51.39 + rng.uniform(-0.3, 0.3), altitude=1190.0,
+        speed=rng.uniform(0, 20), heading=rng.uniform(0, 360), is_location_dead_reckoned=False,
+        signal_strength=80, battery_status=90, trail=(),
+    )
+
+
+def run(vehicles: int, args) -> tuple[float, float, int]:
+    """(s per update, s per publish, updates per publish)"""
+    rng = random.Random(1)
+    # Publishing is driven by hand below
+    store = LatestStateStore(args.trail_length, args.cell_size, publish_interval=math.inf)
+    start = datetime(2026, 1, 1, tzinfo=LOCAL_TZ)
+    names = [f"bench-{i}" for i in range(vehicles)]
+    for name in names:
+        store.update(state(name, start, rng))
+    store.publish()
+
+    batch = max(1, round(vehicles * args.publish_interval / args.report_interval))
+    update_time = publish_time = 0.0
+    for round_ in range(1, args.rounds + 1):
+        now = start + timedelta(seconds=round_)
+        updates = [state(rng.choice(names), now, rng) for _ in range(batch)]
+        started = time.perf_counter()
+        for update in updates:
+            store.update(update)
+        published = time.perf_counter()
+        store.publish()
+        update_time += published - started
+        publish_time += time.perf_counter() - published
+    return update_time / (args.rounds * batch), publish_time / args.rounds, batch
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--vehicles", type=int, nargs="+", default=[1000, 10000, 100000])
+    parser.add_argument("--report-interval", type=float, default=5.0, help="s between reports of a vehicle")
+    parser.add_argument("--publish-interval", type=float, default=0.1, help="LIVE_PUBLISH_INTERVAL, s")
+    parser.add_argument("--trail-length", type=int, default=60)
+    parser.add_argument("--cell-size", type=float, default=0.05, help="degrees")
+    parser.add_argument("--rounds", type=int, default=50, help="publishes measured per fleet size")
+    args = parser.parse_args()
+
+    print(f"{'vehicles':>9}{'updates':>9}{'update us':>11}{'publish ms':>12}{'core %':>8}")
+    for vehicles in args.vehicles:
+        per_update, per_publish, batch = run(vehicles, args)
+        share = 100 * per_publish / args.publish_interval
+        print(f"{vehicles:>9}{batch:>9}{per_update * 1e6:>11.1f}{per_publish * 1000:>12.2f}{share:>8.1f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,118 @@
+"""Unit tests for app/reorder.py.
+
+    python3 -m unittest discover -s tests
+"""
+import sys
+import unittest
+from pathlib import Path
+
+sys.path.insert(0, str(Path(__file__).resolve().parent.parent / "app"))
+
+from reorder import ReorderWindow  # noqa: E402
+
+SIZE = 4
+TIMEOUT = 10.0
+BLOCK_SIZE = 256
+
+
+class ReorderWindowTest(unittest.TestCase):
+
+    def setUp(self):
+        self.now = 0.0
+        self.released = []
+        self.window = ReorderWindow(SIZE, TIMEOUT, BLOCK_SIZE, self.on_release, clock=lambda: self.now)
+
+    def on_release(self, vehicle, record):
+        self.released.append(record)
+
+    def push(self, *sequences):
+        for sequence in sequences:
+            self.window.push("v", sequence, f"#{sequence}")
+
+    def expire(self):
+        self.now += TIMEOUT
+        self.window.flush_expired()
+
+    def sequences(self):
+        return [record.sequence for record in self.released]
+
+    def stats(self):
+        return self.window.stats("v")
+
+    def test_first_record_is_held_for_an_earlier_one(self):
+        self.push(11)
+        self.assertEqual(self.sequences(), [])
+        self.push(10)
+        self.expire()
+        self.assertEqual(self.sequences(), [10, 11])
+        self.assertEqual(self.stats().gaps, 0)
+
+    def test_in_order_records_pass_through(self):
+        self.push(10)
+        self.expire()
+        self.push(11, 12, 13)
+        self.assertEqual(self.sequences(), [10, 11, 12, 13])
+
+    def test_hole_is_filled_before_release(self):
+        self.push(1)
+        self.expire()
+        self.push(3, 2)
+        self.assertEqual(self.sequences(), [1, 2, 3])
+        self.assertEqual(self.stats().gaps, 0)
+
+    def test_hole_gives_up_after_timeout_and_late_record_is_released(self):
+        self.push(1)
+        self.expire()
+        self.push(3)
+        self.expire()
+        self.assertEqual(self.sequences(), [1, 3])
+        self.assertEqual(self.released[-1].gap, 1)
+        self.push(2)
+        self.assertEqual(self.sequences(), [1, 3, 2])
+        self.assertTrue(self.released[-1].late)
+        self.assertEqual(self.stats().gaps, 0)
+        self.assertEqual(self.stats().late, 1)
+
+    def test_recent_duplicate_is_dropped(self):
+        self.push(1)
+        self.expire()
+        self.push(2, 2, 1)
+        self.assertEqual(self.sequences(), [1, 2])
+        self.assertEqual(self.stats().duplicates, 2)
+
+    def test_old_redelivery_is_indexed_again_rather_than_dropped(self):
+        self.push(0)
+        self.expire()
+        self.push(*range(1, 10), 3)
+        self.assertEqual(self.sequences(), list(range(10)) + [3])
+        self.assertEqual(self.stats().duplicates, 0)
+
+    def test_device_restart_loses_nothing(self):
+        self.push(580)
+        self.expire()
+        self.push(*range(581, 600))
+        self.push(602)
+        self.push(*range(20))
+        self.assertEqual(self.sequences(), list(range(580, 600)) + [602] + list(range(20)))
+        self.assertEqual(self.stats().duplicates, 0)
+        self.assertEqual(self.stats().restarts, 1)
+
+    def test_resume_at_next_block_is_not_a_gap(self):
+        self.push(250)
+        self.expire()
+        self.push(BLOCK_SIZE)
+        self.expire()
+        self.assertEqual(self.sequences(), [250, BLOCK_SIZE])
+        self.assertEqual(self.released[-1].gap, 0)
+        self.assertEqual(self.stats().restarts, 1)
+
+    def test_full_window_releases_without_waiting(self):
+        self.push(0)
+        self.expire()
+        self.push(2, 3, 4, 5)
+        self.assertEqual(self.sequences(), [0, 2, 3, 4, 5])
+        self.assertEqual(self.stats().gaps, 1)
+
+
+if __name__ == "__main__":
+    unittest.main()
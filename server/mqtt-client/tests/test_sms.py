@@ -0,0 +1,106 @@
+"""Round trips through app/sms.py with an encoder that mirrors edge-device/src/SmsPacker.cpp.
+
+    python3 -m unittest discover -s tests
+"""
+import base64
+import struct
+import sys
+import unittest
+from datetime import datetime, timedelta, timezone
+from pathlib import Path
+
+sys.path.insert(0, str(Path(__file__).resolve().parent.parent / "app"))
+
+from sms import SMS_EPOCH, SMS_HEADER_FORMAT, SMS_PACKED_VERSION, crc8, decode_packed_sms  # noqa: E402
+
+TZ = timezone(timedelta(hours=3, minutes=30))
+
+
+def varint(value: int) -> bytes:
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        out.append(byte | 0x80 if value else byte)
+        if not value:
+            return bytes(out)
+
+
+def zigzag(value: int) -> int:
+    return ((value << 1) ^ (value >> 31)) & 0xFFFFFFFF
+
+
+def encode(fixes: list[tuple[int, int, float, float, float, bool]], battery=80, signal=60) -> str:
+    """fixes: (seconds since 2000, sequence, latitude, longitude, speed m/s, dead reckoned)"""
+    first_time, first_sequence, first_lat, first_lon = fixes[0][0], fixes[0][1], fixes[0][2], fixes[0][3]
+    data = bytearray(struct.pack(SMS_HEADER_FORMAT, SMS_PACKED_VERSION, first_time, first_sequence,
+                                 round(first_lat * 1e5), round(first_lon * 1e5), battery, signal))
+    last = (first_time, first_sequence, round(first_lat * 1e5), round(first_lon * 1e5))
+    for time, sequence, lat, lon, speed, is_dead_reckoned in fixes:
+        lat, lon = round(lat * 1e5), round(lon * 1e5)
+        data += varint(time - last[0]) + varint(sequence - last[1])
+        data += varint(zigzag(lat - last[2])) + varint(zigzag(lon - last[3]))
+        data.append(min(int(speed * 2 + 0.5), 127) | (0x80 if is_dead_reckoned else 0))
+        last = (time, sequence, lat, lon)
+    data.append(crc8(bytes(data)))
+    return base64.b64encode(bytes(data)).decode()
+
+
+def seconds(dt: datetime) -> int:
+    return int((dt - SMS_EPOCH).total_seconds())
+
+
+class DecodePackedSmsTest(unittest.TestCase):
+
+    def test_round_trip(self):
+        start = seconds(datetime(2026, 10, 19, 8, 30))
+        fixes = [
+            (start, 1200, 35.70001, 51.39002, 0.0, False),
+            (start + 5, 1201, 35.70051, 51.38952, 12.5, False),
+            (start + 12, 1203, 35.69871, 51.39122, 20.0, True),
+        ]
+        decoded = decode_packed_sms(encode(fixes, battery=-1, signal=55), TZ)
+
+        self.assertEqual(len(decoded), 3)
+        for fix, (time, sequence, lat, lon, speed, is_dead_reckoned) in zip(decoded, fixes):
+            self.assertEqual(fix.time, (SMS_EPOCH + timedelta(seconds=time)).replace(tzinfo=TZ))
+            self.assertEqual(fix.sequence, sequence)
+            self.assertAlmostEqual(fix.latitude, lat, places=5)
+            self.assertAlmostEqual(fix.longitude, lon, places=5)
+            self.assertEqual(fix.speed, speed)
+            self.assertEqual(fix.is_location_dead_reckoned, is_dead_reckoned)
+            self.assertEqual(fix.battery_status, -1)
+            self.assertEqual(fix.signal_strength, 55)
+
+    def test_southern_and_western_coordinates(self):
+        start = seconds(datetime(2026, 1, 1))
+        decoded = decode_packed_sms(encode([(start, 0, -33.86785, -70.65073, 1.5, False),
+                                            (start + 1, 1, -33.86790, -70.65080, 1.5, False)]), TZ)
+        self.assertAlmostEqual(decoded[1].latitude, -33.8679, places=5)
+        self.assertAlmostEqual(decoded[1].longitude, -70.6508, places=5)
+
+    def test_unsynced_time_is_rejected(self):
+        with self.assertRaisesRegex(ValueError, "no device time"):
+            decode_packed_sms(encode([(0, 5, 35.7, 51.39, 0.0, False)]), TZ)
+
+    def test_corrupted_message_is_rejected(self):
+        text = encode([(seconds(datetime(2026, 1, 1)), 0, 35.7, 51.39, 0.0, False)])
+        data = bytearray(base64.b64decode(text))
+        data[6] ^= 0x01
+        with self.assertRaisesRegex(ValueError, "checksum"):
+            decode_packed_sms(base64.b64encode(bytes(data)).decode(), TZ)
+
+    def test_other_version_is_rejected(self):
+        data = bytearray(base64.b64decode(encode([(seconds(datetime(2026, 1, 1)), 0, 35.7, 51.39, 0.0, False)])))
+        data[0] = 1
+        data[-1] = crc8(bytes(data[:-1]))
+        with self.assertRaisesRegex(ValueError, "version"):
+            decode_packed_sms(base64.b64encode(bytes(data)).decode(), TZ)
+
+    def test_not_base64_is_rejected(self):
+        with self.assertRaises(ValueError):
+            decode_packed_sms("Lat:35.70 Lon:51.39", TZ)
+
+
+if __name__ == "__main__":
+    unittest.main()